@@ -30,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stack>
 #include "pseudo_base64.h"
 #include "hash_combine.h"
+#include "AnalysisCache.h"
 
 using namespace std;
 
@@ -89,13 +90,21 @@ struct MachO_File_ObjC::OverlapperType {
 	OverlapperType() : defined(false) {}
 	void union_with(const ClassType& cls) throw();
 	void union_with(const OverlapperType& ovlp) throw();
+	void union_with(const OverlapDatabase::Class& cls, ObjCTypeRecord& local) throw();
 	static void recursive_union_with_protocols(unsigned i, std::vector<OverlapperType>& overlappers, const std::vector<ClassType>& classes) throw();
 	void localize(ObjCTypeRecord& local, const ObjCTypeRecord& remote) throw();
 };
 
 #pragma mark -
 
-MachO_File_ObjC::MachO_File_ObjC(const char* path, bool perform_reduced_analysis, const char* arch) : MachO_File(path, arch), m_guess_data_segment(1), m_guess_text_segment(0), m_class_filter(NULL), m_method_filter(NULL), m_class_filter_extra(NULL), m_method_filter_extra(NULL), m_arch(arch), m_has_whitespace(false), m_hide_cats(false), m_hide_dogs(false), m_hints_file(NULL) {
+MachO_File_ObjC::MachO_File_ObjC(const char* path, bool perform_reduced_analysis, const char* arch) : MachO_File(path, arch), m_guess_data_segment(1), m_guess_text_segment(0), m_class_filter(NULL), m_method_filter(NULL), m_class_filter_extra(NULL), m_method_filter_extra(NULL), m_arch(arch), m_has_whitespace(false), m_hide_cats(false), m_hide_dogs(false), m_thread_count(1), m_incremental_headers(false), m_header_archive(NULL), m_hints_file(NULL) {
+	string objc_cache_key;
+	if (!m_cache_key.empty()) {
+		objc_cache_key = m_cache_key + (perform_reduced_analysis ? "#objc-reduced" : "#objc");
+		if (read_objc_cache(objc_cache_key))
+			return;
+	}
+	
 	if (perform_reduced_analysis) {
 		retrieve_reduced_class_info();
 	} else {
@@ -109,6 +118,10 @@ MachO_File_ObjC::MachO_File_ObjC(const char* path, bool perform_reduced_analysis
 	
 	if (!perform_reduced_analysis)
 		m_record.create_short_circuit_weak_links();
+	m_record.freeze_links();
+	
+	if (!objc_cache_key.empty())
+		write_objc_cache(objc_cache_key);
 }
 
 void MachO_File_ObjC::tag_propertized_methods(ClassType& cls) throw() {
@@ -147,69 +160,98 @@ void MachO_File_ObjC::tag_propertized_methods(ClassType& cls) throw() {
 	}
 }
 
+typedef tr1::unordered_map<string, vector<unsigned> > NameIndex;
+
+// append the indices filed under name (if any) to result.
+static void append_indices(const NameIndex& index, const string& name, vector<unsigned>& result) {
+	NameIndex::const_iterator cit = index.find(name);
+	if (cit != index.end())
+		result.insert(result.end(), cit->second.begin(), cit->second.end());
+}
+
 void MachO_File_ObjC::propertize(ClassType& cls) throw() {
 #pragma mark Phase 1: Propertization by matching setXxx: with xxx or isXxx
-	// 1.1. Prepare all setters.
+	// 1.1. Prepare all setters, and index the potential getters (instance methods with no parameters) by name.
+	//      The index only filters by the static conditions. The status is checked again on match since it changes as we go.
 	vector<Method*> potential_setters;
-	for (vector<Method>::iterator mit = cls.methods.begin(); mit != cls.methods.end(); ++ mit) {
-		if (mit->propertize_status == PS_None && !mit->is_class_method && mit->types.size() == 4 && m_record.is_void_type(mit->types[0]))
-			if (strncmp(mit->raw_name, "set", 3) == 0)
-				potential_setters.push_back(&*mit);
+	NameIndex getters_by_name;
+	for (unsigned i = 0; i < cls.methods.size(); ++ i) {
+		Method& method = cls.methods[i];
+		if (method.propertize_status != PS_None || method.is_class_method)
+			continue;
+		if (method.types.size() == 4 && m_record.is_void_type(method.types[0]) && strncmp(method.raw_name, "set", 3) == 0)
+			potential_setters.push_back(&method);
+		else if (method.types.size() == 3)
+			getters_by_name[method.raw_name].push_back(i);
 	}
 	
 	// 1.2 Actually do the match.
-	string property_name;
+	string property_name, potential_name;
 	bool has_getter;
 	unsigned converted_property_start = cls.properties.size();
+	vector<unsigned> candidates;
 	for (vector<Method*>::iterator sit = potential_setters.begin(); sit != potential_setters.end(); ++ sit) {
-		size_t potential_name_length = strlen((*sit)->raw_name) - 4;
-		const char* potential_name = (*sit)->raw_name + 3;
+		size_t raw_name_length = strlen((*sit)->raw_name);
+		if (raw_name_length < 5)
+			continue;
+		potential_name.assign((*sit)->raw_name + 3, raw_name_length - 4);
 		
-		for (vector<Method>::iterator mit = cls.methods.begin(); mit != cls.methods.end(); ++ mit) {
-			if (*sit != &*mit && mit->propertize_status == PS_None && (*sit)->optional == mit->optional && !mit->is_class_method && mit->types.size() == 3 && mit->types[0] == (*sit)->types[3]) {
-				
-				if (strncmp(potential_name+1, mit->raw_name+1, potential_name_length-1) == 0 && mit->raw_name[potential_name_length] == '\0') {
-					if (potential_name[0] == toupper(mit->raw_name[0])) {
-						has_getter = false;
-						property_name = mit->raw_name;
-						goto phase_1_is_property;
-					}
-				} else if (strncmp(mit->raw_name, "is", 2) == 0 && strncmp(potential_name+1, mit->raw_name+3, potential_name_length-1) == 0 && mit->raw_name[potential_name_length+2] == '\0') {
-					if (potential_name[0] == mit->raw_name[2]) {
-						has_getter = true;
-						property_name = mit->raw_name+2;
-						property_name[0] = static_cast<char>(tolower(property_name[0]));
-						goto phase_1_is_property;
-					}
-				}
+		// setXxx: can pair with xxx, Xxx or isXxx. The first one in method order wins.
+		candidates.clear();
+		append_indices(getters_by_name, "is" + potential_name, candidates);
+		char first_char = potential_name[0];
+		if (toupper(first_char) == first_char)
+			append_indices(getters_by_name, potential_name, candidates);
+		char lowered_first_char = static_cast<char>(tolower(first_char));
+		if (lowered_first_char != first_char) {
+			potential_name[0] = lowered_first_char;
+			append_indices(getters_by_name, potential_name, candidates);
+		}
+		sort(candidates.begin(), candidates.end());
+		
+		for (vector<unsigned>::const_iterator cit = candidates.begin(); cit != candidates.end(); ++ cit) {
+			Method& getter = cls.methods[*cit];
+			if (getter.propertize_status != PS_None || (*sit)->optional != getter.optional || getter.types[0] != (*sit)->types[3])
 				continue;
-				
-phase_1_is_property:
-				Property prop;
-				prop.name = property_name;
-				prop.has_getter = has_getter;
-				prop.getter = mit->raw_name;
-				prop.setter = (*sit)->raw_name;
-				prop.getter_vm_address = mit->vm_address;
-				prop.setter_vm_address = (*sit)->vm_address;
-				prop.optional = mit->optional;
-				prop.impl_method = Property::IM_Converted;
-				prop.type = mit->types[0];
-				prop.retain = m_record.is_id_type(prop.type);
-				if (prop.retain && property_name.size() >= strlen("delegate")) {
-					string delegate_matcher = property_name.substr(property_name.size() - strlen("delegate"));
-					if (delegate_matcher == "Delegate" || delegate_matcher == "delegate")
-						prop.retain = false;
-				}
-				cls.properties.push_back(prop);
-				mit->propertize_status = PS_ConvertedGetter;
-				(*sit)->propertize_status = PS_ConvertedSetter;
-				break;
+			
+			if (strlen(getter.raw_name) == potential_name.size()) {
+				has_getter = false;
+				property_name = getter.raw_name;
+			} else {
+				has_getter = true;
+				property_name = getter.raw_name+2;
+				property_name[0] = static_cast<char>(tolower(property_name[0]));
+			}
+			
+			Property prop;
+			prop.name = property_name;
+			prop.has_getter = has_getter;
+			prop.getter = getter.raw_name;
+			prop.setter = (*sit)->raw_name;
+			prop.getter_vm_address = getter.vm_address;
+			prop.setter_vm_address = (*sit)->vm_address;
+			prop.optional = getter.optional;
+			prop.impl_method = Property::IM_Converted;
+			prop.type = getter.types[0];
+			prop.retain = m_record.is_id_type(prop.type);
+			if (prop.retain && property_name.size() >= strlen("delegate")) {
+				string delegate_matcher = property_name.substr(property_name.size() - strlen("delegate"));
+				if (delegate_matcher == "Delegate" || delegate_matcher == "delegate")
+					prop.retain = false;
 			}
-		}				
+			cls.properties.push_back(prop);
+			getter.propertize_status = PS_ConvertedGetter;
+			(*sit)->propertize_status = PS_ConvertedSetter;
+			break;
+		}
 	}
 	
 #pragma mark Phase 2: Propertization by matching readonly 
+	// Index the converted properties by name, so each ivar only looks at the ones it can specialize.
+	NameIndex converted_properties_by_name;
+	for (unsigned p = converted_property_start; p < cls.properties.size(); ++ p)
+		converted_properties_by_name[cls.properties[p].name].push_back(p);
+	
 	string alt_property_name;
 	for (vector<Ivar>::const_iterator iit = cls.ivars.begin(); iit != cls.ivars.end(); ++ iit) {
 		property_name = iit->name + strspn(iit->name, "_");
@@ -218,39 +260,44 @@ phase_1_is_property:
 		
 		// If the ivar is an id, there's a chance that a converted property can specialize to it.
 		if (m_record.can_dereference_to_id_type(iit->type)) {
-			for (unsigned p = converted_property_start; p < cls.properties.size(); ++ p) {
-				Property& prop = cls.properties[p];
-				if (prop.name == property_name && m_record.are_types_compatible(prop.type, iit->type)) {
-					prop.type = iit->type;	// it's ok for us to just move the type because it can never contain a struct. So refcount is unaffected.
-					goto phase_2_next_ivar;
+			NameIndex::const_iterator cit = converted_properties_by_name.find(property_name);
+			if (cit != converted_properties_by_name.end()) {
+				for (vector<unsigned>::const_iterator pit = cit->second.begin(); pit != cit->second.end(); ++ pit) {
+					Property& prop = cls.properties[*pit];
+					if (m_record.are_types_compatible(prop.type, iit->type)) {
+						prop.type = iit->type;	// it's ok for us to just move the type because it can never contain a struct. So refcount is unaffected.
+						goto phase_2_next_ivar;
+					}
 				}
 			}
 		}
 		
 		alt_property_name = "is" + property_name;
-		alt_property_name[2] = static_cast<char>(toupper(alt_property_name[2]));
+		if (alt_property_name.size() > 2)
+			alt_property_name[2] = static_cast<char>(toupper(alt_property_name[2]));
 		
 		// Now search for getters.
-		for (vector<Method>::iterator mit = cls.methods.begin(); mit != cls.methods.end(); ++ mit) {
-			if (mit->propertize_status == PS_None && !mit->is_class_method && mit->types.size() == 3 && m_record.are_types_compatible(mit->types[0], iit->type)) {
-				if (mit->raw_name == property_name)
-					has_getter = false;
-				else if (mit->raw_name == alt_property_name)
-					has_getter = true;
-				else
-					continue;
+		candidates.clear();
+		append_indices(getters_by_name, property_name, candidates);
+		append_indices(getters_by_name, alt_property_name, candidates);
+		sort(candidates.begin(), candidates.end());
+		
+		for (vector<unsigned>::const_iterator cit = candidates.begin(); cit != candidates.end(); ++ cit) {
+			Method& getter = cls.methods[*cit];
+			if (getter.propertize_status == PS_None && m_record.are_types_compatible(getter.types[0], iit->type)) {
 				Property prop;
 				prop.name = property_name;
-				prop.has_getter = has_getter;
-				prop.optional = mit->optional;
+				prop.has_getter = getter.raw_name != property_name;
+				prop.optional = getter.optional;
 				prop.readonly = true;
-				prop.getter = mit->raw_name;
-				prop.getter_vm_address = mit->vm_address;
+				prop.getter = getter.raw_name;
+				prop.getter_vm_address = getter.vm_address;
 				prop.impl_method = Property::IM_Converted;
 				prop.type = iit->type;
 				prop.retain = m_record.is_id_type(iit->type);
+				converted_properties_by_name[property_name].push_back(cls.properties.size());
 				cls.properties.push_back(prop);
-				mit->propertize_status = PS_ConvertedGetter;
+				getter.propertize_status = PS_ConvertedGetter;
 				break;
 			}
 		}
@@ -273,11 +320,46 @@ void MachO_File_ObjC::OverlapperType::union_with(const MachO_File_ObjC::Overlapp
 	methods.insert(cls.methods.begin(), cls.methods.end());
 }
 
+void MachO_File_ObjC::OverlapperType::union_with(const OverlapDatabase::Class& cls, ObjCTypeRecord& local) throw() {
+	defined = true;
+	for (vector<OverlapDatabase::Property>::const_iterator pit = cls.properties.begin(); pit != cls.properties.end(); ++ pit) {
+		ReducedProperty p;
+		p.name = pit->name;
+		p.getter = pit->getter;
+		p.setter = pit->setter;
+		p.type = local.parse(pit->type, false);
+		p.has_getter = pit->has_getter;
+		p.has_setter = pit->has_setter;
+		p.copy = pit->copy;
+		p.retain = pit->retain;
+		p.readonly = pit->readonly;
+		p.nonatomic = pit->nonatomic;
+		properties.insert(p);
+	}
+	for (vector<OverlapDatabase::Method>::const_iterator mit = cls.methods.begin(); mit != cls.methods.end(); ++ mit) {
+		ReducedMethod m;
+		m.raw_name = mit->raw_name;
+		m.is_class_method = mit->is_class_method;
+		m.types.reserve(mit->types.size());
+		for (vector<const char*>::const_iterator tit = mit->types.begin(); tit != mit->types.end(); ++ tit)
+			m.types.push_back(local.parse(*tit, false));
+		methods.insert(m);
+	}
+}
+
 void MachO_File_ObjC::OverlapperType::localize(ObjCTypeRecord& local, const ObjCTypeRecord& remote) throw() {
 	if (&local == &remote)
 		return;
 
 	// Since the unordered_set's iterator is equivalent to a const_iterator, we have to construct a new unordered_set.
+	tr1::unordered_set<ReducedProperty> old_properties;
+	properties.swap(old_properties);
+	for (tr1::unordered_set<ReducedProperty>::const_iterator pit = old_properties.begin(); pit != old_properties.end(); ++ pit) {
+		ReducedProperty p = *pit;
+		p.type = local.parse(remote.encoding_of_type(pit->type), false);
+		properties.insert(p);
+	}
+	
 	tr1::unordered_set<ReducedMethod> old_methods;
 	methods.swap(old_methods);
 	for (tr1::unordered_set<ReducedMethod>::const_iterator mit = old_methods.begin(); mit != old_methods.end(); ++ mit) {
@@ -300,51 +382,96 @@ void MachO_File_ObjC::recursive_union_with_protocols(unsigned i, std::vector<Ove
 		}	
 	}
 }
-void MachO_File_ObjC::recursive_union_with_superclasses(ObjCTypeRecord::TypeIndex ti, tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot) throw() {
-	OverlapperType& ovlp = superclass_overlappers[ti];
+DataFile* MachO_File_ObjC::create_reduced_library(const char* path, const char* arch) {
+	return new MachO_File_ObjC(path, true, arch);
+}
+
+void MachO_File_ObjC::recursive_union_with_superclasses(ObjCTypeRecord::TypeIndex ti, ObjCTypeRecord& local, tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot, LoadedLibraries& libraries) const throw() {
+	bool is_local = &local == &m_record;
+	OverlapperType& ovlp = superclass_overlappers[is_local ? ti : local.parse(m_record.encoding_of_type(ti), false)];
 	if (!ovlp.defined) {
 		tr1::unordered_map<ObjCTypeRecord::TypeIndex, unsigned>::const_iterator cit = ma_classes_typeindex_index.find(ti);
 		// Super class is internal. 
 		if (cit != ma_classes_typeindex_index.end()) {
 			const ClassType& cls = ma_classes[cit->second];
-			ovlp.union_with(cls);
+			if (is_local)
+				ovlp.union_with(cls);
+			else {
+				OverlapperType remote_ovlp;
+				remote_ovlp.union_with(cls);
+				remote_ovlp.localize(local, m_record);
+				ovlp.union_with(remote_ovlp);
+			}
 			if (!(cls.attributes & RO_ROOT)) {
-				recursive_union_with_superclasses(cls.superclass_index, superclass_overlappers, sysroot);
-				ovlp.union_with(superclass_overlappers[cls.superclass_index]);
+				recursive_union_with_superclasses(cls.superclass_index, local, superclass_overlappers, sysroot, libraries);
+				ovlp.union_with(superclass_overlappers[is_local ? cls.superclass_index : local.parse(m_record.encoding_of_type(cls.superclass_index), false)]);
 			}
 		// Super class is probably external.
 		} else {
 			tr1::unordered_map<ObjCTypeRecord::TypeIndex, const char*>::const_iterator lit = ma_lib_path.find(ti);
-			if (lit != ma_lib_path.end()) {
-				const char* libpath = lit->second;
-				tr1::unordered_map<const char*, MachO_File_ObjC*>::iterator loaded_lib = ma_loaded_libraries.find(libpath);
-				if (loaded_lib == ma_loaded_libraries.end()) {
-					size_t sysroot_len = strlen(sysroot);
-					bool sysroot_ends_with_slash = sysroot[sysroot_len-1] == '/';				
-					char* the_path = reinterpret_cast<char*>(alloca(sysroot_len + strlen(libpath) + 1));
-					memcpy(the_path, sysroot, sysroot_len);
-					strcpy(the_path+sysroot_len, libpath+(libpath[0]=='/'&&sysroot_ends_with_slash));
-					MachO_File_ObjC* mf = NULL;
-					try {
-						mf = new MachO_File_ObjC(the_path, true, m_arch);
-					} catch (...) {
-						mf = NULL;
-					}
-					loaded_lib = ma_loaded_libraries.insert( pair<const char*, MachO_File_ObjC*>(libpath, mf) ).first;
-				}
-				
-				MachO_File_ObjC* mf = loaded_lib->second;
-				if (mf != NULL) {
-					tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType> remote_superclass_overlappers;
-					ObjCTypeRecord::TypeIndex remote_index = mf->m_record.parse(m_record.encoding_of_type(ti), false);
-					mf->recursive_union_with_superclasses(remote_index, remote_superclass_overlappers, sysroot);
-					for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>::iterator tit = remote_superclass_overlappers.begin(); tit != remote_superclass_overlappers.end(); ++ tit) {
-						tit->second.localize(m_record, mf->m_record);
-						ObjCTypeRecord::TypeIndex local_index = m_record.parse(mf->m_record.encoding_of_type(tit->first), false);
-						superclass_overlappers[local_index].union_with(tit->second);
-					}
-				}
+			if (lit != ma_lib_path.end())
+				union_with_external_class(lit->second, m_record.encoding_of_type(ti), local, superclass_overlappers, sysroot, libraries);
+		}
+	}
+}
+
+static string path_in_sysroot(const char* sysroot, const char* libpath) {
+	size_t sysroot_len = strlen(sysroot);
+	bool sysroot_ends_with_slash = sysroot_len > 0 && sysroot[sysroot_len-1] == '/';
+	return string(sysroot, sysroot_len) + (libpath+(libpath[0]=='/'&&sysroot_ends_with_slash));
+}
+
+void MachO_File_ObjC::union_with_external_class(const char* libpath, const string& encoding, ObjCTypeRecord& local, tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot, LoadedLibraries& libraries) const throw() {
+	// Prefer the overlap database of the library, which saves analyzing it every time.
+	if (AnalysisCache::directory() != NULL) {
+		tr1::unordered_map<string, ImageHandle<OverlapDatabase> >::iterator loaded_db = libraries.overlap_databases.find(libpath);
+		if (loaded_db == libraries.overlap_databases.end()) {
+			ImageHandle<OverlapDatabase> handle;
+			try {
+				handle = ImageCache::shared().open<OverlapDatabase>(path_in_sysroot(sysroot, libpath).c_str(), m_arch, "OverlapDatabase");
+			} catch (...) {
+			}
+			loaded_db = libraries.overlap_databases.insert( pair<string, ImageHandle<OverlapDatabase> >(libpath, handle) ).first;
+		}
+		if (loaded_db->second) {
+			recursive_union_with_database(*loaded_db->second, encoding, local, superclass_overlappers, sysroot, libraries);
+			return;
+		}
+	}
+	
+	tr1::unordered_map<string, ImageHandle<MachO_File_ObjC> >::iterator loaded_lib = libraries.images.find(libpath);
+	if (loaded_lib == libraries.images.end()) {
+		ImageHandle<MachO_File_ObjC> handle;
+		try {
+			handle = ImageCache::shared().open<MachO_File_ObjC>(path_in_sysroot(sysroot, libpath).c_str(), m_arch, "MachO_File_ObjC/reduced", &create_reduced_library);
+		} catch (...) {
+		}
+		loaded_lib = libraries.images.insert( pair<string, ImageHandle<MachO_File_ObjC> >(libpath, handle) ).first;
+	}
+	
+	// the library may be used by other threads, so its record is only looked up, never parsed into.
+	// A class it has never seen has nothing to hide anyway.
+	const MachO_File_ObjC* mf = loaded_lib->second.get();
+	ObjCTypeRecord::TypeIndex remote_index;
+	if (mf != NULL && mf->m_record.lookup(encoding, remote_index))
+		mf->recursive_union_with_superclasses(remote_index, local, superclass_overlappers, sysroot, libraries);
+}
+
+// mirrors recursive_union_with_superclasses() for a library known through its database.
+void MachO_File_ObjC::recursive_union_with_database(const OverlapDatabase& database, const string& encoding, ObjCTypeRecord& local, tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot, LoadedLibraries& libraries) const throw() {
+	OverlapperType& ovlp = superclass_overlappers[local.parse(encoding, false)];
+	if (!ovlp.defined) {
+		const OverlapDatabase::Class* cls = database.find_class(encoding);
+		if (cls != NULL) {
+			ovlp.union_with(*cls, local);
+			if (cls->superclass != NULL) {
+				recursive_union_with_database(database, cls->superclass, local, superclass_overlappers, sysroot, libraries);
+				ovlp.union_with(superclass_overlappers[local.parse(cls->superclass, false)]);
 			}
+		} else {
+			const char* libpath = database.library_of(encoding);
+			if (libpath != NULL)
+				union_with_external_class(libpath, encoding, local, superclass_overlappers, sysroot, libraries);
 		}
 	}
 }
@@ -374,11 +501,14 @@ void MachO_File_ObjC::hide_overlapping_methods(bool hide_super, bool hide_proto,
 	if (hide_super) {
 		tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType> superclass_overlappers;
 		for (unsigned i = m_protocol_count; i < ma_classes.size(); ++ i)
-			recursive_union_with_superclasses(ma_classes[i].superclass_index, superclass_overlappers, sysroot);
+			recursive_union_with_superclasses(ma_classes[i].superclass_index, m_record, superclass_overlappers, sysroot, ma_loaded_libraries);
 		
 		for (unsigned i = m_protocol_count; i < ma_classes.size(); ++ i) {
 			ClassType& cls = ma_classes[i];
 			hide_overlapping_methods(cls, superclass_overlappers[cls.superclass_index], PS_Inherited);
 		}
+		
+		// localizing the superclasses may have added types and links.
+		m_record.freeze_links();
 	}
 }
@@ -33,6 +33,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <pcre.h>
 #include "TSVParser.h"
+#include "ImageCache.h"
+#include "OverlapDatabase.h"
+#include "PrefixTrie.h"
+
+class TarWriter;
 
 class MachO_File_ObjC : public MachO_File {
 private:
@@ -99,13 +104,13 @@ private:
 		HiddenMethodType hidden;
 		bool optional;
 		
-		enum {
+		enum ImplMethod {
 			IM_None,
 			IM_Synthesized,	// V
 			IM_Dynamic,		// D
 			IM_Converted
 		} impl_method;
-		enum {
+		enum GCStrength {
 			GC_None,
 			GC_Strong,		// P
 			GC_Weak			// W
@@ -145,7 +150,7 @@ private:
 	};
 	
 	struct ClassType {
-		enum {
+		enum Kind {
 			CT_Protocol,
 			CT_Class,
 			CT_Category,
@@ -176,6 +181,7 @@ private:
 	friend struct Property_AlphabeticSorter;
 	friend struct Method_AlphabeticAltSorter;
 	friend struct ClassType;
+	friend class OverlapDatabase;
 	
 //-------------------------------------------------------------------------------------------------------------------------------------------
 	
@@ -188,7 +194,15 @@ private:
 	std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, std::string> ma_include_paths;
 	std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, const char*> ma_lib_path;
 	
-	std::tr1::unordered_map<const char*, MachO_File_ObjC*> ma_loaded_libraries;
+	// the libraries holding external superclasses, by library path. They are shared through the ImageCache
+	// with everything else in the process, so they are only ever read. With the AnalysisCache, only their
+	// overlap databases are loaded; the reduced analyses are the fallback if a database cannot be stored.
+	struct LoadedLibraries {
+		std::tr1::unordered_map<std::string, ImageHandle<MachO_File_ObjC> > images;
+		std::tr1::unordered_map<std::string, ImageHandle<OverlapDatabase> > overlap_databases;
+	};
+	LoadedLibraries ma_loaded_libraries;
+	static DataFile* create_reduced_library(const char* path, const char* arch);
 	
 	ObjCTypeRecord m_record;
 	
@@ -206,28 +220,62 @@ private:
 	
 	void tag_propertized_methods(ClassType& cls) throw();
 	
+	// the result of the retrieval, before any of the options are applied. See MachO_File_ObjC_cache.cpp.
+	bool read_objc_cache(const std::string& key);
+	void write_objc_cache(const std::string& key) const;
+	// what an OverlapDatabase reads.
+	bool write_overlap_database(const std::string& key) const;
+	
 	void propertize(ClassType& cls) throw();
 	void hide_overlapping_methods(ClassType& target, const OverlapperType& reference, HiddenMethodType hiding_method) throw();
 	
 	void recursive_union_with_protocols(unsigned i, std::vector<OverlapperType>& overlappers) const throw();
-	void recursive_union_with_superclasses(ObjCTypeRecord::TypeIndex ti, std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot) throw();
+	// ti is a type of this image. The overlappers are keyed by, and refer to, the types of the local record.
+	void recursive_union_with_superclasses(ObjCTypeRecord::TypeIndex ti, ObjCTypeRecord& local, std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot, LoadedLibraries& libraries) const throw();
+	// the same for a class defined in the library, named by the encoding of its type.
+	void union_with_external_class(const char* libpath, const std::string& encoding, ObjCTypeRecord& local, std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot, LoadedLibraries& libraries) const throw();
+	void recursive_union_with_database(const OverlapDatabase& database, const std::string& encoding, ObjCTypeRecord& local, std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, OverlapperType>& superclass_overlappers, const char* sysroot, LoadedLibraries& libraries) const throw();
 	
 //-------------------------------------------------------------------------------------------------------------------------------------------
 	
 	pcre* m_class_filter, *m_method_filter;
 	pcre_extra* m_class_filter_extra, *m_method_filter_extra;
-	std::vector<std::string> m_kill_prefix;
+	PrefixTrie m_kill_prefix;
+	
+	static void free_filter(pcre*& filter, pcre_extra*& filter_extra) throw();
+	static void compile_filter(const char* regexp, pcre*& filter, pcre_extra*& filter_extra);
 	
 	bool name_killable(const char* name, size_t length, bool check_kill_prefix) const throw();
+	
+	// name_killable() of the names of the classes, protocols and structs, decided once per type and then looked up.
+	enum KillState {
+		KS_Classified = 1,
+		KS_KilledByFilter = 2,
+		KS_KilledByPrefix = 4
+	};
+	mutable std::vector<unsigned char> ma_kill_states;
+	// Classifying must not run concurrently with type_killable(), so it is done before formatting in parallel.
+	void classify_type_name(ObjCTypeRecord::TypeIndex type_index) const throw();
+	bool type_killable(ObjCTypeRecord::TypeIndex type_index, bool check_kill_prefix) const throw();
 		
 	friend bool mfoc_AlphabeticSorter(const ClassType* a, const ClassType* b) throw();
 	
-	std::vector<std::string> ma_string_store;	// store C-strings.
 	std::vector<Method> ma_method_store;
 	std::vector<Property> ma_property_store;
 	
 	const char* m_arch;
 	bool m_has_whitespace, m_hide_cats, m_hide_dogs, m_dont_typedef, m_ida_pro_mode;
+	unsigned m_thread_count;
+	bool m_incremental_headers;
+	TarWriter* m_header_archive;
+	
+	// state shared by the formatting jobs run through parallel_for().
+	struct FormatJobs;
+	static void format_class_type_job(void* context, std::size_t index);
+	static void write_header_file_job(void* context, std::size_t index);
+	
+	// format the classes in parallel. A NULL class is formatted as an empty string.
+	void format_class_types(const std::vector<const ClassType*>& classes, std::vector<std::string>& results, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_methods_by, bool show_only_exported_classes) const throw();
 	
 //-------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -243,12 +291,8 @@ public:
 public:	
 	MachO_File_ObjC(const char* path, bool perform_reduced_analysis = false, const char* arch = "any");
 	~MachO_File_ObjC() throw() {
-		if (m_class_filter != NULL) pcre_free(m_class_filter);
-		if (m_method_filter != NULL) pcre_free(m_method_filter);
-		if (m_class_filter_extra != NULL) pcre_free(m_class_filter_extra);
-		if (m_method_filter_extra != NULL) pcre_free(m_method_filter_extra);
-		for (std::tr1::unordered_map<const char*, MachO_File_ObjC*>::iterator it = ma_loaded_libraries.begin(); it != ma_loaded_libraries.end(); ++ it)
-			delete it->second;
+		free_filter(m_class_filter, m_class_filter_extra);
+		free_filter(m_method_filter, m_method_filter_extra);
 		delete m_hints_file;
 	}
 	
@@ -263,11 +307,17 @@ public:
 	void set_prettify_struct_names(bool prettify_struct_names = true) throw() { m_record.prettify_struct_names = prettify_struct_names; }
 	void set_class_filter(const char* regexp);
 	void set_method_filter(const char* regexp);
-	void set_kill_prefix(const std::vector<std::string>& kill_prefix) { m_kill_prefix = kill_prefix; }
+	void set_kill_prefix(const std::vector<std::string>& kill_prefix);
 	void set_method_has_whitespace(bool has_whitespace = true) throw() { m_has_whitespace = has_whitespace; }
 	void set_hide_cats_and_dogs(bool hide_cats, bool hide_dogs) throw() { m_hide_cats = hide_cats; m_hide_dogs = hide_dogs; }
 	void set_dont_typedef(bool dont_typedef) throw() { m_dont_typedef = dont_typedef; }
 	void set_ida_pro_mode(bool ida_pro_mode) throw() { m_ida_pro_mode = ida_pro_mode; }
+	// format the classes and write the header files on this many threads. The output does not depend on it.
+	void set_thread_count(unsigned thread_count) throw() { m_thread_count = thread_count > 0 ? thread_count : 1; }
+	// leave the headers with unchanged contents alone, and delete those of removed classes. See write_header_files().
+	void set_incremental_headers(bool incremental) throw() { m_incremental_headers = incremental; }
+	// add the headers to this archive instead of writing them as separate files. Incremental mode does not apply then.
+	void set_header_archive(TarWriter* archive) throw() { m_header_archive = archive; }
 	
 	void set_hints_file(const char* filename);
 	void write_hints_file(const char* filename) const;
@@ -280,7 +330,10 @@ public:
 	
 	void print_struct_declaration(SortBy sort_by) const throw();
 	
-	void write_header_files(const char* filename, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_by, bool show_only_exported_classes) const throw();
+	// write the headers into the directory, or the current directory if it is NULL. With a header archive, the directory
+	// is only used as the prefix of the names in the archive.
+	// In incremental mode, a manifest of the headers written is kept next to them, and a summary is printed to stderr.
+	void write_header_files(const char* filename, const char* directory, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_by, bool show_only_exported_classes) const throw();
 	
 //-------------------------------------------------------------------------------------------------------------------------------------------
 	
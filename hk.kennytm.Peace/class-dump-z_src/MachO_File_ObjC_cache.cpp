@@ -0,0 +1,417 @@
+/*
+
+MachO_File_ObjC_cache.cpp ... Storing the retrieved ObjC info in the AnalysisCache.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MachO_File_ObjC.h"
+#include "AnalysisCache.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+template <typename K, typename V> static void write_value(AnalysisCacheWriter& writer, const tr1::unordered_map<K,V>& m);
+template <typename K, typename V> static void read_value(AnalysisCacheReader& reader, tr1::unordered_map<K,V>& m);
+
+static inline void write_value(AnalysisCacheWriter& writer, unsigned value) { writer.write_uint(value); }
+static inline void write_value(AnalysisCacheWriter& writer, const string& value) { writer.write_string(value); }
+static inline void write_value(AnalysisCacheWriter& writer, const char* value) { writer.write_string(value); }
+
+static inline void read_value(AnalysisCacheReader& reader, unsigned& value) { value = reader.read_uint(); }
+static inline void read_value(AnalysisCacheReader& reader, string& value) { reader.read_string(value); }
+static inline void read_value(AnalysisCacheReader& reader, const char*& value) { value = reader.read_string(); }
+
+struct EntryKeyLess {
+	template <typename Iterator>
+	inline bool operator() (Iterator a, Iterator b) const { return a->first < b->first; }
+};
+
+// Hash tables are stored with their entries sorted by key, so the cache does not depend on the layout of
+// the table. Nothing printed may depend on the iteration order of a hash table either.
+template <typename K, typename V>
+static void write_value(AnalysisCacheWriter& writer, const tr1::unordered_map<K,V>& m) {
+	vector<typename tr1::unordered_map<K,V>::const_iterator> entries;
+	entries.reserve(m.size());
+	for (typename tr1::unordered_map<K,V>::const_iterator cit = m.begin(); cit != m.end(); ++ cit)
+		entries.push_back(cit);
+	sort(entries.begin(), entries.end(), EntryKeyLess());
+	
+	writer.write_uint(static_cast<unsigned>(entries.size()));
+	for (typename vector<typename tr1::unordered_map<K,V>::const_iterator>::const_iterator eit = entries.begin(); eit != entries.end(); ++ eit) {
+		write_value(writer, (*eit)->first);
+		write_value(writer, (*eit)->second);
+	}
+}
+
+template <typename K, typename V>
+static void read_value(AnalysisCacheReader& reader, tr1::unordered_map<K,V>& m) {
+	unsigned count = reader.read_uint();
+	if (!reader.can_read(count))
+		return;
+		
+	m.clear();
+	for (unsigned i = 0; i < count && reader.valid(); ++ i) {
+		K key;
+		read_value(reader, key);
+		read_value(reader, m[key]);
+	}
+}
+
+template <typename T>
+static void write_vector(AnalysisCacheWriter& writer, const vector<T>& v) {
+	writer.write_uint(static_cast<unsigned>(v.size()));
+	for (typename vector<T>::const_iterator cit = v.begin(); cit != v.end(); ++ cit)
+		write_value(writer, *cit);
+}
+
+template <typename T>
+static void read_vector(AnalysisCacheReader& reader, vector<T>& v) {
+	unsigned count = reader.read_uint();
+	if (!reader.can_read(count))
+		return;
+	v.resize(count);
+	for (unsigned i = 0; i < count && reader.valid(); ++ i)
+		read_value(reader, v[i]);
+}
+
+#pragma mark -
+
+void ObjCTypeRecord::write_cache(AnalysisCacheWriter& writer) const {
+	writer.write_uint(static_cast<unsigned>(ma_type_store.size()));
+	for (vector<Type>::const_iterator cit = ma_type_store.begin(); cit != ma_type_store.end(); ++ cit) {
+		writer.write_uint(static_cast<unsigned char>(cit->type));
+		writer.write_uint(cit->external);
+		writer.write_uint(cit->refcount);
+		writer.write_string(cit->encoding);
+		writer.write_string(cit->name);
+		writer.write_string(cit->value);
+		writer.write_string(cit->pretty_name);
+		write_vector(writer, cit->subtypes);
+		write_vector(writer, cit->field_names);
+		writer.write_uint(cit->type_index);
+	}
+	
+	write_value(writer, ma_indexed_types);
+	
+	// the links, as one sorted list per type.
+	writer.write_uint(static_cast<unsigned>(ma_type_store.size()));
+	for (TypeIndex i = 0; i < ma_type_store.size(); ++ i) {
+		LinkRange links = dependencies(i);
+		writer.write_uint(static_cast<unsigned>(links.end() - links.begin()));
+		for (const Link* lit = links.begin(); lit != links.end(); ++ lit) {
+			writer.write_uint(lit->target);
+			writer.write_uint(lit->strength);
+		}
+	}
+	write_vector(writer, ma_k_in);
+	write_vector(writer, ma_strong_k_in);
+	
+	writer.write_uint(m_void_type_index);
+	writer.write_uint(m_id_type_index);
+	writer.write_uint(m_sel_type_index);
+	writer.write_uint(m_unknown_type_index);
+}
+
+bool ObjCTypeRecord::read_cache(AnalysisCacheReader& reader) {
+	unsigned count = reader.read_uint();
+	if (!reader.can_read(count))
+		return false;
+		
+	vector<Type> type_store;
+	type_store.reserve(count);
+	for (unsigned i = 0; i < count && reader.valid(); ++ i) {
+		Type t;
+		t.type = static_cast<char>(reader.read_uint());
+		t.external = reader.read_uint() != 0;
+		t.refcount = reader.read_uint();
+		reader.read_string(t.encoding);
+		reader.read_string(t.name);
+		reader.read_string(t.value);
+		reader.read_string(t.pretty_name);
+		read_vector(reader, t.subtypes);
+		read_vector(reader, t.field_names);
+		t.type_index = reader.read_uint();
+		type_store.push_back(t);
+	}
+	
+	tr1::unordered_map<string, TypeIndex> indexed_types;
+	read_value(reader, indexed_types);
+	
+	// read the links straight into the packed form.
+	unsigned link_list_count = reader.read_uint();
+	if (!reader.can_read(link_list_count))
+		return false;
+	vector<unsigned> link_offsets;
+	vector<Link> links;
+	link_offsets.reserve(link_list_count + 1);
+	for (unsigned i = 0; i < link_list_count && reader.valid(); ++ i) {
+		link_offsets.push_back(static_cast<unsigned>(links.size()));
+		unsigned link_count = reader.read_uint();
+		if (!reader.can_read(link_count))
+			return false;
+		for (unsigned j = 0; j < link_count && reader.valid(); ++ j) {
+			TypeIndex target = reader.read_uint();
+			EdgeStrength strength = reader.read_uint();
+			links.push_back(Link(target, strength));
+		}
+	}
+	link_offsets.push_back(static_cast<unsigned>(links.size()));
+	
+	vector<unsigned> k_in, strong_k_in;
+	read_vector(reader, k_in);
+	read_vector(reader, strong_k_in);
+	
+	TypeIndex void_type_index = reader.read_uint();
+	TypeIndex id_type_index = reader.read_uint();
+	TypeIndex sel_type_index = reader.read_uint();
+	TypeIndex unknown_type_index = reader.read_uint();
+	
+	if (!reader.valid())
+		return false;
+		
+	ma_type_store.swap(type_store);
+	ma_indexed_types.swap(indexed_types);
+	ma_link_offsets.swap(link_offsets);
+	ma_links.swap(links);
+	vector<vector<Link> >().swap(ma_link_lists);
+	m_links_frozen = true;
+	ma_k_in.swap(k_in);
+	ma_strong_k_in.swap(strong_k_in);
+	m_void_type_index = void_type_index;
+	m_id_type_index = id_type_index;
+	m_sel_type_index = sel_type_index;
+	m_unknown_type_index = unknown_type_index;
+	this->rebuild_structural_index();
+	++ m_format_generation;
+	return true;
+}
+
+#pragma mark -
+
+// Layout: the counts, the classes, the class indices, the include paths, and then the type record.
+void MachO_File_ObjC::write_objc_cache(const string& key) const {
+	AnalysisCacheWriter writer;
+	
+	writer.write_uint(m_class_count);
+	writer.write_uint(m_protocol_count);
+	writer.write_uint(m_category_count);
+	
+	writer.write_uint(static_cast<unsigned>(ma_classes.size()));
+	for (vector<ClassType>::const_iterator cit = ma_classes.begin(); cit != ma_classes.end(); ++ cit) {
+		writer.write_uint(cit->type);
+		writer.write_uint(cit->vm_address);
+		writer.write_uint(cit->type_index);
+		writer.write_uint(cit->superclass_index);
+		writer.write_string(cit->name);
+		writer.write_uint(cit->attributes);
+		writer.write_uint(static_cast<unsigned>(cit->superclass_size));
+		writer.write_string(cit->superclass_name);
+		
+		writer.write_uint(static_cast<unsigned>(cit->ivars.size()));
+		for (vector<Ivar>::const_iterator iit = cit->ivars.begin(); iit != cit->ivars.end(); ++ iit) {
+			writer.write_uint(iit->type);
+			writer.write_string(iit->name);
+			writer.write_uint(iit->offset);
+			writer.write_uint(iit->is_private);
+		}
+		
+		writer.write_uint(static_cast<unsigned>(cit->properties.size()));
+		for (vector<Property>::const_iterator pit = cit->properties.begin(); pit != cit->properties.end(); ++ pit) {
+			writer.write_string(pit->name);
+			writer.write_string(pit->getter);
+			writer.write_string(pit->setter);
+			writer.write_uint(pit->type);
+			writer.write_uint(pit->has_getter | pit->has_setter << 1 | pit->copy << 2 | pit->retain << 3 | pit->readonly << 4 | pit->nonatomic << 5 | pit->optional << 6);
+			writer.write_string(pit->synthesized_to);
+			writer.write_uint(pit->getter_vm_address);
+			writer.write_uint(pit->setter_vm_address);
+			writer.write_uint(pit->hidden);
+			writer.write_uint(pit->impl_method);
+			writer.write_uint(pit->gc_strength);
+		}
+		
+		writer.write_uint(static_cast<unsigned>(cit->methods.size()));
+		for (vector<Method>::const_iterator mit = cit->methods.begin(); mit != cit->methods.end(); ++ mit) {
+			writer.write_string(mit->raw_name);
+			writer.write_uint(mit->is_class_method);
+			write_vector(writer, mit->types);
+			writer.write_uint(mit->vm_address);
+			writer.write_uint(mit->propertize_status);
+			writer.write_uint(mit->optional);
+			write_vector(writer, mit->components);
+			write_vector(writer, mit->argname);
+		}
+		
+		write_vector(writer, cit->adopted_protocols);
+	}
+	
+	write_value(writer, ma_classes_vm_address_index);
+	write_value(writer, ma_classes_typeindex_index);
+	write_value(writer, ma_include_paths);
+	write_value(writer, ma_lib_path);
+	
+	m_record.write_cache(writer);
+	
+	writer.save(key);
+}
+
+bool MachO_File_ObjC::read_objc_cache(const string& key) {
+	AnalysisCacheReader* reader = new AnalysisCacheReader(key);
+	
+	unsigned class_count = reader->read_uint();
+	unsigned protocol_count = reader->read_uint();
+	unsigned category_count = reader->read_uint();
+	
+	vector<ClassType> classes;
+	unsigned count = reader->read_uint();
+	if (reader->can_read(count))
+		classes.resize(count);
+	for (vector<ClassType>::iterator cit = classes.begin(); cit != classes.end() && reader->valid(); ++ cit) {
+		cit->type = static_cast<ClassType::Kind>(reader->read_uint());
+		cit->vm_address = reader->read_uint();
+		cit->type_index = reader->read_uint();
+		cit->superclass_index = reader->read_uint();
+		cit->name = reader->read_string();
+		cit->attributes = reader->read_uint();
+		cit->superclass_size = reader->read_uint();
+		cit->superclass_name = reader->read_string();
+		
+		count = reader->read_uint();
+		if (reader->can_read(count))
+			cit->ivars.resize(count);
+		for (vector<Ivar>::iterator iit = cit->ivars.begin(); iit != cit->ivars.end() && reader->valid(); ++ iit) {
+			iit->type = reader->read_uint();
+			iit->name = reader->read_string();
+			iit->offset = reader->read_uint();
+			iit->is_private = reader->read_uint() != 0;
+		}
+		
+		count = reader->read_uint();
+		if (reader->can_read(count))
+			cit->properties.resize(count);
+		for (vector<Property>::iterator pit = cit->properties.begin(); pit != cit->properties.end() && reader->valid(); ++ pit) {
+			reader->read_string(pit->name);
+			reader->read_string(pit->getter);
+			reader->read_string(pit->setter);
+			pit->type = reader->read_uint();
+			unsigned flags = reader->read_uint();
+			pit->has_getter = (flags & 1) != 0;
+			pit->has_setter = (flags & 2) != 0;
+			pit->copy = (flags & 4) != 0;
+			pit->retain = (flags & 8) != 0;
+			pit->readonly = (flags & 16) != 0;
+			pit->nonatomic = (flags & 32) != 0;
+			pit->optional = (flags & 64) != 0;
+			reader->read_string(pit->synthesized_to);
+			pit->getter_vm_address = reader->read_uint();
+			pit->setter_vm_address = reader->read_uint();
+			pit->hidden = static_cast<HiddenMethodType>(reader->read_uint());
+			pit->impl_method = static_cast<Property::ImplMethod>(reader->read_uint());
+			pit->gc_strength = static_cast<Property::GCStrength>(reader->read_uint());
+		}
+		
+		count = reader->read_uint();
+		if (reader->can_read(count))
+			cit->methods.resize(count);
+		for (vector<Method>::iterator mit = cit->methods.begin(); mit != cit->methods.end() && reader->valid(); ++ mit) {
+			mit->raw_name = reader->read_string();
+			mit->is_class_method = reader->read_uint() != 0;
+			read_vector(*reader, mit->types);
+			mit->vm_address = reader->read_uint();
+			mit->propertize_status = static_cast<HiddenMethodType>(reader->read_uint());
+			mit->optional = reader->read_uint() != 0;
+			read_vector(*reader, mit->components);
+			read_vector(*reader, mit->argname);
+		}
+		
+		read_vector(*reader, cit->adopted_protocols);
+	}
+	
+	tr1::unordered_map<unsigned, unsigned> classes_vm_address_index;
+	tr1::unordered_map<ObjCTypeRecord::TypeIndex, unsigned> classes_typeindex_index;
+	tr1::unordered_map<ObjCTypeRecord::TypeIndex, string> include_paths;
+	tr1::unordered_map<ObjCTypeRecord::TypeIndex, const char*> lib_path;
+	read_value(*reader, classes_vm_address_index);
+	read_value(*reader, classes_typeindex_index);
+	read_value(*reader, include_paths);
+	read_value(*reader, lib_path);
+	
+	// the record is read last, as it cannot be rolled back.
+	if (!reader->valid() || !m_record.read_cache(*reader) || !reader->finished()) {
+		delete reader;
+		return false;
+	}
+	
+	m_class_count = class_count;
+	m_protocol_count = protocol_count;
+	m_category_count = category_count;
+	ma_classes.swap(classes);
+	ma_classes_vm_address_index.swap(classes_vm_address_index);
+	ma_classes_typeindex_index.swap(classes_typeindex_index);
+	ma_include_paths.swap(include_paths);
+	ma_lib_path.swap(lib_path);
+	ma_cache_readers.push_back(reader);
+	return true;
+}
+
+#pragma mark -
+
+// Layout: the classes, each as its encoding, the superclass encoding (NULL for root classes), the methods and the
+// properties; and then the libraries of the external superclasses. Types are stored as encodings, so the database
+// does not depend on the type record of the library.
+bool MachO_File_ObjC::write_overlap_database(const string& key) const {
+	AnalysisCacheWriter writer;
+	
+	writer.write_uint(static_cast<unsigned>(ma_classes_typeindex_index.size()));
+	for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, unsigned>::const_iterator cit = ma_classes_typeindex_index.begin(); cit != ma_classes_typeindex_index.end(); ++ cit) {
+		const ClassType& cls = ma_classes[cit->second];
+		writer.write_string(m_record.encoding_of_type(cit->first));
+		if (cls.attributes & RO_ROOT)
+			writer.write_string(NULL);
+		else
+			writer.write_string(m_record.encoding_of_type(cls.superclass_index));
+		
+		writer.write_uint(static_cast<unsigned>(cls.methods.size()));
+		for (vector<Method>::const_iterator mit = cls.methods.begin(); mit != cls.methods.end(); ++ mit) {
+			writer.write_string(mit->raw_name);
+			writer.write_uint(mit->is_class_method);
+			writer.write_uint(static_cast<unsigned>(mit->types.size()));
+			for (vector<ObjCTypeRecord::TypeIndex>::const_iterator tit = mit->types.begin(); tit != mit->types.end(); ++ tit)
+				writer.write_string(m_record.encoding_of_type(*tit));
+		}
+		
+		writer.write_uint(static_cast<unsigned>(cls.properties.size()));
+		for (vector<Property>::const_iterator pit = cls.properties.begin(); pit != cls.properties.end(); ++ pit) {
+			writer.write_string(pit->name);
+			writer.write_string(pit->getter);
+			writer.write_string(pit->setter);
+			writer.write_string(m_record.encoding_of_type(pit->type));
+			writer.write_uint(pit->has_getter | pit->has_setter << 1 | pit->copy << 2 | pit->retain << 3 | pit->readonly << 4 | pit->nonatomic << 5);
+		}
+	}
+	
+	writer.write_uint(static_cast<unsigned>(ma_lib_path.size()));
+	for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, const char*>::const_iterator cit = ma_lib_path.begin(); cit != ma_lib_path.end(); ++ cit) {
+		writer.write_string(m_record.encoding_of_type(cit->first));
+		writer.write_string(cit->second);
+	}
+	
+	return writer.save(key);
+}
@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "MachO_File_ObjC.h"
 #include <cstdio>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -36,9 +38,16 @@ void MachO_File_ObjC::print_all_types() const throw() {
 void MachO_File_ObjC::print_extern_symbols() const throw() {
 	printf("// Found %lu external symbols.\n\n", ma_include_paths.size());
 	
-	for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, string>::const_iterator cit = ma_include_paths.begin(); cit != ma_include_paths.end(); ++ cit) {
-		std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, const char*>::const_iterator lit = ma_lib_path.find(cit->first);
-		printf("%s:\t%s\t(%s)\n", cit->second.c_str(), m_record.name_of_type(cit->first).c_str(), lit == ma_lib_path.end() ? "-" : lit->second);
+	// in type order, so the list does not depend on the layout of the hash table.
+	vector<ObjCTypeRecord::TypeIndex> externals;
+	externals.reserve(ma_include_paths.size());
+	for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, string>::const_iterator cit = ma_include_paths.begin(); cit != ma_include_paths.end(); ++ cit)
+		externals.push_back(cit->first);
+	sort(externals.begin(), externals.end());
+	
+	for (vector<ObjCTypeRecord::TypeIndex>::const_iterator eit = externals.begin(); eit != externals.end(); ++ eit) {
+		std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, const char*>::const_iterator lit = ma_lib_path.find(*eit);
+		printf("%s:\t%s\t(%s)\n", ma_include_paths.find(*eit)->second.c_str(), m_record.name_of_type(*eit).c_str(), lit == ma_lib_path.end() ? "-" : lit->second);
 	}
 	printf("\n");
 }
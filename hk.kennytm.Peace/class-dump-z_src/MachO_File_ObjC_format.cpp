@@ -29,42 +29,71 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "combine_dependencies.h"
 #include "or.h"
 #include "snprintf.h"
+#include "Threading.h"
+#include "crc32.h"
+#include "TarArchive.h"
+#include <sys/stat.h>
 
 using namespace std;
 
+static string banner (const char* selfpath) {
+	string retval = "/**\n"
+					" * This header is generated by class-dump-z 0.2b.\n"
+					" *\n"
+					" * Source: ";
+	retval += selfpath != NULL ? selfpath : "(null)";
+	retval += "\n"
+			  " */\n\n";
+	return retval;
+}
+
 static void print_banner (FILE* f, const char* selfpath) {
-	fprintf(f,
-			"/**\n"
-			" * This header is generated by class-dump-z 0.2b.\n"
-			" *\n"
-			" * Source: %s\n"
-			" */\n\n", selfpath);
+	fputs(banner(selfpath).c_str(), f);
 }
 
-void MachO_File_ObjC::set_class_filter(const char* regexp) {
-	if (m_class_filter != NULL) pcre_free(m_class_filter);
-	if (m_class_filter_extra != NULL) pcre_free(m_class_filter_extra);
+void MachO_File_ObjC::free_filter(pcre*& filter, pcre_extra*& filter_extra) throw() {
+	if (filter != NULL) pcre_free(filter);
+#ifdef PCRE_STUDY_JIT_COMPILE
+	if (filter_extra != NULL) pcre_free_study(filter_extra);
+#else
+	if (filter_extra != NULL) pcre_free(filter_extra);
+#endif
+	filter = NULL;
+	filter_extra = NULL;
+}
+
+// compile the filter with the JIT if this PCRE has one. pcre_exec() then runs the machine code by itself.
+void MachO_File_ObjC::compile_filter(const char* regexp, pcre*& filter, pcre_extra*& filter_extra) {
+	free_filter(filter, filter_extra);
 	
 	const char* errStr = NULL;
-	int erroffset;
-	m_class_filter = pcre_compile(regexp, 0, &errStr, &erroffset, NULL);
-	if (m_class_filter != NULL)
-		m_class_filter_extra = pcre_study(m_class_filter, 0, &errStr);
+	int erroffset = 0;
+	filter = pcre_compile(regexp, 0, &errStr, &erroffset, NULL);
+#ifdef PCRE_STUDY_JIT_COMPILE
+	if (filter != NULL)
+		filter_extra = pcre_study(filter, PCRE_STUDY_JIT_COMPILE, &errStr);
+#else
+	if (filter != NULL)
+		filter_extra = pcre_study(filter, 0, &errStr);
+#endif
 	if (errStr != NULL)
 		fprintf(stderr, "Warning: Encountered error while parsing RegExp pattern '%s' at offset %d: %s.\n", regexp, erroffset, errStr);
 }
 
+void MachO_File_ObjC::set_class_filter(const char* regexp) {
+	compile_filter(regexp, m_class_filter, m_class_filter_extra);
+	ma_kill_states.clear();
+}
+
 void MachO_File_ObjC::set_method_filter(const char* regexp) {
-	if (m_method_filter != NULL) pcre_free(m_method_filter);
-	if (m_method_filter_extra != NULL) pcre_free(m_method_filter_extra);
-	
-	const char* errStr = NULL;
-	int erroffset;
-	m_method_filter = pcre_compile(regexp, 0, &errStr, &erroffset, NULL);
-	if (m_method_filter != NULL)
-		m_method_filter_extra = pcre_study(m_method_filter, 0, &errStr);
-	if (errStr != NULL)
-		fprintf(stderr, "Warning: Encountered error while parsing RegExp pattern '%s' at offset %d: %s.\n", regexp, erroffset, errStr);
+	compile_filter(regexp, m_method_filter, m_method_filter_extra);
+}
+
+void MachO_File_ObjC::set_kill_prefix(const vector<string>& kill_prefix) {
+	m_kill_prefix.clear();
+	for (vector<string>::const_iterator cit = kill_prefix.begin(); cit != kill_prefix.end(); ++ cit)
+		m_kill_prefix.insert(*cit);
+	ma_kill_states.clear();
 }
 
 bool MachO_File_ObjC::name_killable(const char* name, size_t length, bool check_kill_prefix) const throw() {
@@ -72,14 +101,32 @@ bool MachO_File_ObjC::name_killable(const char* name, size_t length, bool check_
 		if (0 != pcre_exec(m_class_filter, m_class_filter_extra, name, length, 0, 0, NULL, 0))
 			return true;
 	if (check_kill_prefix)
-		for (vector<string>::const_iterator kit = m_kill_prefix.begin(); kit != m_kill_prefix.end(); ++ kit)
-			if (!kit->empty())
-				if (strncmp(name+strspn(name, "_"), kit->c_str(), kit->size()) == 0)
-					return true;
+		return m_kill_prefix.matches_prefix_of(name+strspn(name, "_"));
 	return false;
 }
 
+void MachO_File_ObjC::classify_type_name(ObjCTypeRecord::TypeIndex type_index) const throw() {
+	if (type_index >= ma_kill_states.size())
+		ma_kill_states.resize(m_record.types_count());
+	unsigned char& state = ma_kill_states[type_index];
+	if (state == 0) {
+		const string& name = m_record.name_of_type(type_index);
+		state = KS_Classified;
+		if (name_killable(name.c_str(), name.size(), false))
+			state |= KS_KilledByFilter;
+		else if (m_kill_prefix.matches_prefix_of(name.c_str()+strspn(name.c_str(), "_")))
+			state |= KS_KilledByPrefix;
+	}
+}
 
+bool MachO_File_ObjC::type_killable(ObjCTypeRecord::TypeIndex type_index, bool check_kill_prefix) const throw() {
+	if (type_index >= ma_kill_states.size() || ma_kill_states[type_index] == 0) {
+		const string& name = m_record.name_of_type(type_index);
+		return name_killable(name.c_str(), name.size(), check_kill_prefix);
+	}
+	unsigned char state = ma_kill_states[type_index];
+	return (state & KS_KilledByFilter) || (check_kill_prefix && (state & KS_KilledByPrefix));
+}
 
 struct Method_AlphabeticSorter {
 	const vector<MachO_File_ObjC::Method>& v;
@@ -273,7 +320,7 @@ string MachO_File_ObjC::ClassType::format(const ObjCTypeRecord& record, const Ma
 	if ((self.m_hide_cats && type == CT_Category) || (self.m_hide_dogs && type == CT_Protocol))
 		return "";
 	
-	if (self.name_killable(name, strlen(name), type != CT_Category)) {
+	if (type != CT_Category ? self.type_killable(type_index, true) : self.name_killable(name, strlen(name), false)) {
 		if (type != CT_Category || self.name_killable(superclass_name, strlen(superclass_name), false))
 			return "";
 	}
@@ -470,44 +517,180 @@ bool mfoc_AlphabeticSorter(const MachO_File_ObjC::ClassType* a, const MachO_File
 		return false;
 }
 
+namespace {
+	struct Header {
+		bool include_common;
+		string struct_declarations;
+		string declaration;
+		vector<ObjCTypeRecord::Link> dependencies;	// sorted by target.
+	};
+	
+	// what the incremental mode remembers about a header it has written, by file name.
+	struct ManifestEntry {
+		uint32_t crc;
+		unsigned long size;	// the size on disk, which may differ from the contents' because of text mode.
+	};
+	typedef tr1::unordered_map<string, ManifestEntry> Manifest;
+	
+	enum OutputStatus {
+		OS_Unchanged,
+		OS_Added,
+		OS_Changed,
+		OS_Failed
+	};
+}
+
+static void read_manifest(const string& path, Manifest& manifest) {
+	FILE* f = fopen(path.c_str(), "rt");
+	if (f == NULL)
+		return;
+	unsigned long crc, size;
+	char name[1024];
+	while (fscanf(f, "%lx %lu %1023[^\n]\n", &crc, &size, name) == 3) {
+		ManifestEntry& entry = manifest[name];
+		entry.crc = static_cast<uint32_t>(crc);
+		entry.size = size;
+	}
+	fclose(f);
+}
+
+static void write_manifest(const string& path, const Manifest& manifest) {
+	FILE* f = fopen(path.c_str(), "wt");
+	if (f == NULL)
+		return;
+	for (Manifest::const_iterator cit = manifest.begin(); cit != manifest.end(); ++ cit)
+		fprintf(f, "%08lx %lu %s\n", static_cast<unsigned long>(cit->second.crc), cit->second.size, cit->first.c_str());
+	fclose(f);
+}
+
+static bool read_file(const char* path, string& contents) {
+	FILE* f = fopen(path, "rt");
+	if (f == NULL)
+		return false;
+	contents.clear();
+	char buffer[4096];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		contents.append(buffer, length);
+	fclose(f);
+	return true;
+}
+
+// write the contents into the file. If entry is not NULL (incremental mode), the file is left alone when its contents are unchanged,
+// judging from the previous entry in the manifest if the file has the size recorded there, or else by reading it back.
+static OutputStatus write_output_file(const string& path, const string& contents, const ManifestEntry* previous_entry, ManifestEntry* entry) {
+	struct stat st;
+	bool existed = stat(path.c_str(), &st) == 0;
+	if (entry != NULL) {
+		entry->crc = crc32(0, reinterpret_cast<const unsigned char*>(contents.data()), contents.size());
+		if (existed) {
+			entry->size = static_cast<unsigned long>(st.st_size);
+			if (previous_entry != NULL && previous_entry->crc == entry->crc && previous_entry->size == entry->size)
+				return OS_Unchanged;
+			string old_contents;
+			if (read_file(path.c_str(), old_contents) && old_contents == contents)
+				return OS_Unchanged;
+		}
+	}
+	
+	FILE* f = fopen(path.c_str(), "wt");
+	if (f == NULL)
+		return OS_Failed;
+	fwrite(contents.data(), 1, contents.size(), f);
+	fclose(f);
+	
+	if (entry != NULL)
+		entry->size = stat(path.c_str(), &st) == 0 ? static_cast<unsigned long>(st.st_size) : 0;
+	return existed ? OS_Changed : OS_Added;
+}
+
+struct MachO_File_ObjC::FormatJobs {
+	const MachO_File_ObjC* self;
+	
+	const vector<const ClassType*>* classes;
+	vector<string>* results;
+	bool print_method_addresses, print_ivar_offsets, show_only_exported_classes;
+	int print_comments;
+	SortBy sort_methods_by;
+	
+	vector<const pair<const string, Header>*> headers;
+	const char* self_path;
+	string aggr_filename, output_prefix;
+	const Manifest* previous_manifest;	// NULL if not incremental.
+	vector<ManifestEntry> entries;
+	vector<OutputStatus> statuses;
+	vector<string>* archived_contents;	// NULL if the headers are written to files.
+};
+
+void MachO_File_ObjC::format_class_type_job(void* context, size_t index) {
+	const FormatJobs& jobs = *static_cast<const FormatJobs*>(context);
+	const ClassType* cls = (*jobs.classes)[index];
+	if (cls != NULL)
+		(*jobs.results)[index] = cls->format(jobs.self->m_record, *jobs.self, jobs.print_method_addresses, jobs.print_comments, jobs.print_ivar_offsets, jobs.sort_methods_by, jobs.show_only_exported_classes);
+}
+
+void MachO_File_ObjC::format_class_types(const vector<const ClassType*>& classes, vector<string>& results, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_methods_by, bool show_only_exported_classes) const throw() {
+	results.clear();
+	results.resize(classes.size());
+	for (vector<const ClassType*>::const_iterator cit = classes.begin(); cit != classes.end(); ++ cit)
+		if (*cit != NULL && (*cit)->type != ClassType::CT_Category)
+			classify_type_name((*cit)->type_index);
+	
+	FormatJobs jobs;
+	jobs.self = this;
+	jobs.classes = &classes;
+	jobs.results = &results;
+	jobs.print_method_addresses = print_method_addresses;
+	jobs.print_ivar_offsets = print_ivar_offsets;
+	jobs.show_only_exported_classes = show_only_exported_classes;
+	jobs.print_comments = print_comments;
+	jobs.sort_methods_by = sort_methods_by;
+	
+	// every job writes only its own slot, so the results come out in the same order whatever the thread count.
+	parallel_for(m_thread_count, classes.size(), format_class_type_job, &jobs);
+}
+
 void MachO_File_ObjC::print_class_type(SortBy sort_by, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_methods_by, bool show_only_exported_classes) const throw() {	
+	vector<const ClassType*> remap;
+	vector<ObjCTypeRecord::TypeIndex> type_indices;
+	remap.reserve(ma_classes.size());
+	
 	switch (sort_by) {
 		default:
 			for (vector<ClassType>::const_iterator cit = ma_classes.begin(); cit != ma_classes.end(); ++ cit)
-				printf("%s", cit->format(m_record, *this, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes).c_str());
+				remap.push_back(&*cit);
 			break;
-		case SB_Alphabetic: {
-			vector<const ClassType*> remap;
-			remap.reserve(ma_classes.size());
+		case SB_Alphabetic:
 			for (vector<ClassType>::const_iterator cit = ma_classes.begin(); cit != ma_classes.end(); ++ cit)
 				remap.push_back(&*cit);
 			sort(remap.begin(), remap.end(), mfoc_AlphabeticSorter);
-			
-			for (vector<const ClassType*>::const_iterator cit = remap.begin(); cit != remap.end(); ++ cit)
-				printf("%s", (*cit)->format(m_record, *this, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes).c_str());
 			break;
-		}
 		case SB_Inherit: {
-			vector<ObjCTypeRecord::TypeIndex> remap;
-			remap.reserve(ma_classes.size());
+			type_indices.reserve(ma_classes.size());
 			for (vector<ClassType>::const_iterator cit = ma_classes.begin(); cit != ma_classes.end(); ++ cit)
-				remap.push_back(cit->type_index);
+				type_indices.push_back(cit->type_index);
 			
-			m_record.sort_by_strong_links(remap.begin(), remap.begin() + m_protocol_count);
-			m_record.sort_by_strong_links(remap.begin() + m_protocol_count, remap.begin() + m_protocol_count + m_class_count);
-
-			for (vector<ObjCTypeRecord::TypeIndex>::const_iterator cit = remap.begin(); cit != remap.end(); ++ cit) {
+			m_record.sort_by_strong_links(type_indices.begin(), type_indices.begin() + m_protocol_count);
+			m_record.sort_by_strong_links(type_indices.begin() + m_protocol_count, type_indices.begin() + m_protocol_count + m_class_count);
+			
+			for (vector<ObjCTypeRecord::TypeIndex>::const_iterator cit = type_indices.begin(); cit != type_indices.end(); ++ cit) {
 				tr1::unordered_map<ObjCTypeRecord::TypeIndex, unsigned>::const_iterator iit = ma_classes_typeindex_index.find(*cit);
-				if (iit != ma_classes_typeindex_index.end())
-					printf("%s", ma_classes[iit->second].format(m_record, *this, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes).c_str());
-				else {
-					printf("Not found %d\n",*cit);
-				}
-
+				remap.push_back(iit != ma_classes_typeindex_index.end() ? &ma_classes[iit->second] : NULL);
 			}
 			break;
 		}
 	}
+	
+	vector<string> formatted;
+	format_class_types(remap, formatted, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes);
+	
+	for (size_t i = 0; i < remap.size(); ++ i) {
+		if (remap[i] != NULL)
+			printf("%s", formatted[i].c_str());
+		else {
+			printf("Not found %d\n", type_indices[i]);
+		}
+	}
 }
 
 void MachO_File_ObjC::print_struct_declaration(SortBy sort_by) const throw() {
@@ -520,22 +703,128 @@ void MachO_File_ObjC::print_struct_declaration(SortBy sort_by) const throw() {
 		m_record.sort_by_strong_links(public_struct_types.begin(), public_struct_types.end());
 	
 	for (vector<ObjCTypeRecord::TypeIndex>::const_iterator cit = public_struct_types.begin(); cit != public_struct_types.end(); ++ cit) {
-		const string& name = m_record.name_of_type(*cit);
-		if (!name_killable(name.c_str(), name.size(), true))		
+		classify_type_name(*cit);
+		if (!type_killable(*cit, true))
 			printf("%s;\n\n", m_record.format(*cit, "", 0, true, m_dont_typedef, m_ida_pro_mode).c_str());
 	}
 }
 
-namespace {
-	struct Header {
-		bool include_common;
-		string struct_declarations;
-		string declaration;
-		tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength> dependencies;
-	};
+void MachO_File_ObjC::write_header_file_job(void* context, size_t index) {
+	FormatJobs& jobs = *static_cast<FormatJobs*>(context);
+	const ObjCTypeRecord& record = jobs.self->m_record;
+	const pair<const string, Header>& header = *jobs.headers[index];
+	
+	string contents = banner(jobs.self_path);
+	
+	bool include_structs = true;
+	vector<ObjCTypeRecord::TypeIndex> weak_dependencies;
+	tr1::unordered_set<string> already_included;
+	// Write imports.
+	for (vector<ObjCTypeRecord::Link>::const_iterator dit = header.second.dependencies.begin(); dit != header.second.dependencies.end(); ++ dit) {
+		if (record.is_struct_type(dit->target)) {
+			if (include_structs) {
+				include_structs = false;
+				contents += "#import \"";
+				contents += jobs.aggr_filename;
+				contents += "-Structs.h\"\n";
+			}
+		} else if (dit->strength == ObjCTypeRecord::ES_Strong) {
+			if (record.is_external_type(dit->target)) {
+				tr1::unordered_map<ObjCTypeRecord::TypeIndex, string>::const_iterator lib_it = jobs.self->ma_include_paths.find(dit->target);
+				if (lib_it != jobs.self->ma_include_paths.end()) {
+					string lib_inc_path = lib_it->second;
+					if (lib_inc_path[lib_inc_path.size()-1] == '/') {
+						lib_inc_path += record.name_of_type(dit->target);
+						lib_inc_path += ".h";
+					}
+					if (already_included.find(lib_inc_path) == already_included.end()) {
+						contents += "#import <";
+						contents += lib_inc_path;
+						contents += ">\n";
+						already_included.insert(lib_inc_path);
+					}
+				} else {
+					contents += "#import <";
+					contents += record.name_of_type(dit->target);
+					contents += ".h> // Unknown library\n";
+				}
+			} else {
+				contents += "#import \"";
+				contents += record.name_of_type(dit->target);
+				contents += ".h\"\n";
+			}
+		} else if (dit->strength == ObjCTypeRecord::ES_Weak)
+			weak_dependencies.push_back(dit->target);
+	}
+	
+	contents.push_back('\n');
+	contents += record.format_forward_declaration(weak_dependencies);
+	contents.push_back('\n');
+	contents += header.second.declaration;
+	
+	if (jobs.archived_contents != NULL) {
+		(*jobs.archived_contents)[index].swap(contents);
+		return;
+	}
+	
+	string file_name = header.first + ".h";
+	const ManifestEntry* previous_entry = NULL;
+	if (jobs.previous_manifest != NULL) {
+		Manifest::const_iterator mit = jobs.previous_manifest->find(file_name);
+		if (mit != jobs.previous_manifest->end())
+			previous_entry = &mit->second;
+	}
+	jobs.statuses[index] = write_output_file(jobs.output_prefix + file_name, contents, previous_entry, jobs.previous_manifest != NULL ? &jobs.entries[index] : NULL);
+}
+
+// update the manifest, delete the headers which are not generated anymore, and print what has changed.
+static void report_incremental_headers(const string& aggr_filename, const string& output_prefix, const string& manifest_path, const Manifest& previous_manifest, const vector<string>& file_names, const vector<ManifestEntry>& entries, const vector<OutputStatus>& statuses) {
+	Manifest manifest;
+	vector<string> added, changed, removed;
+	unsigned unchanged_count = 0;
+	for (size_t i = 0; i < file_names.size(); ++ i) {
+		switch (statuses[i]) {
+			case OS_Unchanged: ++ unchanged_count; break;
+			case OS_Added: added.push_back(file_names[i]); break;
+			case OS_Changed: changed.push_back(file_names[i]); break;
+			case OS_Failed: {
+				// keep whatever we knew about it, so it is not taken as removed.
+				Manifest::const_iterator mit = previous_manifest.find(file_names[i]);
+				if (mit != previous_manifest.end())
+					manifest.insert(*mit);
+				continue;
+			}
+		}
+		manifest[file_names[i]] = entries[i];
+	}
+	
+	for (Manifest::const_iterator cit = previous_manifest.begin(); cit != previous_manifest.end(); ++ cit)
+		if (manifest.find(cit->first) == manifest.end() && remove((output_prefix + cit->first).c_str()) == 0)
+			removed.push_back(cit->first);
+	
+	write_manifest(manifest_path, manifest);
+	
+	string summary = "class-dump-z: " + aggr_filename + ": ";
+	summary += numeric_format("%u added, ", static_cast<unsigned>(added.size()));
+	summary += numeric_format("%u changed, ", static_cast<unsigned>(changed.size()));
+	summary += numeric_format("%u removed, ", static_cast<unsigned>(removed.size()));
+	summary += numeric_format("%u unchanged.\n", unchanged_count);
+	const vector<string>* lists[3] = {&added, &changed, &removed};
+	const char* const markers[3] = {"  A ", "  M ", "  D "};
+	for (unsigned i = 0; i < 3; ++ i) {
+		vector<string> sorted_names = *lists[i];
+		sort(sorted_names.begin(), sorted_names.end());
+		for (vector<string>::const_iterator cit = sorted_names.begin(); cit != sorted_names.end(); ++ cit) {
+			summary += markers[i];
+			summary += *cit;
+			summary.push_back('\n');
+		}
+	}
+	// in one piece, so the summaries of a batch do not interleave.
+	fputs(summary.c_str(), stderr);
 }
 
-void MachO_File_ObjC::write_header_files(const char* filename, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_by, bool show_only_exported_classes) const throw() {
+void MachO_File_ObjC::write_header_files(const char* filename, const char* directory, bool print_method_addresses, int print_comments, bool print_ivar_offsets, SortBy sort_by, bool show_only_exported_classes) const throw() {
 	vector<ObjCTypeRecord::TypeIndex> public_struct_types = m_record.all_public_struct_types();
 	tr1::unordered_map<string, Header> headers;
 	
@@ -545,101 +834,123 @@ void MachO_File_ObjC::write_header_files(const char* filename, bool print_method
 	if (*last_component == '/') ++ last_component;
 	const char* dot_position = strrchr(last_component, '.');
 	string aggr_filename = dot_position == NULL ? last_component : string(last_component, dot_position);	
+	string output_prefix;
+	if (directory != NULL) {
+		output_prefix = directory;
+		if (!output_prefix.empty() && output_prefix[output_prefix.size()-1] != '/')
+			output_prefix.push_back('/');
+	}
 	
 	// Filter out those structs not matching the regexp or having specified prefix.
 	bool need_killer_check = m_class_filter != NULL || !m_kill_prefix.empty();
 	if (need_killer_check) {
 		for (int i = public_struct_types.size()-1; i >= 0; -- i) {
 			ObjCTypeRecord::TypeIndex idx = public_struct_types[i];
-			const string& name = m_record.name_of_type(idx);
-			if (name_killable(name.c_str(), name.size(), true))
+			classify_type_name(idx);
+			if (type_killable(idx, true))
 				public_struct_types.erase(public_struct_types.begin() + i);
 		}
 	}
 	
+	vector<const ClassType*> class_types;
+	class_types.reserve(ma_classes.size());
+	for (vector<ClassType>::const_iterator cit = ma_classes.begin(); cit != ma_classes.end(); ++ cit)
+		class_types.push_back(&*cit);
+	vector<string> declarations;
+	format_class_types(class_types, declarations, print_method_addresses, print_comments, print_ivar_offsets, sort_by, show_only_exported_classes);
+	
 	// Distribute each class into files. 
 	for (vector<ClassType>::const_iterator cit = ma_classes.begin(); cit != ma_classes.end(); ++ cit) {
 		Header h;
-		h.declaration = cit->format(m_record, *this, print_method_addresses, print_comments, print_ivar_offsets, sort_by, show_only_exported_classes);
+		h.declaration.swap(declarations[static_cast<size_t>(cit - ma_classes.begin())]);
 		// we still need to pay lip service to create an empty file for the filtered types if someone else it going to include us.
 		if (!h.declaration.empty() || m_record.link_count(cit->type_index, true) > 0) {
-			const tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>* dep = m_record.dependencies(cit->type_index);
-			if (dep != NULL)
-				h.dependencies = *dep;
+			ObjCTypeRecord::LinkRange dep = m_record.dependencies(cit->type_index);
+			h.dependencies.assign(dep.begin(), dep.end());
 			string file_name = cit->type == ClassType::CT_Category ? cit->superclass_name : cit->name;
 			if (file_name == aggr_filename)
 				file_name += "-Class";
 			pair<tr1::unordered_map<string, Header>::iterator, bool> res = headers.insert(pair<string, Header>(file_name, h));
 			if (!res.second) {
 				res.first->second.declaration += h.declaration;
-				combine_dependencies(res.first->second.dependencies, h.dependencies);
+				combine_dependencies(res.first->second.dependencies, dep);
 			}
 		}
 	}
 	
 	// TODO: pull out all structs which k_in = 1 into the header file.
 	
-	// Write the aggregation file first.
-	
-	FILE* f_aggr = fopen((aggr_filename + ".h").c_str(), "wt");
-	print_banner(f_aggr, cached_self_path);
-	fprintf(f_aggr, "#import \"%s-Structs.h\"\n", aggr_filename.c_str());
+	// Compose the aggregation file first.
+	string aggr_contents = banner(cached_self_path);
+	aggr_contents += "#import \"" + aggr_filename + "-Structs.h\"\n";
 	for (tr1::unordered_map<string, Header>::const_iterator hit = headers.begin(); hit != headers.end(); ++ hit) {
-		fprintf(f_aggr, "#import \"%s.h\"\n", hit->first.c_str());
+		aggr_contents += "#import \"" + hit->first + ".h\"\n";
 	}
-	fclose(f_aggr);
 	
 	// Print the structs.
-	FILE* f_structs = fopen((aggr_filename + "-Structs.h").c_str(), "wt");
-	print_banner(f_structs, cached_self_path);
-	fprintf(f_structs, "%s\n", m_record.format_structs_with_forward_declarations(public_struct_types).c_str());
-	fclose(f_structs);
+	string structs_contents = banner(cached_self_path);
+	structs_contents += m_record.format_structs_with_forward_declarations(public_struct_types);
+	structs_contents.push_back('\n');
 	
-	// Now print to each file.
-	vector<ObjCTypeRecord::TypeIndex> weak_dependencies;
-	tr1::unordered_set<string> already_included;
-
-	for (tr1::unordered_map<string, Header>::const_iterator hit = headers.begin(); hit != headers.end(); ++ hit) {
-		string cur_filename = hit->first;
-		cur_filename += ".h";
-		FILE* f = fopen(cur_filename.c_str(), "wt");
-		print_banner(f, cached_self_path);
-		
-		bool include_structs = true;
-		weak_dependencies.clear();
-		already_included.clear();
-		// Write imports.
-		for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>::const_iterator dit = hit->second.dependencies.begin(); dit != hit->second.dependencies.end(); ++ dit) {
-			if (m_record.is_struct_type(dit->first)) {
-				if (include_structs) {
-					include_structs = false;
-					fprintf(f, "#import \"%s-Structs.h\"\n", aggr_filename.c_str());
-				}
-			} else if (dit->second == ObjCTypeRecord::ES_Strong) {
-				if (m_record.is_external_type(dit->first)) {
-					tr1::unordered_map<ObjCTypeRecord::TypeIndex, string>::const_iterator lib_it = ma_include_paths.find(dit->first);
-					if (lib_it != ma_include_paths.end()) {
-						string lib_inc_path = lib_it->second;
-						if (lib_inc_path[lib_inc_path.size()-1] == '/') {
-							lib_inc_path += m_record.name_of_type(dit->first);
-							lib_inc_path += ".h";
-						}
-						if (already_included.find(lib_inc_path) == already_included.end()) {
-							fprintf(f, "#import <%s>\n", lib_inc_path.c_str());
-							already_included.insert(lib_inc_path);
-						}
-					} else
-						fprintf(f, "#import <%s.h> // Unknown library\n", m_record.name_of_type(dit->first).c_str());
-				} else
-					fprintf(f, "#import \"%s.h\"\n", m_record.name_of_type(dit->first).c_str());
-			} else if (dit->second == ObjCTypeRecord::ES_Weak)
-				weak_dependencies.push_back(dit->first);
-		}
-		
-		fprintf(f, "\n%s", m_record.format_forward_declaration(weak_dependencies).c_str());
-		fprintf(f, "\n%s", hit->second.declaration.c_str());
-		fclose(f);
+	FormatJobs jobs;
+	jobs.self = this;
+	jobs.self_path = cached_self_path;
+	jobs.aggr_filename = aggr_filename;
+	jobs.output_prefix = output_prefix;
+	jobs.headers.reserve(headers.size());
+	for (tr1::unordered_map<string, Header>::const_iterator hit = headers.begin(); hit != headers.end(); ++ hit)
+		jobs.headers.push_back(&*hit);
+	
+	// The headers are rendered in parallel, but added to the archive in a fixed order.
+	if (m_header_archive != NULL) {
+		vector<string> archived_contents (headers.size());
+		jobs.previous_manifest = NULL;
+		jobs.archived_contents = &archived_contents;
+		parallel_for(m_thread_count, jobs.headers.size(), write_header_file_job, &jobs);
+		m_header_archive->add_file(output_prefix + aggr_filename + ".h", aggr_contents);
+		m_header_archive->add_file(output_prefix + aggr_filename + "-Structs.h", structs_contents);
+		for (size_t i = 0; i < archived_contents.size(); ++ i)
+			m_header_archive->add_file(output_prefix + jobs.headers[i]->first + ".h", archived_contents[i]);
+		return;
 	}
+	
+	string manifest_path = output_prefix + "." + aggr_filename + ".manifest";
+	Manifest previous_manifest;
+	if (m_incremental_headers)
+		read_manifest(manifest_path, previous_manifest);
+	
+	vector<string> file_names;
+	vector<ManifestEntry> entries;
+	vector<OutputStatus> statuses;
+	file_names.reserve(headers.size() + 2);
+	file_names.push_back(aggr_filename + ".h");
+	file_names.push_back(aggr_filename + "-Structs.h");
+	
+	const string* special_contents[2] = {&aggr_contents, &structs_contents};
+	for (unsigned i = 0; i < 2; ++ i) {
+		Manifest::const_iterator mit = previous_manifest.find(file_names[i]);
+		ManifestEntry entry = {0, 0};
+		statuses.push_back(write_output_file(output_prefix + file_names[i], *special_contents[i], mit != previous_manifest.end() ? &mit->second : NULL, m_incremental_headers ? &entry : NULL));
+		entries.push_back(entry);
+	}
+	
+	// Now print to each file. Every header goes to its own file, so they can be written in any order.
+	jobs.previous_manifest = m_incremental_headers ? &previous_manifest : NULL;
+	jobs.archived_contents = NULL;
+	for (vector<const pair<const string, Header>*>::const_iterator hit = jobs.headers.begin(); hit != jobs.headers.end(); ++ hit)
+		file_names.push_back((*hit)->first + ".h");
+	jobs.entries.resize(headers.size());
+	jobs.statuses.resize(headers.size());
+	parallel_for(m_thread_count, jobs.headers.size(), write_header_file_job, &jobs);
+	entries.insert(entries.end(), jobs.entries.begin(), jobs.entries.end());
+	statuses.insert(statuses.end(), jobs.statuses.begin(), jobs.statuses.end());
+	
+	for (size_t i = 0; i < file_names.size(); ++ i)
+		if (statuses[i] == OS_Failed)
+			fprintf(stderr, "Warning: Cannot write to '%s'.\n", (output_prefix + file_names[i]).c_str());
+	
+	if (m_incremental_headers)
+		report_incremental_headers(aggr_filename, output_prefix, manifest_path, previous_manifest, file_names, entries, statuses);
 }
 
 std::string MachO_File_ObjC::reconstruct_raw_name(const ClassType& cls, const ReducedMethod& method) {
@@ -763,6 +1074,7 @@ void MachO_File_ObjC::set_hints_file(const char* filename) {
 				}
 			}
 		}
+		m_record.freeze_links();
 	}
 }
 
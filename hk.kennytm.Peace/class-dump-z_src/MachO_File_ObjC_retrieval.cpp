@@ -173,8 +173,7 @@ void MachO_File_ObjC::add_methods(ClassType& cls, const method_list_t* method_li
 		method.vm_address = reinterpret_cast<unsigned>(cur_method->imp);
 		method.raw_name = this->get_cstring(cur_method->name, &m_guess_text_segment, method.vm_address, 0, NULL);
 		if (method.raw_name == NULL) {
-			ma_string_store.push_back(numeric_format("XXEncryptedMethod_%04x", OR(method.vm_address, reinterpret_cast<unsigned>(cur_method->name))));
-			method.raw_name = ma_string_store.back().c_str();
+			method.raw_name = m_string_arena.intern(numeric_format("XXEncryptedMethod_%04x", OR(method.vm_address, reinterpret_cast<unsigned>(cur_method->name))));
 		} else if (method.raw_name[0] == '-' || method.raw_name[0] == '+')
 			method.raw_name = strchr(method.raw_name, ' ') + 1;
 		
@@ -371,8 +370,7 @@ void MachO_File_ObjC::retrieve_protocol_info() throw() {
 		if (cls.name == NULL) {
 			// Protocol's original name is never store in the symbol section.
 			// So we need to synthesize a protocol name.
-			ma_string_store.push_back(numeric_format("XXEncryptedProtocol_%04x", cls.vm_address));
-			cls.name = ma_string_store.back().c_str();
+			cls.name = m_string_arena.intern(numeric_format("XXEncryptedProtocol_%04x", cls.vm_address));
 		}
 		
 		// Make sure the same protocol hasn't been declared.
@@ -457,8 +455,7 @@ void MachO_File_ObjC::retrieve_class_info() throw() {
 		cls.superclass_size = class_data_ptr->instanceStart;
 		cls.name = this->get_cstring(class_data_ptr->name, &m_guess_text_segment, cls.vm_address, strlen("_OBJC_CLASS_$_"), NULL);
 		if (cls.name == NULL) {
-			ma_string_store.push_back(numeric_format("XXEncryptedClass_%04x", cls.vm_address));
-			cls.name = ma_string_store.back().c_str();
+			cls.name = m_string_arena.intern(numeric_format("XXEncryptedClass_%04x", cls.vm_address));
 		}
 		cls.type_index = m_record.add_internal_objc_class(cls.name);
 		
@@ -506,8 +503,7 @@ void MachO_File_ObjC::retrieve_class_info() throw() {
 				ivar.offset = *PEEK_VM_ADDR(cur_ivar->offset, unsigned, text);
 				ivar.is_private = is_symbol(reinterpret_cast<unsigned>(cur_ivar->offset)) && !is_extern_symbol(reinterpret_cast<unsigned>(cur_ivar->offset));
 				if (ivar.name == NULL) {
-					ma_string_store.push_back(numeric_format("XXEncryptedIvar_%02x", ivar.offset));
-					ivar.name = ma_string_store.back().c_str();
+					ivar.name = m_string_arena.intern(numeric_format("XXEncryptedIvar_%02x", ivar.offset));
 				} else {
 					const char* last_dot = strrchr(ivar.name, '.');
 					if (last_dot != NULL)
@@ -573,8 +569,7 @@ void MachO_File_ObjC::retrieve_reduced_class_info() throw() {
 		cls.attributes = class_data_ptr->flags;
 		cls.name = this->get_cstring(class_data_ptr->name, &m_guess_text_segment, cls.vm_address, strlen("_OBJC_CLASS_$_"), NULL);
 		if (cls.name == NULL) {
-			ma_string_store.push_back(numeric_format("XXEncryptedClass_%04x", cls.vm_address));
-			cls.name = ma_string_store.back().c_str();
+			cls.name = m_string_arena.intern(numeric_format("XXEncryptedClass_%04x", cls.vm_address));
 		}
 		cls.type_index = m_record.add_internal_objc_class(cls.name);
 		
@@ -645,14 +640,12 @@ void MachO_File_ObjC::retrieve_category_info() throw() {
 						if (rep != NULL) {
 							const char* first_open_parenthesis = strchr(rep, '(')+1;
 							const char* first_close_parenthesis = strchr(first_open_parenthesis, ')');
-							ma_string_store.push_back(string(first_open_parenthesis, first_close_parenthesis));
-							cls.name = ma_string_store.back().c_str();
+							cls.name = m_string_arena.intern(first_open_parenthesis, static_cast<size_t>(first_close_parenthesis - first_open_parenthesis));
 							goto found_name;
 						}
 					}
 				}
-				ma_string_store.push_back(numeric_format("XXEncryptedCategory_%04x", cls.vm_address));
-				cls.name = ma_string_store.back().c_str();
+				cls.name = m_string_arena.intern(numeric_format("XXEncryptedCategory_%04x", cls.vm_address));
 			found_name:;
 			}
 			
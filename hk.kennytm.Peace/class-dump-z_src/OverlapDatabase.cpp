@@ -0,0 +1,119 @@
+/*
+
+OverlapDatabase.cpp ... Methods and properties of the classes of a library, for hiding inherited methods.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "OverlapDatabase.h"
+#include "MachO_File_ObjC.h"
+#include "AnalysisCache.h"
+
+using namespace std;
+
+OverlapDatabase::OverlapDatabase(const char* path, const char* arch) : MachO_File_Simple(path, arch), mp_reader(NULL) {
+	if (!m_is_valid || AnalysisCache::directory() == NULL)
+		throw TRException("No overlap database can be stored for '%s'.", path);
+		
+	string key = this->cache_key(path) + "#overlaps";
+	if (!this->read(key)) {
+		{
+			MachO_File_ObjC library (path, true, arch);
+			library.write_overlap_database(key);
+		}
+		if (!this->read(key))
+			throw TRException("Cannot store the overlap database of '%s'.", path);
+	}
+}
+
+OverlapDatabase::~OverlapDatabase() throw() {
+	delete mp_reader;
+}
+
+// Layout: the classes, each as its encoding, the superclass encoding, the methods and the properties; and then
+// the libraries of the other classes. See MachO_File_ObjC::write_overlap_database().
+bool OverlapDatabase::read(const string& key) {
+	AnalysisCacheReader* reader = new AnalysisCacheReader(key);
+	
+	tr1::unordered_map<string, Class> classes;
+	unsigned count = reader->read_uint();
+	for (unsigned i = 0; i < count && reader->valid(); ++ i) {
+		const char* encoding = reader->read_string();
+		Class& cls = classes[encoding != NULL ? encoding : ""];
+		cls.superclass = reader->read_string();
+		
+		unsigned method_count = reader->read_uint();
+		if (reader->can_read(method_count))
+			cls.methods.resize(method_count);
+		for (vector<Method>::iterator mit = cls.methods.begin(); mit != cls.methods.end() && reader->valid(); ++ mit) {
+			mit->raw_name = reader->read_string();
+			mit->is_class_method = reader->read_uint() != 0;
+			unsigned type_count = reader->read_uint();
+			if (reader->can_read(type_count))
+				mit->types.resize(type_count);
+			for (vector<const char*>::iterator tit = mit->types.begin(); tit != mit->types.end(); ++ tit)
+				*tit = reader->read_string();
+		}
+		
+		unsigned property_count = reader->read_uint();
+		if (reader->can_read(property_count))
+			cls.properties.resize(property_count);
+		for (vector<Property>::iterator pit = cls.properties.begin(); pit != cls.properties.end() && reader->valid(); ++ pit) {
+			pit->name = reader->read_string();
+			pit->getter = reader->read_string();
+			pit->setter = reader->read_string();
+			pit->type = reader->read_string();
+			unsigned flags = reader->read_uint();
+			pit->has_getter = (flags & 1) != 0;
+			pit->has_setter = (flags & 2) != 0;
+			pit->copy = (flags & 4) != 0;
+			pit->retain = (flags & 8) != 0;
+			pit->readonly = (flags & 16) != 0;
+			pit->nonatomic = (flags & 32) != 0;
+		}
+	}
+	
+	tr1::unordered_map<string, const char*> lib_paths;
+	count = reader->read_uint();
+	for (unsigned i = 0; i < count && reader->valid(); ++ i) {
+		const char* encoding = reader->read_string();
+		const char* lib_path = reader->read_string();
+		if (encoding != NULL && lib_path != NULL)
+			lib_paths.insert(pair<string, const char*>(encoding, lib_path));
+	}
+	
+	if (!reader->finished()) {
+		delete reader;
+		return false;
+	}
+	
+	delete mp_reader;
+	mp_reader = reader;
+	ma_classes.swap(classes);
+	ma_lib_paths.swap(lib_paths);
+	return true;
+}
+
+const OverlapDatabase::Class* OverlapDatabase::find_class(const string& encoding) const throw() {
+	tr1::unordered_map<string, Class>::const_iterator cit = ma_classes.find(encoding);
+	return cit != ma_classes.end() ? &cit->second : NULL;
+}
+
+const char* OverlapDatabase::library_of(const string& encoding) const throw() {
+	tr1::unordered_map<string, const char*>::const_iterator cit = ma_lib_paths.find(encoding);
+	return cit != ma_lib_paths.end() ? cit->second : NULL;
+}
@@ -0,0 +1,79 @@
+/*
+
+OverlapDatabase.h ... Methods and properties of the classes of a library, for hiding inherited methods.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef OVERLAPDATABASE_H
+#define OVERLAPDATABASE_H
+
+#include <vector>
+#include <string>
+#include <tr1/unordered_map>
+#include "MachO_File.h"
+
+class AnalysisCacheReader;
+
+// What "-h super" needs from a library: the methods and properties of each class, with the types as encodings,
+// and where the classes it does not define come from. The database is kept in the AnalysisCache under the key
+// of the library (its UUID if any) with the "#overlaps" suffix, and is built from a reduced analysis on first use.
+// The strings point into the mapped cache file.
+class OverlapDatabase : public MachO_File_Simple {
+public:
+	struct Method {
+		const char* raw_name;
+		bool is_class_method;
+		std::vector<const char*> types;
+	};
+	
+	struct Property {
+		const char* name;
+		const char* getter;
+		const char* setter;
+		const char* type;
+		bool has_getter, has_setter, copy, retain, readonly, nonatomic;
+	};
+	
+	struct Class {
+		const char* superclass;		// NULL for root classes.
+		std::vector<Method> methods;
+		std::vector<Property> properties;
+	};
+
+private:
+	AnalysisCacheReader* mp_reader;
+	std::tr1::unordered_map<std::string, Class> ma_classes;
+	std::tr1::unordered_map<std::string, const char*> ma_lib_paths;
+	
+	bool read(const std::string& key);
+	
+	OverlapDatabase(const OverlapDatabase&);
+	OverlapDatabase& operator=(const OverlapDatabase&);
+
+public:
+	// Throws TRException if the library cannot be opened, or its database cannot be stored (e.g. the cache is disabled).
+	OverlapDatabase(const char* path, const char* arch);
+	~OverlapDatabase() throw();
+	
+	// look up by the encoding of the class type. Returns NULL if the library does not define the class.
+	const Class* find_class(const std::string& encoding) const throw();
+	// the library of a class referred to by this library, or NULL if unknown.
+	const char* library_of(const std::string& encoding) const throw();
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+
+PrefixTrie.h ... A set of prefixes which can be matched against a string in one pass.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PREFIXTRIE_H
+#define PREFIXTRIE_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+// checking a name against a long list of prefixes costs one walk down the trie, instead of one comparison per prefix.
+class PrefixTrie {
+private:
+	struct Node {
+		bool terminal;	// a prefix ends here.
+		std::vector<std::pair<char, unsigned> > children;	// sorted by the character.
+		Node() : terminal(false) {}
+	};
+	std::vector<Node> ma_nodes;	// the root is the first node.
+
+public:
+	PrefixTrie() : ma_nodes(1) {}
+	
+	inline bool empty() const throw() { return ma_nodes.size() == 1; }
+	inline void clear() { ma_nodes.assign(1, Node()); }
+	
+	// an empty prefix would match everything, so it is ignored.
+	void insert(const std::string& prefix) {
+		unsigned node = 0;
+		for (std::string::const_iterator cit = prefix.begin(); cit != prefix.end(); ++ cit) {
+			std::vector<std::pair<char, unsigned> >& children = ma_nodes[node].children;
+			std::vector<std::pair<char, unsigned> >::iterator child = std::lower_bound(children.begin(), children.end(), std::make_pair(*cit, 0u));
+			if (child != children.end() && child->first == *cit)
+				node = child->second;
+			else {
+				unsigned new_node = static_cast<unsigned>(ma_nodes.size());
+				children.insert(child, std::make_pair(*cit, new_node));
+				ma_nodes.push_back(Node());
+				node = new_node;
+			}
+		}
+		if (node != 0)
+			ma_nodes[node].terminal = true;
+	}
+	
+	// true if the null-terminated string starts with any of the prefixes.
+	bool matches_prefix_of(const char* str) const throw() {
+		unsigned node = 0;
+		for (; *str != '\0'; ++ str) {
+			const std::vector<std::pair<char, unsigned> >& children = ma_nodes[node].children;
+			std::vector<std::pair<char, unsigned> >::const_iterator child = std::lower_bound(children.begin(), children.end(), std::make_pair(*str, 0u));
+			if (child == children.end() || child->first != *str)
+				return false;
+			node = child->second;
+			if (ma_nodes[node].terminal)
+				return true;
+		}
+		return false;
+	}
+};
+
+#endif
@@ -20,9 +20,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "MachO_File_ObjC.h"
+#include "Threading.h"
+#include "DirectoryScanner.h"
+#include "AnalysisCache.h"
+#include "TarArchive.h"
+#include "string_util.h"
 #include <getopt.h>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <tr1/unordered_set>
 #include <unistd.h>
 #include <sys/stat.h>
 #if !_MSC_VER
@@ -42,6 +49,10 @@ void print_usage () {
 			"    -h super   Hide inherited methods.\n"
 			"    -y <root>  Choose the sysroot. Default to the path of latest iPhoneOS SDK, or /.\n"
 			"    -u <arch>  Choose a specific architecture in a fat binary (e.g. armv6, armv7, etc.)\n"
+			"    -c <dir>   Cache the analysis in this directory, and reuse it in later runs.\n"
+			"               Defaults to $PEACE_CACHE_DIR. The cache is not used if neither is set.\n"
+			"               With -h super, the methods of the superclass libraries are also kept there,\n"
+			"               so the libraries are not analyzed again.\n"
 			"\n  Formatting:\n"
 			"    -a         Print ivar offsets\n"
 			"    -A         Print implementation VM addresses.\n"
@@ -68,11 +79,263 @@ void print_usage () {
 			"\n  Output:\n"
 			"    -H         Separate into header files\n"
 			"    -o <dir>   Put header files into this directory instead of current directory.\n"
+			"    -U         With -H, leave unchanged headers untouched, delete those of removed classes,\n"
+			"               and report what has changed.\n"
+			"    -j <n>     Format the classes and write the headers on n threads (0 = one per processor).\n"
+			"    -O <file>  With -H, write all headers into this tar archive instead of separate files (- = stdout).\n"
+			"               The -o directory becomes the directory inside the archive.\n"
+			"    -t <file>  List the headers in an archive written with -O.\n"
+			"    -x <file>  Extract the headers in an archive written with -O into the -o directory.\n"
+			"\n  Batch:\n"
+			"    -r <dir>   Write the headers of every Mach-O file under this directory. May be repeated.\n"
+			"    -l <file>  Write the headers of every file listed in this file, one per line (- = stdin).\n"
+			"               Each binary gets its own directory in the output directory, named after it.\n"
+			"               With -j, the binaries are dumped concurrently, sharing the libraries used by -h super.\n"
+			"               With -O, the headers of all binaries go into the same archive.\n"
 			"\n"
 			);
 }
 
+// the options applied to every file dumped.
+struct DumpOptions {
+	bool print_ivar_offsets, print_method_addresses, show_only_exported_classes;
+	bool pointers_right_align, propertize, prettify_struct_names, has_blank;
+	bool hide_protocols, hide_super, hide_cats, hide_dogs, dont_typedef, ida_pro_mode, incremental_headers;
+	MachO_File_ObjC::SortBy sort_methods_by;
+	int print_comments;
+	const char* sysroot;
+	const char* arch;
+	const char* type_regexp;
+	const char* method_regexp;
+	const char* hints_file;
+	vector<string> kill_prefix;
+	TarWriter* header_archive;
+};
+
+static void configure(MachO_File_ObjC& mf, const DumpOptions& options) {
+	mf.set_prettify_struct_names(options.prettify_struct_names);
+	mf.set_pointers_right_aligned(options.pointers_right_align);
+	mf.set_method_has_whitespace(options.has_blank);
+	mf.set_hide_cats_and_dogs(options.hide_cats, options.hide_dogs);
+	mf.set_hints_file(options.hints_file);
+	mf.set_dont_typedef(options.dont_typedef);
+	mf.set_ida_pro_mode(options.ida_pro_mode);
+	mf.set_incremental_headers(options.incremental_headers);
+	mf.set_header_archive(options.header_archive);
+	
+	if (options.type_regexp != NULL)
+		mf.set_class_filter(options.type_regexp);
+	if (options.method_regexp != NULL)
+		mf.set_method_filter(options.method_regexp);
+	if (!options.kill_prefix.empty())
+		mf.set_kill_prefix(options.kill_prefix);
+	
+	mf.hide_overlapping_methods(options.hide_super, options.hide_protocols, options.sysroot);
+	if (options.propertize)
+		mf.propertize();
+}
+
+static bool make_directory(const char* path) {
+	struct stat st;
+	return stat(path, &st) == 0 || mkdir(path, 0755) == 0;
+}
+
+// write the end of the header archive. Returns false if the archive could not be written completely.
+static bool close_header_archive(TarWriter* archive, const char* path) {
+	if (archive == NULL)
+		return true;
+	bool success = archive->finish();
+	if (!success)
+		fprintf(stderr, "class-dump-z: cannot write the header archive '%s'.\n", path);
+	delete archive;
+	return success;
+}
+
+// reject the absolute paths and those with a ".." component, so extraction never writes outside the output directory.
+static bool is_safe_archive_path(const string& name) {
+	return !name.empty() && name[0] != '/' && ("/" + name + "/").find("/../") == string::npos;
+}
+
+// list the files in an archive written with -O, or extract them into the directory.
+static int unpack_header_archive(const char* archive_path, const char* output_directory, bool extract) {
+	string prefix;
+	if (output_directory != NULL && *output_directory != '\0') {
+		prefix = output_directory;
+		if (prefix[prefix.size()-1] != '/')
+			prefix.push_back('/');
+	}
+	
+	try {
+		TarReader reader (archive_path);
+		string name, contents;
+		while (reader.next(name, contents)) {
+			if (!extract) {
+				printf("%s\n", name.c_str());
+				continue;
+			}
+			if (!is_safe_archive_path(name)) {
+				fprintf(stderr, "class-dump-z: skipping '%s' in the archive.\n", name.c_str());
+				continue;
+			}
+			
+			string path = prefix + name;
+			size_t slash = path.rfind('/');
+			if (slash != string::npos && slash != 0 && !make_directories(path.substr(0, slash))) {
+				fprintf(stderr, "class-dump-z: cannot create directory '%s'.\n", path.substr(0, slash).c_str());
+				return 1;
+			}
+			FILE* f = fopen(path.c_str(), "wb");
+			bool written = f != NULL && fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+			if (f != NULL && fclose(f) != 0)
+				written = false;
+			if (!written)
+				fprintf(stderr, "Warning: Cannot write to '%s'.\n", path.c_str());
+		}
+	} catch (const TRException& e) {
+		fprintf(stderr, "class-dump-z: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
+
+#pragma mark -
+
+enum BatchStatus {
+	BS_Pending,
+	BS_NoObjC,
+	BS_Failed,
+	BS_Dumped
+};
+
+struct BatchJob {
+	string path;
+	string output_directory;
+	BatchStatus status;
+	string error;
+	// with -O, the headers of this binary, until every binary before it is in the archive.
+	TarWriter* staged_headers;
+	bool finished;
+};
+
+struct Batch {
+	const DumpOptions* options;
+	vector<BatchJob> jobs;
+	Mutex archive_mutex;
+	size_t next_job_to_archive;
+};
+
+static void dump_one_batch_job(BatchJob& job, const DumpOptions& options) {
+	try {
+		MachO_File_ObjC mf (job.path.c_str(), false, options.arch);
+		if (mf.total_class_type_count() == 0) {
+			job.status = BS_NoObjC;
+			return;
+		}
+		if (options.header_archive == NULL && !make_directory(job.output_directory.c_str())) {
+			job.error = "Cannot create directory " + job.output_directory + ".";
+			job.status = BS_Failed;
+			return;
+		}
+		
+		configure(mf, options);
+		if (job.staged_headers != NULL)
+			mf.set_header_archive(job.staged_headers);
+		mf.write_header_files(job.path.c_str(), job.output_directory.c_str(), options.print_method_addresses, options.print_comments, options.print_ivar_offsets, options.sort_methods_by, options.show_only_exported_classes);
+		job.status = BS_Dumped;
+	} catch (const exception& e) {
+		// this runs as a parallel_for job, so even a bad_alloc from a broken binary must stop here.
+		job.error = e.what();
+		job.status = BS_Failed;
+	} catch (...) {
+		job.error = "Unknown exception.";
+		job.status = BS_Failed;
+	}
+}
+
+// each binary is analyzed on its own thread. The reduced analyses of the libraries for -h super come from the
+// ImageCache, so a library shared by many binaries (Foundation, UIKit, ...) is only analyzed once.
+// With -O, the headers go into the archive in input order, so the archive does not depend on which thread finishes first.
+static void dump_batch_job(void* context, size_t index) {
+	Batch& batch = *static_cast<Batch*>(context);
+	BatchJob& job = batch.jobs[index];
+	TarWriter* archive = batch.options->header_archive;
+	
+	if (archive != NULL)
+		job.staged_headers = new TarWriter();
+	dump_one_batch_job(job, *batch.options);
+	if (archive == NULL)
+		return;
+	
+	ScopedLock lock (batch.archive_mutex);
+	job.finished = true;
+	while (batch.next_job_to_archive < batch.jobs.size() && batch.jobs[batch.next_job_to_archive].finished) {
+		BatchJob& ready_job = batch.jobs[batch.next_job_to_archive];
+		archive->add_files_from(*ready_job.staged_headers);
+		delete ready_job.staged_headers;
+		ready_job.staged_headers = NULL;
+		++ batch.next_job_to_archive;
+	}
+}
+
+// the output directory of a binary is named after its file name without the extension, like its aggregation header.
+// Clashing names get a numeric suffix in input order, so the layout does not depend on the thread count.
+static void assign_output_directories(vector<BatchJob>& jobs, const char* output_directory) {
+	string prefix = output_directory != NULL && *output_directory != '\0' ? output_directory : ".";
+	if (prefix[prefix.size()-1] != '/')
+		prefix.push_back('/');
+	
+	tr1::unordered_set<string> used_names;
+	for (vector<BatchJob>::iterator it = jobs.begin(); it != jobs.end(); ++ it) {
+		const char* last_component = strrchr(it->path.c_str(), '/');
+		last_component = last_component != NULL ? last_component + 1 : it->path.c_str();
+		const char* dot_position = strrchr(last_component, '.');
+		string name = dot_position == NULL || dot_position == last_component ? last_component : string(last_component, dot_position);
+		
+		string unique_name = name;
+		for (unsigned i = 2; !used_names.insert(unique_name).second; ++ i)
+			unique_name = name + numeric_format("-%u", i);
+		it->output_directory = prefix + unique_name;
+	}
+}
+
+static int run_batch(const vector<string>& paths, const DumpOptions& options, const char* output_directory, unsigned thread_count) {
+	if (options.header_archive == NULL && output_directory != NULL && !make_directory(output_directory)) {
+		perror("Cannot create directory for header generation. ");
+		return 1;
+	}
+	
+	Batch batch;
+	batch.options = &options;
+	batch.next_job_to_archive = 0;
+	for (vector<string>::const_iterator cit = paths.begin(); cit != paths.end(); ++ cit) {
+		BatchJob job;
+		job.path = *cit;
+		job.status = BS_Pending;
+		job.staged_headers = NULL;
+		job.finished = false;
+		batch.jobs.push_back(job);
+	}
+	assign_output_directories(batch.jobs, output_directory);
+	
+	// initialize the cache directory before any thread needs it.
+	AnalysisCache::directory();
+	parallel_for(thread_count, batch.jobs.size(), dump_batch_job, &batch);
+	
+	unsigned dumped_count = 0;
+	for (vector<BatchJob>::const_iterator cit = batch.jobs.begin(); cit != batch.jobs.end(); ++ cit) {
+		if (cit->status == BS_Dumped)
+			++ dumped_count;
+		else if (cit->status == BS_Failed)
+			fprintf(stderr, "An exception was thrown while analyzing '%s' (with sysroot '%s'): %s\n", cit->path.c_str(), options.sysroot, cit->error.c_str());
+	}
+	fprintf(stderr, "Dumped %u of %u Mach-O files.\n", dumped_count, static_cast<unsigned>(batch.jobs.size()));
+	return 0;
+}
+
+#pragma mark -
+
 int main (int argc, char* argv[]) {
+	int retval = 0;
 	if (argc == 1) {
 		print_usage();
 	} else {
@@ -84,6 +347,7 @@ int main (int argc, char* argv[]) {
 		bool hide_cats = false, hide_dogs = false;
 		bool dont_typedef = false;
 		bool ida_pro_mode = false;
+		bool incremental_headers = false;
 		MachO_File_ObjC::SortBy sort_by = MachO_File_ObjC::SB_None, sort_methods_by = MachO_File_ObjC::SB_None;
 		int print_comments = 0;
 		char diagnosis_option = '\0';
@@ -95,6 +359,12 @@ int main (int argc, char* argv[]) {
 		vector<string> kill_prefix;
 		const char* arch = "any";
 		const char* hints_file = NULL;
+		const char* cache_directory = NULL;
+		unsigned thread_count = 1;
+		vector<const char*> batch_roots, batch_lists;
+		const char* header_archive_path = NULL;
+		const char* listed_archive_path = NULL;
+		const char* extracted_archive_path = NULL;
 		
 		// search for a suitable sysroot.
 #if !_MSC_VER
@@ -126,7 +396,7 @@ int main (int argc, char* argv[]) {
 		
 		// const char* regexp_string = NULL;
 		while (argc > 1) {
-			switch (c = getopt(argc, argv, "aAkC:ISsD:Rf:gpHo:X:Nh:y:u:bzi:T")) {
+			switch (c = getopt(argc, argv, "aAkC:ISsD:Rf:gpHo:X:Nh:y:u:bzi:Tc:j:r:l:UO:t:x:")) {
 				case 'a': print_ivar_offsets = true; break;
 				case 'A': print_method_addresses = true; break;
 				case 'k': ++ print_comments; break;
@@ -142,6 +412,7 @@ int main (int argc, char* argv[]) {
 				case 'I': sort_by = MachO_File_ObjC::SB_Inherit; break;
 				case 'o': output_directory = optarg;  break;
 				case 'H': generate_headers = true; break;
+				case 'U': incremental_headers = true; break;
 				case 'X': {
 					const char* comma = optarg;
 					const char* last_comma;
@@ -196,6 +467,29 @@ int main (int argc, char* argv[]) {
 					ida_pro_mode = true;
 					hide_cats = hide_dogs = true;
 					break;
+				case 'c':
+					cache_directory = optarg;
+					break;
+				case 'j':
+					thread_count = static_cast<unsigned>(strtoul(optarg, NULL, 10));
+					if (thread_count == 0)
+						thread_count = processor_count();
+					break;
+				case 'r':
+					batch_roots.push_back(optarg);
+					break;
+				case 'l':
+					batch_lists.push_back(optarg);
+					break;
+				case 'O':
+					header_archive_path = optarg;
+					break;
+				case 't':
+					listed_archive_path = optarg;
+					break;
+				case 'x':
+					extracted_archive_path = optarg;
+					break;
 #if EOF != -1
 				case EOF:
 #endif
@@ -211,6 +505,98 @@ int main (int argc, char* argv[]) {
 			}
 		}
 		
+		if (cache_directory != NULL && !AnalysisCache::set_directory(cache_directory))
+			fprintf(stderr, "class-dump-z: cannot use '%s' as the cache directory.\n", cache_directory);
+		
+		if (listed_archive_path != NULL || extracted_archive_path != NULL) {
+			if (listed_archive_path != NULL)
+				retval = unpack_header_archive(listed_archive_path, NULL, false);
+			else
+				retval = unpack_header_archive(extracted_archive_path, output_directory, true);
+			if (delete_sysroot_on_quit)
+				delete[] sysroot;
+			return retval;
+		}
+		
+		bool batch_mode = !batch_roots.empty() || !batch_lists.empty();
+		TarWriter* header_archive = NULL;
+		if (header_archive_path != NULL) {
+			if (!generate_headers && !batch_mode)
+				fprintf(stderr, "class-dump-z: -O only applies with -H. Ignoring it.\n");
+			else {
+				if (incremental_headers) {
+					fprintf(stderr, "class-dump-z: -U cannot be used with -O. Ignoring it.\n");
+					incremental_headers = false;
+				}
+				try {
+					header_archive = new TarWriter(header_archive_path);
+				} catch (const TRException& e) {
+					fprintf(stderr, "class-dump-z: %s\n", e.what());
+					return 1;
+				}
+			}
+		}
+		
+		DumpOptions options;
+		options.print_ivar_offsets = print_ivar_offsets;
+		options.print_method_addresses = print_method_addresses;
+		options.show_only_exported_classes = show_only_exported_classes;
+		options.pointers_right_align = pointers_right_align;
+		options.propertize = propertize;
+		options.prettify_struct_names = prettify_struct_names;
+		options.has_blank = has_blank;
+		options.hide_protocols = hide_protocols;
+		options.hide_super = hide_super;
+		options.hide_cats = hide_cats;
+		options.hide_dogs = hide_dogs;
+		options.dont_typedef = dont_typedef;
+		options.ida_pro_mode = ida_pro_mode;
+		options.incremental_headers = incremental_headers;
+		options.sort_methods_by = sort_methods_by;
+		options.print_comments = print_comments;
+		options.sysroot = sysroot;
+		options.arch = arch;
+		options.type_regexp = type_regexp;
+		options.method_regexp = method_regexp;
+		options.hints_file = hints_file;
+		options.kill_prefix = kill_prefix;
+		options.header_archive = header_archive;
+		
+		if (batch_mode) {
+			if (hints_file != NULL) {
+				fprintf(stderr, "class-dump-z: -i cannot be used in batch mode. Ignoring it.\n");
+				options.hints_file = NULL;
+			}
+			
+			vector<string> paths (filenames.begin(), filenames.end());
+			for (vector<const char*>::const_iterator cit = batch_lists.begin(); cit != batch_lists.end(); ++ cit) {
+				FILE* list = strcmp(*cit, "-") == 0 ? stdin : fopen(*cit, "r");
+				if (list == NULL) {
+					fprintf(stderr, "class-dump-z: cannot open '%s'.\n", *cit);
+					continue;
+				}
+				read_path_list(list, paths);
+				if (list != stdin)
+					fclose(list);
+			}
+			// directories may contain anything, but the files named explicitly are always tried.
+			for (vector<const char*>::const_iterator cit = batch_roots.begin(); cit != batch_roots.end(); ++ cit) {
+				vector<string> scanned_paths;
+				// a framework lists its binary under several names; dump it only once.
+				scan_directory(*cit, scanned_paths, true);
+				for (vector<string>::const_iterator pit = scanned_paths.begin(); pit != scanned_paths.end(); ++ pit)
+					if (has_macho_magic(pit->c_str()))
+						paths.push_back(*pit);
+			}
+			
+			retval = run_batch(paths, options, output_directory, thread_count);
+			if (!close_header_archive(header_archive, header_archive_path))
+				retval = 1;
+			if (delete_sysroot_on_quit)
+				delete[] sysroot;
+			return retval;
+		}
+		
 		if (filenames.size() == 0) {
 			print_usage();
 		} else {
@@ -219,7 +605,7 @@ int main (int argc, char* argv[]) {
 			
 		try {
 			
-			MachO_File_ObjC mf = MachO_File_ObjC(*fit, false, arch);
+			MachO_File_ObjC mf (*fit, false, arch);
 		
 			if (diagnosis_option != '\0') {
 				switch (diagnosis_option) {
@@ -241,37 +627,16 @@ int main (int argc, char* argv[]) {
 						break;
 				}
 			} else {
-				mf.set_prettify_struct_names(prettify_struct_names);
-				mf.set_pointers_right_aligned(pointers_right_align);
-				mf.set_method_has_whitespace(has_blank);
-				mf.set_hide_cats_and_dogs(hide_cats, hide_dogs);
-				mf.set_hints_file(hints_file);
-				mf.set_dont_typedef(dont_typedef);
-				mf.set_ida_pro_mode(ida_pro_mode);
-				
-				if (type_regexp != NULL)
-					mf.set_class_filter(type_regexp);
-				if (method_regexp != NULL)
-					mf.set_method_filter(method_regexp);
-				if (!kill_prefix.empty())
-					mf.set_kill_prefix(kill_prefix);
-			
-				mf.hide_overlapping_methods(hide_super, hide_protocols, sysroot);
-				if (propertize)
-					mf.propertize();
+				configure(mf, options);
+				mf.set_thread_count(thread_count);
 								
 				if (generate_headers) {
-					if (output_directory != NULL) {
-						if (chdir(output_directory) == -1) {
-							if (mkdir(output_directory, 0755) == -1) {
-								perror("Cannot create directory for header generation. ");
-								return 1;
-							} else
-								chdir(output_directory);
-						}
+					if (header_archive == NULL && output_directory != NULL && !make_directory(output_directory)) {
+						perror("Cannot create directory for header generation. ");
+						return 1;
 					}
 					
-					mf.write_header_files(*fit, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes);
+					mf.write_header_files(*fit, output_directory, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes);
 				} else {
 					mf.print_struct_declaration(sort_by);
 					mf.print_class_type(sort_by, print_method_addresses, print_comments, print_ivar_offsets, sort_methods_by, show_only_exported_classes);
@@ -281,16 +646,19 @@ int main (int argc, char* argv[]) {
 			}
 			
 		} catch (const TRException& e) {
-			printf("/*\n\nAn exception was thrown while analyzing '%s' (with sysroot '%s'):\n\n%s\n\n*/\n", *fit, sysroot, e.what());
+			// keep the archive intact if it is written to stdout.
+			fprintf(header_archive != NULL ? stderr : stdout, "/*\n\nAn exception was thrown while analyzing '%s' (with sysroot '%s'):\n\n%s\n\n*/\n", *fit, sysroot, e.what());
 		}
 			
 		}
 
 		}
 		
+		if (!close_header_archive(header_archive, header_archive_path))
+			retval = 1;
 		if (delete_sysroot_on_quit)
 			delete[] sysroot;
 	}
 	
-	return 0;
+	return retval;
 }
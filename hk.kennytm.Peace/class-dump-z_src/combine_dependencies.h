@@ -22,22 +22,43 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef COMBINE_DEPENDENCIES_H
 #define COMBINE_DEPENDENCIES_H
 
-static void combine_dependencies( std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>& a, const std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>& b, std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, unsigned>* p_ma_k_in = NULL, std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, unsigned>* p_ma_strong_k_in = NULL ) {
-	for (std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>::const_iterator bit = b.begin(); bit != b.end(); ++ bit) {
-		std::pair<std::tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>::iterator, bool> res = a.insert(*bit);
-		if (!res.second) {
-			if (res.first->second < bit->second) {
-				if (p_ma_strong_k_in != NULL && res.first->second < ObjCTypeRecord::ES_StrongIndirect)
-					++ (*p_ma_strong_k_in)[bit->first];
-				res.first->second = bit->second;
+// the in-degree counter of a type, growing the array if needed.
+static inline unsigned& link_counter(std::vector<unsigned>& counts, ObjCTypeRecord::TypeIndex type_index) {
+	if (type_index >= counts.size())
+		counts.resize(type_index+1);
+	return counts[type_index];
+}
+
+// merge the sorted links b into the sorted links a, keeping the stronger link when both have the same target.
+static void combine_dependencies( std::vector<ObjCTypeRecord::Link>& a, ObjCTypeRecord::LinkRange b, std::vector<unsigned>* p_ma_k_in = NULL, std::vector<unsigned>* p_ma_strong_k_in = NULL ) {
+	if (b.empty())
+		return;
+	
+	// b may point into a, so build the result separately.
+	std::vector<ObjCTypeRecord::Link> merged;
+	merged.reserve(a.size() + static_cast<std::size_t>(b.end() - b.begin()));
+	std::vector<ObjCTypeRecord::Link>::const_iterator ait = a.begin();
+	for (const ObjCTypeRecord::Link* bit = b.begin(); bit != b.end(); ++ bit) {
+		while (ait != a.end() && ait->target < bit->target)
+			merged.push_back(*ait++);
+		if (ait != a.end() && ait->target == bit->target) {
+			ObjCTypeRecord::Link link = *ait++;
+			if (link.strength < bit->strength) {
+				if (p_ma_strong_k_in != NULL && link.strength < ObjCTypeRecord::ES_StrongIndirect)
+					++ link_counter(*p_ma_strong_k_in, bit->target);
+				link.strength = bit->strength;
 			}
+			merged.push_back(link);
 		} else {
 			if (p_ma_k_in != NULL)
-				++ (*p_ma_k_in)[bit->first];
-			if (p_ma_strong_k_in != NULL && bit->second >= ObjCTypeRecord::ES_StrongIndirect)
-				++ (*p_ma_strong_k_in)[bit->first];
+				++ link_counter(*p_ma_k_in, bit->target);
+			if (p_ma_strong_k_in != NULL && bit->strength >= ObjCTypeRecord::ES_StrongIndirect)
+				++ link_counter(*p_ma_strong_k_in, bit->target);
+			merged.push_back(*bit);
 		}
 	}
+	merged.insert(merged.end(), ait, std::vector<ObjCTypeRecord::Link>::const_iterator(a.end()));
+	a.swap(merged);
 }
 
 #endif
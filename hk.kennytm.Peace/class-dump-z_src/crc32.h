@@ -29,7 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" uint32_t crc32 (uint32_t crc, const unsigned char *buf, std::size_t len);
 
 // result should be long enough to hold 11 characters.
-void crc32_b64(const char* value, std::size_t length, char* result) {
+inline void crc32_b64(const char* value, std::size_t length, char* result) {
 	uint32_t crc = crc32(0, reinterpret_cast<const unsigned char*>(value), length);
 	pseudo_base64_encode(reinterpret_cast<const unsigned char*>(&crc), sizeof(crc), result);
 }
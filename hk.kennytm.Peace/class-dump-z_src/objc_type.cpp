@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "string_util.h"
 #include "combine_dependencies.h"
 #include "hash_combine.h"
+#include "snprintf.h"
 
 #ifdef _MSC_VER
 #define __alignof__ __alignof
@@ -93,19 +94,76 @@ static inline bool name_Refable(const string& pretty_name) throw() {
 
 
 
+string ObjCTypeRecord::structural_key(char type, const string& value, const string* name, const size_t* arity) {
+	string key (1, type);
+	if (arity != NULL) {
+		char arity_string[16];
+		snprintf(arity_string, sizeof(arity_string), "%u", static_cast<unsigned>(*arity));
+		key += arity_string;
+	} else
+		key.push_back('*');
+	key.push_back('\0');
+	key += value;
+	key.push_back('\0');
+	if (name != NULL) {
+		key.push_back('=');
+		key += *name;
+	} else
+		key.push_back('*');
+	return key;
+}
+
+// every type is filed 4 times, with and without its name and number of subtypes, for the wildcard lookups in parse().
+void ObjCTypeRecord::index_type(TypeIndex idx) {
+	const Type& type = ma_type_store[idx];
+	size_t arity = type.subtypes.size();
+	for (unsigned i = 0; i < 4; ++ i) {
+		vector<TypeIndex>& bucket = ma_structural_index[structural_key(type.type, type.value, (i & 1) ? NULL : &type.name, (i & 2) ? NULL : &arity)];
+		if (bucket.empty() || bucket.back() < idx)
+			bucket.push_back(idx);
+		else
+			bucket.insert(lower_bound(bucket.begin(), bucket.end(), idx), idx);
+	}
+}
+
+void ObjCTypeRecord::unindex_type(TypeIndex idx) {
+	const Type& type = ma_type_store[idx];
+	size_t arity = type.subtypes.size();
+	for (unsigned i = 0; i < 4; ++ i) {
+		tr1::unordered_map<string, vector<TypeIndex> >::iterator bit = ma_structural_index.find(structural_key(type.type, type.value, (i & 1) ? NULL : &type.name, (i & 2) ? NULL : &arity));
+		if (bit != ma_structural_index.end()) {
+			vector<TypeIndex>::iterator it = lower_bound(bit->second.begin(), bit->second.end(), idx);
+			if (it != bit->second.end() && *it == idx)
+				bit->second.erase(it);
+		}
+	}
+}
+
+void ObjCTypeRecord::rebuild_structural_index() {
+	ma_structural_index.clear();
+	for (TypeIndex i = 0; i < ma_type_store.size(); ++ i)
+		this->index_type(i);
+}
+
 ObjCTypeRecord::TypeIndex ObjCTypeRecord::parse(const string& type_to_parse, bool is_struct_used_locally) {
 	tr1::unordered_map<string, TypeIndex>::const_iterator p_index = ma_indexed_types.find(type_to_parse);
 		
 	if (p_index != ma_indexed_types.end()) {
 		Type& retval = ma_type_store[p_index->second];
+		unsigned old_refcount = retval.refcount;
 		if (is_struct_used_locally) {
 			if (retval.refcount != Type::used_globally)
 				++ retval.refcount;
 		} else
 			retval.refcount = Type::used_globally;
+		// format() only cares whether the refcount exceeds 1.
+		if (old_refcount <= 1 && retval.refcount > 1)
+			++ m_format_generation;
 		return p_index->second;
 	}
 	
+	// the new type may be merged into an existing one, changing how the latter is formatted.
+	++ m_format_generation;
 	Type t = Type(*this, type_to_parse, is_struct_used_locally);
 	
 	TypeIndex ret_index = ma_type_store.size();
@@ -113,20 +171,62 @@ ObjCTypeRecord::TypeIndex ObjCTypeRecord::parse(const string& type_to_parse, boo
 	
 	// merge struct with the same name, typesignature etc. 
 	if (t.type != '@' && (!t.subtypes.empty() || !t.name.empty())) {
-		ret_index = 0;
+		// a type outside these buckets fails is_compatible_with() before it recurses, so only these need to be tried.
+		// An empty name or no subtypes on either side matches anything, so look up both the exact and the empty
+		// name and number of subtypes, or every name or number of subtypes if ours is empty.
+		const string empty_name;
+		const size_t arity = t.subtypes.size(), zero_arity = 0;
+		const string* names[2] = {&t.name, &empty_name};
+		const size_t* arities[2] = {&arity, &zero_arity};
+		unsigned name_count = 2, arity_count = 2;
+		if (t.name.empty()) {
+			names[0] = NULL;
+			name_count = 1;
+		}
+		if (arity == 0) {
+			arities[0] = NULL;
+			arity_count = 1;
+		}
+		
+		const vector<TypeIndex>* buckets[4];
+		size_t positions[4] = {0, 0, 0, 0};
+		unsigned bucket_count = 0;
+		for (unsigned i = 0; i < name_count; ++ i)
+			for (unsigned j = 0; j < arity_count; ++ j) {
+				tr1::unordered_map<string, vector<TypeIndex> >::const_iterator bit = ma_structural_index.find(structural_key(t.type, t.value, names[i], arities[j]));
+				if (bit != ma_structural_index.end())
+					buckets[bucket_count++] = &bit->second;
+			}
+		
 		tr1::unordered_set<TypePointerPair> banned_pairs;
-		for (vector<Type>::iterator cit = ma_type_store.begin(); cit != ma_type_store.end(); ++ cit, ++ ret_index) {
-			if (cit->is_compatible_with(t, *this, banned_pairs)) {
+		while (true) {
+			// try the candidates in store order, as the first compatible type wins.
+			unsigned next_bucket = bucket_count;
+			ret_index = static_cast<TypeIndex>(ma_type_store.size());
+			for (unsigned i = 0; i < bucket_count; ++ i) {
+				if (positions[i] < buckets[i]->size() && (*buckets[i])[positions[i]] < ret_index) {
+					ret_index = (*buckets[i])[positions[i]];
+					next_bucket = i;
+				}
+			}
+			if (next_bucket == bucket_count)
+				break;
+			++ positions[next_bucket];
+			
+			Type& candidate = ma_type_store[ret_index];
+			if (candidate.is_compatible_with(t, *this, banned_pairs)) {
 				if (is_struct_used_locally) {
-					t.refcount = cit->refcount;
+					t.refcount = candidate.refcount;
 				} else
-					cit->refcount = Type::used_globally;
+					candidate.refcount = Type::used_globally;
 				ma_indexed_types.insert(pair<string,unsigned>(type_to_parse, ret_index));
-				if (t.is_more_complete_than(*cit)) {
-					t.type_index = cit->type_index;
-					*cit = t;
+				if (t.is_more_complete_than(candidate)) {
+					t.type_index = candidate.type_index;
+					this->unindex_type(ret_index);
+					candidate = t;
+					this->index_type(ret_index);
 				} else
-					t = *cit;
+					t = candidate;
 				goto combined;
 			}
 		}
@@ -134,6 +234,7 @@ ObjCTypeRecord::TypeIndex ObjCTypeRecord::parse(const string& type_to_parse, boo
 	
 	ma_type_store.push_back(t);
 	ma_indexed_types.insert(pair<string,unsigned>(type_to_parse, ret_index));
+	this->index_type(ret_index);
 	
 combined:
 	// add strong link to its children. (only for unions & structs.)
@@ -198,6 +299,56 @@ string ObjCTypeRecord::format_forward_declaration(const vector<TypeIndex>& type_
 	return struct_refs;
 }
 
+bool ObjCTypeRecord::FormattedType::splice(const string& argname, unsigned tabs, string& result) const throw() {
+	if (multiline && tabs != 0)
+		return false;
+	result.assign(tabs, '\t');
+	result.reserve(tabs + declarator.size() + argname.size());
+	if (argname_position == string::npos)
+		result += declarator;
+	else {
+		result.append(declarator, 0, argname_position);
+		result += argname;
+		result.append(declarator, argname_position+1, string::npos);
+	}
+	return true;
+}
+
+string ObjCTypeRecord::format(TypeIndex type_index, const string& argname, unsigned tabs, bool as_declaration, bool dont_typedef, bool treat_objcls_as_struct) const throw() {
+	// The argument name can be spliced into a cached declarator only if it can't take part in the "int *x" -> "int* x" rewriting.
+	// Multiline declarators indent their nested anonymous structs independently, so they are only reused without indentation.
+	string retval;
+	if (argname.find_first_of(" *\x01") == string::npos) {
+		unsigned flags = as_declaration | dont_typedef << 1 | treat_objcls_as_struct << 2 | pointers_right_aligned << 3 | prettify_struct_names << 4 | !argname.empty() << 5;
+		unsigned long long key = static_cast<unsigned long long>(type_index) << 6 | flags;
+		
+		{
+			ScopedLock lock(m_format_cache_mutex);
+			if (m_format_cache_generation != m_format_generation) {
+				ma_format_cache.clear();
+				m_format_cache_generation = m_format_generation;
+			}
+			tr1::unordered_map<unsigned long long, FormattedType>::const_iterator cit = ma_format_cache.find(key);
+			if (cit != ma_format_cache.end() && cit->second.splice(argname, tabs, retval))
+				return retval;
+		}
+		
+		// render outside the lock, so the other threads can still use the cache meanwhile.
+		FormattedType formatted;
+		formatted.declarator = format_uncached(type_index, argname.empty() ? "" : "\x01", 0, as_declaration, dont_typedef, treat_objcls_as_struct);
+		formatted.argname_position = formatted.declarator.find('\x01');
+		formatted.multiline = formatted.declarator.find('\n') != string::npos;
+		bool spliced = formatted.splice(argname, tabs, retval);
+		
+		ScopedLock lock(m_format_cache_mutex);
+		ma_format_cache.insert(pair<unsigned long long, FormattedType>(key, formatted));
+		if (spliced)
+			return retval;
+	}
+	
+	return format_uncached(type_index, argname, tabs, as_declaration, dont_typedef, treat_objcls_as_struct);
+}
+
 ObjCTypeRecord::TypeIndex ObjCTypeRecord::add_external_objc_class(const std::string& objc_class) {
 	TypeIndex idx = parse("@\"" + objc_class + "\"", false);
 	ma_type_store[idx].external = true;
@@ -218,6 +369,16 @@ ObjCTypeRecord::TypeIndex ObjCTypeRecord::add_objc_category(const std::string& c
 	return parse("6" + category_name + "@\"" + categorized_class + "\"", false);	// the category name must be an identifier.
 }
 
+// the strength of the link to the target, inserting a link of strength ES_None if there isn't one.
+// The reference is invalidated by the next insertion.
+static ObjCTypeRecord::EdgeStrength& link_slot(vector<ObjCTypeRecord::Link>& links, ObjCTypeRecord::TypeIndex to) {
+	ObjCTypeRecord::Link key (to, ObjCTypeRecord::ES_None);
+	vector<ObjCTypeRecord::Link>::iterator lit = lower_bound(links.begin(), links.end(), key);
+	if (lit == links.end() || lit->target != to)
+		lit = links.insert(lit, key);
+	return lit->strength;
+}
+
 void ObjCTypeRecord::add_link_with_strength(TypeIndex from, TypeIndex to, EdgeStrength target_strength, bool convert_class_strength_to_weak) {
 recurse:
 	if (from == to)
@@ -269,15 +430,14 @@ recurse:
 			return;
 	}
 	
-	tr1::unordered_map<TypeIndex, EdgeStrength>& from_adjs = ma_adjlist[from];
-	
-	EdgeStrength& strength = from_adjs[to];
+	vector<Link>& from_links = mutable_links(from);
+	EdgeStrength& strength = link_slot(from_links, to);
 	bool need_bfs = false;
 	if (strength < target_strength) {
 		if (strength == 0)
-			++ ma_k_in[to];
+			++ link_counter(ma_k_in, to);
 		if (target_strength == ES_Strong)
-			++ ma_strong_k_in[to];
+			++ link_counter(ma_strong_k_in, to);
 		
 		strength = target_strength;
 		if (target_strength >= ES_StrongIndirect)
@@ -292,25 +452,81 @@ recurse:
 	tr1::unordered_set<TypeIndex> visited;
 	visited.insert(to);
 	
+	vector<TypeIndex> strong_neighbors;
 	while (bfs_stack.size() != 0) {
 		TypeIndex cur = bfs_stack.back();
 		bfs_stack.pop_back();
-		tr1::unordered_map<TypeIndex, EdgeStrength>& cur_adjs = ma_adjlist[cur];
 		
-		for (tr1::unordered_map<TypeIndex, EdgeStrength>::iterator cit = cur_adjs.begin(); cit != cur_adjs.end(); ++ cit) {
-			if (cit->second >= ES_StrongIndirect && visited.insert(cit->first).second) {
-				EdgeStrength& orig_strength = from_adjs[cit->first];
+		// collect them first, since from_links may be cur's own list when there is a cycle.
+		strong_neighbors.clear();
+		const vector<Link>& cur_links = ma_link_lists[cur];
+		for (vector<Link>::const_iterator cit = cur_links.begin(); cit != cur_links.end(); ++ cit)
+			if (cit->strength >= ES_StrongIndirect)
+				strong_neighbors.push_back(cit->target);
+		
+		for (vector<TypeIndex>::const_iterator nit = strong_neighbors.begin(); nit != strong_neighbors.end(); ++ nit) {
+			if (visited.insert(*nit).second) {
+				EdgeStrength& orig_strength = link_slot(from_links, *nit);
 				if (orig_strength < ES_StrongIndirect) {
 					if (orig_strength == 0)
-						++ ma_k_in[cit->first];
+						++ link_counter(ma_k_in, *nit);
 					orig_strength = ES_StrongIndirect;
 				}
-				bfs_stack.push_back(cit->first);
+				bfs_stack.push_back(*nit);
 			}
 		}
 	}
 }
 
+vector<ObjCTypeRecord::Link>& ObjCTypeRecord::mutable_links(TypeIndex from) {
+	if (m_links_frozen)
+		this->thaw_links();
+	if (ma_link_lists.size() < ma_type_store.size())
+		ma_link_lists.resize(ma_type_store.size());
+	return ma_link_lists[from];
+}
+
+void ObjCTypeRecord::thaw_links() {
+	ma_link_lists.clear();
+	ma_link_lists.resize(ma_type_store.size());
+	for (TypeIndex i = 0; i+1 < ma_link_offsets.size() && i < ma_link_lists.size(); ++ i)
+		ma_link_lists[i].assign(ma_links.begin() + ma_link_offsets[i], ma_links.begin() + ma_link_offsets[i+1]);
+	vector<unsigned>().swap(ma_link_offsets);
+	vector<Link>().swap(ma_links);
+	m_links_frozen = false;
+}
+
+void ObjCTypeRecord::freeze_links() throw() {
+	if (m_links_frozen)
+		return;
+	
+	size_t link_count = 0;
+	for (vector<vector<Link> >::const_iterator cit = ma_link_lists.begin(); cit != ma_link_lists.end(); ++ cit)
+		link_count += cit->size();
+	
+	ma_links.clear();
+	ma_links.reserve(link_count);
+	ma_link_offsets.resize(ma_type_store.size() + 1);
+	for (TypeIndex i = 0; i < ma_type_store.size(); ++ i) {
+		ma_link_offsets[i] = static_cast<unsigned>(ma_links.size());
+		if (i < ma_link_lists.size())
+			ma_links.insert(ma_links.end(), ma_link_lists[i].begin(), ma_link_lists[i].end());
+	}
+	ma_link_offsets.back() = static_cast<unsigned>(ma_links.size());
+	
+	vector<vector<Link> >().swap(ma_link_lists);
+	m_links_frozen = true;
+}
+
+ObjCTypeRecord::EdgeStrength ObjCTypeRecord::link_strength(TypeIndex a, TypeIndex b) const throw() {
+	LinkRange links = dependencies(a);
+	const Link* lit = lower_bound(links.begin(), links.end(), Link(b, ES_None));
+	if (lit != links.end() && lit->target == b)
+		return lit->strength;
+	else
+		return ES_None;
+}
+
 // for 2 types to be equal...
 bool ObjCTypeRecord::Type::is_compatible_with(const Type& another, const ObjCTypeRecord& record, tr1::unordered_set<TypePointerPair>& banned_pairs) const throw() {
 	// this is pretty obvious yeah?
@@ -899,33 +1115,31 @@ void ObjCTypeRecord::sort_alphabetically(vector<TypeIndex>::iterator type_indice
 }
 
 // Basically an uglified topological sort.
-static void octr_visit(const tr1::unordered_map<ObjCTypeRecord::TypeIndex, tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength> >& adjlist, tr1::unordered_map<ObjCTypeRecord::TypeIndex, bool>& visited, vector<ObjCTypeRecord::TypeIndex>& result, ObjCTypeRecord::TypeIndex ti) {
-	tr1::unordered_map<ObjCTypeRecord::TypeIndex, bool>::iterator vit = visited.find(ti);
-	if (vit != visited.end() && !vit->second) {
-		vit->second = true;
-		tr1::unordered_map<ObjCTypeRecord::TypeIndex, tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength> >::const_iterator cit = adjlist.find(ti);
-		if (cit != adjlist.end()) {
-			for (tr1::unordered_map<ObjCTypeRecord::TypeIndex, ObjCTypeRecord::EdgeStrength>::const_iterator nit = cit->second.begin(); nit != cit->second.end(); ++ nit) {
-				if (nit->second >= ObjCTypeRecord::ES_StrongIndirect)
-					octr_visit(adjlist, visited, result, nit->first);
-			}
-			result.push_back(ti);
+// visit_states: 0 = not to be sorted, 1 = not visited yet, 2 = visited.
+static void octr_visit(const ObjCTypeRecord& record, vector<unsigned char>& visit_states, vector<ObjCTypeRecord::TypeIndex>& result, ObjCTypeRecord::TypeIndex ti) {
+	if (visit_states[ti] == 1) {
+		visit_states[ti] = 2;
+		ObjCTypeRecord::LinkRange links = record.dependencies(ti);
+		for (const ObjCTypeRecord::Link* lit = links.begin(); lit != links.end(); ++ lit) {
+			if (lit->strength >= ObjCTypeRecord::ES_StrongIndirect)
+				octr_visit(record, visit_states, result, lit->target);
 		}
+		result.push_back(ti);
 	}
 }
 
 void ObjCTypeRecord::sort_by_strong_links(vector<TypeIndex>::iterator type_indices_begin, vector<TypeIndex>::iterator type_indices_end) const throw() {
 	// sort(type_indices_begin, type_indices_end, octr_StrongLinkSorter(*this));
-	tr1::unordered_map<TypeIndex, bool> visited;
+	vector<unsigned char> visit_states (ma_type_store.size());
 	for (vector<TypeIndex>::iterator it = type_indices_begin; it != type_indices_end; ++ it)
-		visited.insert(std::pair<TypeIndex, bool>(*it, false));
+		visit_states[*it] = 1;
 	
 	size_t length = type_indices_end - type_indices_begin;
 	vector<TypeIndex> result;
 	result.reserve(length);
 	
 	for (vector<TypeIndex>::iterator it = type_indices_begin; it != type_indices_end; ++ it)
-		octr_visit(ma_adjlist, visited, result, *it);
+		octr_visit(*this, visit_states, result, *it);
 	
 	copy(result.begin(), result.end(), type_indices_begin);
 }
@@ -941,14 +1155,13 @@ string ObjCTypeRecord::format_structs_with_forward_declarations(const vector<Typ
 		// Forward declare any weak dependencies first.
 		weak_dependecies.clear();
 		
-		const tr1::unordered_map<TypeIndex, EdgeStrength>* cur_dependencies = dependencies(*cit);
-		if (cur_dependencies != NULL)
-			for (tr1::unordered_map<TypeIndex, EdgeStrength>::const_iterator dit = cur_dependencies->begin(); dit != cur_dependencies->end(); ++ dit) {
-				if (dit->second == ES_Weak && dit->first != *cit && forward_declared.find(dit->first) == forward_declared.end()) {
-					forward_declared.insert(dit->first);
-					weak_dependecies.push_back(dit->first);
-				}
+		LinkRange cur_dependencies = dependencies(*cit);
+		for (const Link* dit = cur_dependencies.begin(); dit != cur_dependencies.end(); ++ dit) {
+			if (dit->strength == ES_Weak && dit->target != *cit && forward_declared.find(dit->target) == forward_declared.end()) {
+				forward_declared.insert(dit->target);
+				weak_dependecies.push_back(dit->target);
 			}
+		}
 		
 		res += format_forward_declaration(weak_dependecies);
 		res += format(*cit, "", 0, true, forward_declared.find(*cit) != forward_declared.end());
@@ -962,21 +1175,26 @@ string ObjCTypeRecord::format_structs_with_forward_declarations(const vector<Typ
 
 void ObjCTypeRecord::print_network() const throw() {
 	printf("digraph G {\n");
-	for (tr1::unordered_map<TypeIndex, tr1::unordered_map<TypeIndex, EdgeStrength> >::const_iterator cit = ma_adjlist.begin(); cit != ma_adjlist.end(); ++ cit) {
-		const Type& t = ma_type_store[cit->first];
+	for (TypeIndex i = 0; i < ma_type_store.size(); ++ i) {
+		if (dependencies(i).empty() && link_count(i) == 0)
+			continue;
+		const Type& t = ma_type_store[i];
 		char tp = t.type;
 		const char* shape = (tp == '(' || tp == '{') ? "box" : t.external ? "doublecircle" : "circle";
 		printf("\t\"%c%s%s\" [shape=%s]\n", tp, t.name.c_str(), t.value.c_str(), shape);
 	}
 	string s;
-	for (tr1::unordered_map<TypeIndex, tr1::unordered_map<TypeIndex, EdgeStrength> >::const_iterator cit = ma_adjlist.begin(); cit != ma_adjlist.end(); ++ cit) {
-		const Type& t = ma_type_store[cit->first];
+	for (TypeIndex i = 0; i < ma_type_store.size(); ++ i) {
+		LinkRange links = dependencies(i);
+		if (links.empty())
+			continue;
+		const Type& t = ma_type_store[i];
 		s = string(1, t.type);
 		s += t.name;
 		s += t.value;
-		for (tr1::unordered_map<TypeIndex, EdgeStrength>::const_iterator dit = cit->second.begin(); dit != cit->second.end(); ++ dit) {
-			const Type& t2 = ma_type_store[dit->first];
-			printf("\t\"%s\" -> \"%c%s%s\" [color=%s]\n", s.c_str(), t2.type, t2.name.c_str(), t2.value.c_str(), dit->second == ES_Strong ? "black" : dit->second == ES_StrongIndirect ? "gray50" : "gray");
+		for (const Link* dit = links.begin(); dit != links.end(); ++ dit) {
+			const Type& t2 = ma_type_store[dit->target];
+			printf("\t\"%s\" -> \"%c%s%s\" [color=%s]\n", s.c_str(), t2.type, t2.name.c_str(), t2.value.c_str(), dit->strength == ES_Strong ? "black" : dit->strength == ES_StrongIndirect ? "gray50" : "gray");
 		}
 	}
 	printf("}\n");
@@ -995,20 +1213,22 @@ void ObjCTypeRecord::create_short_circuit_weak_links() throw() {
 	for (TypeIndex i = 0; i < ma_type_store.size(); ++ i) {
 		const Type& t = ma_type_store[i];
 		if (t.refcount > 1 && (t.type == '@' || t.type == '{' || t.type == '[')) {
-			tr1::unordered_map<TypeIndex, EdgeStrength>& adjs = ma_adjlist[i];
+			vector<Link>& links = mutable_links(i);
 			bool modified;
 			do {
-				vector<pair<TypeIndex, EdgeStrength> > unmodified_adjs (adjs.begin(), adjs.end());
+				vector<Link> unmodified_links = links;
 				modified = false;
 				
-				for (vector<pair<TypeIndex, EdgeStrength> >::const_iterator cit = unmodified_adjs.begin(); cit != unmodified_adjs.end(); ++ cit) {
-					if (cit->second >= ES_StrongIndirect) {
-						const Type& s = ma_type_store[cit->first];
+				for (vector<Link>::const_iterator cit = unmodified_links.begin(); cit != unmodified_links.end(); ++ cit) {
+					if (cit->strength >= ES_StrongIndirect) {
+						const Type& s = ma_type_store[cit->target];
 						if (s.refcount == 1 && s.name.empty()) {
-							combine_dependencies(adjs, ma_adjlist[cit->first], &ma_k_in, &ma_strong_k_in);
-							adjs.erase(cit->first);
-							-- ma_k_in[cit->first];
-							-- ma_strong_k_in[cit->first];
+							combine_dependencies(links, dependencies(cit->target), &ma_k_in, &ma_strong_k_in);
+							vector<Link>::iterator lit = lower_bound(links.begin(), links.end(), *cit);
+							if (lit != links.end() && lit->target == cit->target)
+								links.erase(lit);
+							-- link_counter(ma_k_in, cit->target);
+							-- link_counter(ma_strong_k_in, cit->target);
 							modified = true;
 						}
 					}
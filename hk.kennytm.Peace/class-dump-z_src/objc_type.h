@@ -28,6 +28,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <tr1/unordered_map>
 #include <cstdarg>
 #include <cstdio>
+#include "Threading.h"
+
+class AnalysisCacheWriter;
+class AnalysisCacheReader;
 
 class ObjCTypeRecord {
 public:
@@ -41,6 +45,23 @@ public:
 		ES_Strong			// direct strong link: The target type must be completely declared before the source type, and a class must #include this type in a header file.
 	};
 	
+	struct Link {
+		TypeIndex target;
+		EdgeStrength strength;
+		Link(TypeIndex target_, EdgeStrength strength_) throw() : target(target_), strength(strength_) {}
+		bool operator<(const Link& other) const throw() { return target < other.target; }
+	};
+	
+	// the links going out of a type, sorted by target.
+	struct LinkRange {
+		const Link* first;
+		const Link* last;
+		LinkRange(const Link* first_, const Link* last_) throw() : first(first_), last(last_) {}
+		const Link* begin() const throw() { return first; }
+		const Link* end() const throw() { return last; }
+		bool empty() const throw() { return first == last; }
+	};
+	
 private:
 	class Type;
 	
@@ -75,6 +96,8 @@ private:
 		//----
 		
 		Type(ObjCTypeRecord& record, const std::string& type_to_parse, bool is_struct_used_locally);
+		// for reading from a cache.
+		Type() : type('\0'), external(false), refcount(0), type_index(0) {}
 		std::string format(const ObjCTypeRecord& record, const std::string& argname, unsigned tabs, bool treat_char_as_bool, bool as_declaration, bool pointers_right_aligned, bool dont_typedef, std::vector<TypeIndex>* append_struct_if_matching, bool treat_objcls_as_struct) const throw();
 		
 		bool is_compatible_with(const Type& another, const ObjCTypeRecord& record, std::tr1::unordered_set<TypePointerPair>& banned_pairs) const throw();
@@ -88,8 +111,32 @@ private:
 	std::tr1::unordered_map<std::string, TypeIndex> ma_indexed_types;
 	std::vector<Type> ma_type_store;
 	
-	std::tr1::unordered_map<TypeIndex, std::tr1::unordered_map<TypeIndex, EdgeStrength> > ma_adjlist;
-	std::tr1::unordered_map<TypeIndex, unsigned> ma_k_in, ma_strong_k_in;
+	// the types, bucketed by everything Type::is_compatible_with() checks before comparing the subtypes:
+	// the leading character, the value, the name and the number of subtypes. Buckets are sorted.
+	std::tr1::unordered_map<std::string, std::vector<TypeIndex> > ma_structural_index;
+	
+	// format() rendered with no indentation and a placeholder for the argument name, by type index and formatting flags.
+	// Bumping m_format_generation (whenever a type changes in a way that affects formatting) drops the whole cache.
+	struct FormattedType {
+		std::string declarator;
+		std::size_t argname_position;	// std::string::npos if the argument name does not appear.
+		bool multiline;
+		// returns false if the declarator has to be rendered again for this indentation.
+		bool splice(const std::string& argname, unsigned tabs, std::string& result) const throw();
+	};
+	mutable std::tr1::unordered_map<unsigned long long, FormattedType> ma_format_cache;
+	mutable unsigned m_format_cache_generation;
+	mutable Mutex m_format_cache_mutex;
+	unsigned m_format_generation;
+	
+	// The links of type i, indexed by TypeIndex. While the record is being built every type has its own sorted list in
+	// ma_link_lists. freeze_links() packs them into one array, with the links of type i in
+	// ma_links[ma_link_offsets[i] .. ma_link_offsets[i+1]), and adding a link afterwards unpacks them again.
+	std::vector<std::vector<Link> > ma_link_lists;
+	std::vector<unsigned> ma_link_offsets;
+	std::vector<Link> ma_links;
+	bool m_links_frozen;
+	std::vector<unsigned> ma_k_in, ma_strong_k_in;	// indexed by TypeIndex; may be shorter than the type store.
 	
 	TypeIndex m_void_type_index;
 	TypeIndex m_id_type_index;
@@ -99,8 +146,21 @@ private:
 	friend class Type;
 	
 private:
+	// a NULL name or arity makes a wildcard key.
+	static std::string structural_key(char type, const std::string& value, const std::string* name, const std::size_t* arity);
+	void index_type(TypeIndex idx);
+	void unindex_type(TypeIndex idx);
+	void rebuild_structural_index();
+	
+	std::string format_uncached(TypeIndex type_index, const std::string& argname, unsigned tabs, bool as_declaration, bool dont_typedef, bool treat_objcls_as_struct) const throw() {
+		std::vector<TypeIndex> ti;
+		return ma_type_store[type_index].format(*this, argname, tabs, true, as_declaration, pointers_right_aligned, dont_typedef, dont_typedef ? NULL : &ti, treat_objcls_as_struct);
+	}
+	
 	void add_objc_class_private(const std::string& objc_class);
 	void add_link_with_strength(TypeIndex from, TypeIndex to, EdgeStrength strength, bool convert_class_strength_to_weak = true);
+	std::vector<Link>& mutable_links(TypeIndex from);
+	void thaw_links();
 	
 public:
 	bool pointers_right_aligned;
@@ -116,16 +176,22 @@ public:
 	void add_weak_link(TypeIndex from, TypeIndex to) { add_link_with_strength(from, to, ES_Weak); }
 	
 	TypeIndex parse(const std::string& type_to_parse, bool is_struct_used_locally);
-	std::string format(TypeIndex type_index, const std::string& argname, unsigned tabs, bool as_declaration, bool dont_typedef, bool treat_objcls_as_struct = false) const throw() {
-		std::vector<TypeIndex> ti;
-		return ma_type_store[type_index].format(*this, argname, tabs, true, as_declaration, pointers_right_aligned, dont_typedef, dont_typedef ? NULL : &ti, treat_objcls_as_struct);
+	// find a type parsed before, without modifying the record.
+	bool lookup(const std::string& type_to_parse, TypeIndex& type_index) const throw() {
+		std::tr1::unordered_map<std::string, TypeIndex>::const_iterator cit = ma_indexed_types.find(type_to_parse);
+		if (cit == ma_indexed_types.end())
+			return false;
+		type_index = cit->second;
+		return true;
 	}
+	// safe to call from several threads, as long as no one modifies the record at the same time.
+	std::string format(TypeIndex type_index, const std::string& argname, unsigned tabs, bool as_declaration, bool dont_typedef, bool treat_objcls_as_struct = false) const throw();
 	
 	std::string format_forward_declaration(const std::vector<TypeIndex>& type_indices) const throw();
 	
 	size_t types_count() const throw() { return ma_type_store.size(); }
 	
-	ObjCTypeRecord() : pointers_right_aligned(false), prettify_struct_names(true) {
+	ObjCTypeRecord() : m_format_cache_generation(0), m_format_generation(0), m_links_frozen(false), pointers_right_aligned(false), prettify_struct_names(true) {
 		m_void_type_index = parse("v", false);
 		m_id_type_index = parse("@", false);
 		m_sel_type_index = parse(":", false);
@@ -166,40 +232,40 @@ public:
 	void sort_by_strong_links(std::vector<TypeIndex>::iterator type_indices_begin, std::vector<TypeIndex>::iterator type_indices_end) const throw();
 	std::string format_structs_with_forward_declarations(const std::vector<TypeIndex>& type_indices) const throw();
 	
-	const std::tr1::unordered_map<TypeIndex, EdgeStrength>* dependencies(TypeIndex type_index) const throw() { 
-		std::tr1::unordered_map<TypeIndex, std::tr1::unordered_map<TypeIndex, EdgeStrength> >::const_iterator cit = ma_adjlist.find(type_index);
-		if (cit == ma_adjlist.end())
-			return NULL;
-		else
-			return &(cit->second);
-	}
-	EdgeStrength link_strength(TypeIndex a, TypeIndex b) const throw() {
-		std::tr1::unordered_map<TypeIndex, std::tr1::unordered_map<TypeIndex, EdgeStrength> >::const_iterator ait = ma_adjlist.find(a);
-		if (ait == ma_adjlist.end())
-			return ES_None;
-		else {
-			std::tr1::unordered_map<TypeIndex, EdgeStrength>::const_iterator bit = ait->second.find(b);
-			if (bit == ait->second.end())
-				return ES_None;
-			else
-				return bit->second;
+	LinkRange dependencies(TypeIndex type_index) const throw() {
+		if (m_links_frozen) {
+			if (type_index + 1 >= ma_link_offsets.size())
+				return LinkRange(NULL, NULL);
+			const Link* links = ma_links.empty() ? NULL : &ma_links[0];
+			return LinkRange(links + ma_link_offsets[type_index], links + ma_link_offsets[type_index+1]);
+		} else {
+			if (type_index >= ma_link_lists.size() || ma_link_lists[type_index].empty())
+				return LinkRange(NULL, NULL);
+			const std::vector<Link>& links = ma_link_lists[type_index];
+			return LinkRange(&links[0], &links[0] + links.size());
 		}
 	}
+	EdgeStrength link_strength(TypeIndex a, TypeIndex b) const throw();
 	
 	unsigned link_count(TypeIndex type_index, bool strong_only = false) const throw() { 
-		std::tr1::unordered_map<TypeIndex, unsigned>::const_iterator cit = (strong_only ? ma_strong_k_in : ma_k_in).find(type_index);
-		if (cit == (strong_only ? ma_strong_k_in : ma_k_in).end())
-			return 0;
-		else
-			return cit->second;
+		const std::vector<unsigned>& k_in = strong_only ? ma_strong_k_in : ma_k_in;
+		return type_index < k_in.size() ? k_in[type_index] : 0;
 	}
 	
+	// pack the links into contiguous memory once the record is complete. The record stays modifiable.
+	void freeze_links() throw();
+	
 	// Strongly-linked anonymous structs used only once will be embedded in its containing struct.
 	// But the weak link associated with it will not be transferred to the container.
 	// This function is to do such a transfer.
 	void create_short_circuit_weak_links() throw();
 	
 	// void insert_cpp_method(const char* mangled_name) throw();
+	
+	// the whole record except the formatting options. See MachO_File_ObjC_cache.cpp.
+	void write_cache(AnalysisCacheWriter& writer) const;
+	// leaves the record unchanged and returns false if the reader runs out of data.
+	bool read_cache(AnalysisCacheReader& reader);
 };
 
 #endif
@@ -0,0 +1,377 @@
+/*
+
+DependencyGraph.cpp ... Analysis of the dependency graph
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DependencyGraph.h"
+#include "DataFile.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+struct DependencyGraphHeader {
+	char magic[8];
+	unsigned version;
+	unsigned node_count;
+	unsigned arc_count;
+	unsigned strings_size;
+};
+
+static const char graph_magic[8] = {'P', 'e', 'a', 'c', 'e', 'D', 'G', '\0'};
+static const unsigned graph_version = 1;
+
+// index of the lowest set bit of a non-zero word.
+static inline unsigned lowest_bit(unsigned x) throw() {
+	static const unsigned char debruijn_positions[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+	};
+	return debruijn_positions[((x & (0u - x)) * 0x077CB531u) >> 27];
+}
+
+#pragma mark -
+
+// vector's fill constructor and assign() take it by reference.
+const unsigned DependencyGraph::npos;
+
+DependencyGraph::DependencyGraph(const vector<string>& paths, const vector<pair<unsigned,unsigned> >& arcs) : ma_paths(paths) {
+	this->build_csr(arcs);
+	this->analyze();
+}
+
+DependencyGraph::DependencyGraph(const char* filename) {
+	DataFile file (filename);
+	
+	const DependencyGraphHeader* header = file.peek_data_at<DependencyGraphHeader>(0);
+	if (header == NULL || memcmp(header->magic, graph_magic, sizeof(graph_magic)) != 0 || header->version != graph_version)
+		throw TRException("DependencyGraph::DependencyGraph(const char*):\n\t\"%s\" is not a dependency graph.", filename);
+		
+	unsigned node_count = header->node_count, arc_count = header->arc_count;
+	off_t expected_size = static_cast<off_t>(sizeof(DependencyGraphHeader)) + (static_cast<off_t>(node_count) + 1 + arc_count) * 4 + header->strings_size;
+	if (node_count >= (1u << 28) || arc_count >= (1u << 28) || expected_size != file.filesize())
+		throw TRException("DependencyGraph::DependencyGraph(const char*):\n\t\"%s\" is truncated.", filename);
+		
+	const unsigned* offsets = reinterpret_cast<const unsigned*>(file.data() + sizeof(DependencyGraphHeader));
+	const unsigned* targets = offsets + node_count + 1;
+	const char* strings = reinterpret_cast<const char*>(targets + arc_count);
+	const char* strings_end = strings + header->strings_size;
+	
+	ma_paths.reserve(node_count);
+	for (unsigned i = 0; i < node_count; ++ i) {
+		const char* nul = static_cast<const char*>(memchr(strings, '\0', static_cast<size_t>(strings_end - strings)));
+		if (nul == NULL)
+			throw TRException("DependencyGraph::DependencyGraph(const char*):\n\t\"%s\" is corrupted.", filename);
+		ma_paths.push_back(string(strings, nul));
+		strings = nul + 1;
+	}
+	
+	vector<pair<unsigned,unsigned> > arcs;
+	arcs.reserve(arc_count);
+	if (offsets[0] != 0 || offsets[node_count] != arc_count)
+		throw TRException("DependencyGraph::DependencyGraph(const char*):\n\t\"%s\" is corrupted.", filename);
+	for (unsigned i = 0; i < node_count; ++ i) {
+		if (offsets[i] > offsets[i+1])
+			throw TRException("DependencyGraph::DependencyGraph(const char*):\n\t\"%s\" is corrupted.", filename);
+		for (unsigned j = offsets[i]; j < offsets[i+1]; ++ j) {
+			if (targets[j] >= node_count)
+				throw TRException("DependencyGraph::DependencyGraph(const char*):\n\t\"%s\" is corrupted.", filename);
+			arcs.push_back(pair<unsigned,unsigned>(i, targets[j]));
+		}
+	}
+	
+	this->build_csr(arcs);
+	this->analyze();
+}
+
+void DependencyGraph::build_csr(const vector<pair<unsigned,unsigned> >& arcs) {
+	unsigned node_count = this->node_count();
+	
+	// counting sort by dependent. Arcs from the same node keep their order.
+	ma_offsets.assign(node_count + 1, 0);
+	for (vector<pair<unsigned,unsigned> >::const_iterator cit = arcs.begin(); cit != arcs.end(); ++ cit)
+		++ ma_offsets[cit->first + 1];
+	for (unsigned i = 0; i < node_count; ++ i)
+		ma_offsets[i+1] += ma_offsets[i];
+		
+	ma_targets.resize(arcs.size());
+	vector<unsigned> cursors (ma_offsets.begin(), ma_offsets.end() - 1);
+	for (vector<pair<unsigned,unsigned> >::const_iterator cit = arcs.begin(); cit != arcs.end(); ++ cit)
+		ma_targets[cursors[cit->first] ++] = cit->second;
+		
+	// drop duplicated arcs.
+	vector<unsigned> last_source (node_count, npos);
+	unsigned out = 0;
+	for (unsigned i = 0; i < node_count; ++ i) {
+		unsigned begin = ma_offsets[i], end = ma_offsets[i+1];
+		ma_offsets[i] = out;
+		for (unsigned j = begin; j < end; ++ j) {
+			unsigned target = ma_targets[j];
+			if (last_source[target] != i) {
+				last_source[target] = i;
+				ma_targets[out ++] = target;
+			}
+		}
+	}
+	ma_offsets[node_count] = out;
+	ma_targets.resize(out);
+	
+	// the reverse graph. Dependents come out in increasing order.
+	ma_reverse_offsets.assign(node_count + 1, 0);
+	for (vector<unsigned>::const_iterator cit = ma_targets.begin(); cit != ma_targets.end(); ++ cit)
+		++ ma_reverse_offsets[*cit + 1];
+	for (unsigned i = 0; i < node_count; ++ i)
+		ma_reverse_offsets[i+1] += ma_reverse_offsets[i];
+		
+	ma_reverse_targets.resize(ma_targets.size());
+	cursors.assign(ma_reverse_offsets.begin(), ma_reverse_offsets.end() - 1);
+	for (unsigned i = 0; i < node_count; ++ i)
+		for (unsigned j = ma_offsets[i]; j < ma_offsets[i+1]; ++ j)
+			ma_reverse_targets[cursors[ma_targets[j]] ++] = i;
+}
+
+#pragma mark -
+
+// Tarjan's algorithm, with an explicit stack so deep dependency chains cannot overflow the call stack.
+// A component is completed only after every component it can reach, which gives the numbering promised in the header.
+void DependencyGraph::find_components() {
+	unsigned node_count = this->node_count();
+	vector<unsigned> indices (node_count, npos), lowlinks (node_count);
+	vector<bool> on_stack (node_count, false);
+	vector<unsigned> stack;
+	vector<pair<unsigned,unsigned> > call_stack;	// (node, next arc).
+	unsigned next_index = 0;
+	
+	ma_components.assign(node_count, npos);
+	m_component_count = 0;
+	
+	for (unsigned root = 0; root < node_count; ++ root) {
+		if (indices[root] != npos)
+			continue;
+			
+		indices[root] = lowlinks[root] = next_index ++;
+		stack.push_back(root);
+		on_stack[root] = true;
+		call_stack.push_back(pair<unsigned,unsigned>(root, ma_offsets[root]));
+		
+		while (!call_stack.empty()) {
+			unsigned v = call_stack.back().first;
+			if (call_stack.back().second < ma_offsets[v+1]) {
+				unsigned w = ma_targets[call_stack.back().second ++];
+				if (indices[w] == npos) {
+					indices[w] = lowlinks[w] = next_index ++;
+					stack.push_back(w);
+					on_stack[w] = true;
+					call_stack.push_back(pair<unsigned,unsigned>(w, ma_offsets[w]));
+				} else if (on_stack[w])
+					lowlinks[v] = min(lowlinks[v], indices[w]);
+			} else {
+				call_stack.pop_back();
+				if (lowlinks[v] == indices[v]) {
+					unsigned w;
+					do {
+						w = stack.back();
+						stack.pop_back();
+						on_stack[w] = false;
+						ma_components[w] = m_component_count;
+					} while (w != v);
+					++ m_component_count;
+				}
+				if (!call_stack.empty()) {
+					unsigned u = call_stack.back().first;
+					lowlinks[u] = min(lowlinks[u], lowlinks[v]);
+				}
+			}
+		}
+	}
+	
+	ma_component_offsets.assign(m_component_count + 1, 0);
+	for (unsigned i = 0; i < node_count; ++ i)
+		++ ma_component_offsets[ma_components[i] + 1];
+	for (unsigned c = 0; c < m_component_count; ++ c)
+		ma_component_offsets[c+1] += ma_component_offsets[c];
+	ma_component_members.resize(node_count);
+	vector<unsigned> cursors (ma_component_offsets.begin(), ma_component_offsets.end() - 1);
+	for (unsigned i = 0; i < node_count; ++ i)
+		ma_component_members[cursors[ma_components[i]] ++] = i;
+		
+	ma_component_cyclic.assign(m_component_count, false);
+	for (unsigned c = 0; c < m_component_count; ++ c)
+		if (ma_component_offsets[c+1] - ma_component_offsets[c] > 1)
+			ma_component_cyclic[c] = true;
+	for (unsigned i = 0; i < node_count; ++ i)
+		for (unsigned j = ma_offsets[i]; j < ma_offsets[i+1]; ++ j)
+			if (ma_targets[j] == i)
+				ma_component_cyclic[ma_components[i]] = true;
+}
+
+// Components are visited dependencies first, so every row a component needs is complete by then,
+// and a row is merged with 32 components at a time.
+void DependencyGraph::compute_closure() {
+	m_row_words = (m_component_count + 31) / 32;
+	ma_closure.assign(static_cast<size_t>(m_component_count) * m_row_words, 0);
+	ma_levels.assign(m_component_count, 0);
+	vector<unsigned> last_merged (m_component_count, npos);
+	
+	for (unsigned c = 0; c < m_component_count; ++ c) {
+		unsigned* row = &ma_closure[c * m_row_words];
+		if (ma_component_cyclic[c])
+			row[c / 32] |= 1u << (c % 32);
+			
+		for (unsigned k = ma_component_offsets[c]; k < ma_component_offsets[c+1]; ++ k) {
+			unsigned v = ma_component_members[k];
+			for (unsigned j = ma_offsets[v]; j < ma_offsets[v+1]; ++ j) {
+				unsigned d = ma_components[ma_targets[j]];
+				if (d == c || last_merged[d] == c)
+					continue;
+				last_merged[d] = c;
+				
+				ma_levels[c] = max(ma_levels[c], ma_levels[d] + 1);
+				row[d / 32] |= 1u << (d % 32);
+				const unsigned* dependency_row = this->closure_row(d);
+				for (unsigned w = 0; w < m_row_words; ++ w)
+					row[w] |= dependency_row[w];
+			}
+		}
+	}
+	
+	// the counts exclude the node itself, even when it is in a cycle.
+	ma_dependency_counts.assign(m_component_count, 0);
+	ma_dependent_counts.assign(m_component_count, 0);
+	for (unsigned c = 0; c < m_component_count; ++ c) {
+		unsigned size = ma_component_offsets[c+1] - ma_component_offsets[c];
+		const unsigned* row = this->closure_row(c);
+		for (unsigned w = 0; w < m_row_words; ++ w) {
+			for (unsigned bits = row[w]; bits != 0; bits &= bits - 1) {
+				unsigned d = w * 32 + lowest_bit(bits);
+				ma_dependency_counts[c] += ma_component_offsets[d+1] - ma_component_offsets[d];
+				ma_dependent_counts[d] += size;
+			}
+		}
+	}
+	for (unsigned c = 0; c < m_component_count; ++ c) {
+		if (ma_component_cyclic[c]) {
+			-- ma_dependency_counts[c];
+			-- ma_dependent_counts[c];
+		}
+	}
+}
+
+void DependencyGraph::analyze() {
+	this->find_components();
+	this->compute_closure();
+}
+
+#pragma mark -
+
+vector<unsigned> DependencyGraph::find(const char* name) const {
+	vector<unsigned> retval;
+	for (unsigned i = 0; i < this->node_count(); ++ i)
+		if (ma_paths[i] == name)
+			retval.push_back(i);
+			
+	if (retval.empty()) {
+		for (unsigned i = 0; i < this->node_count(); ++ i) {
+			const char* path = ma_paths[i].c_str();
+			const char* filename = strrchr(path, '/');
+			if (strcmp(filename != NULL ? filename+1 : path, name) == 0)
+				retval.push_back(i);
+		}
+	}
+	return retval;
+}
+
+vector<unsigned> DependencyGraph::transitive_dependencies(unsigned node) const {
+	vector<unsigned> retval;
+	unsigned c = ma_components[node];
+	for (unsigned i = 0; i < this->node_count(); ++ i)
+		if (i != node && this->reaches(c, ma_components[i]))
+			retval.push_back(i);
+	return retval;
+}
+
+vector<unsigned> DependencyGraph::transitive_dependents(unsigned node) const {
+	vector<unsigned> retval;
+	unsigned c = ma_components[node];
+	for (unsigned i = 0; i < this->node_count(); ++ i)
+		if (i != node && this->reaches(ma_components[i], c))
+			retval.push_back(i);
+	return retval;
+}
+
+#pragma mark -
+
+void DependencyGraph::write_pajek(FILE* f) const {
+	fprintf(f, "*NETWORK Dependency graph.\r\n");
+	fprintf(f, "*VERTICES %u\r\n", this->node_count());
+	for (unsigned i = 0; i < this->node_count(); ++ i) {
+		const char* path = ma_paths[i].c_str();
+		const char* filename = strrchr(path, '/');
+		fprintf(f, " %u \"%s\" # %s\r\n", i+1, filename != NULL ? filename+1 : path, path);
+	}
+	fprintf(f, "*ARCS\r\n");
+	for (unsigned i = 0; i < this->node_count(); ++ i)
+		for (unsigned j = ma_offsets[i]; j < ma_offsets[i+1]; ++ j)
+			fprintf(f, " %u %u 1\r\n", i+1, ma_targets[j]+1);
+}
+
+static void write_csv_field(FILE* f, const char* str) {
+	if (strpbrk(str, ",\"\n") == NULL)
+		fputs(str, f);
+	else {
+		fputc('"', f);
+		for (; *str != '\0'; ++ str) {
+			if (*str == '"')
+				fputc('"', f);
+			fputc(*str, f);
+		}
+		fputc('"', f);
+	}
+}
+
+void DependencyGraph::write_csv(FILE* f) const {
+	fprintf(f, "id,name,path,component,level,fan_in,fan_out,dependencies,dependents\n");
+	for (unsigned i = 0; i < this->node_count(); ++ i) {
+		const char* path = ma_paths[i].c_str();
+		const char* filename = strrchr(path, '/');
+		fprintf(f, "%u,", i+1);
+		write_csv_field(f, filename != NULL ? filename+1 : path);
+		fputc(',', f);
+		write_csv_field(f, path);
+		fprintf(f, ",%u,%u,%u,%u,%u,%u\n", this->component(i), this->level(i), this->fan_in(i), this->fan_out(i), this->dependency_count(i), this->dependent_count(i));
+	}
+}
+
+bool DependencyGraph::write_binary(FILE* f) const {
+	DependencyGraphHeader header;
+	memcpy(header.magic, graph_magic, sizeof(graph_magic));
+	header.version = graph_version;
+	header.node_count = this->node_count();
+	header.arc_count = static_cast<unsigned>(ma_targets.size());
+	header.strings_size = 0;
+	for (vector<string>::const_iterator cit = ma_paths.begin(); cit != ma_paths.end(); ++ cit)
+		header.strings_size += static_cast<unsigned>(cit->size() + 1);
+		
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && fwrite(&ma_offsets[0], sizeof(unsigned), ma_offsets.size(), f) == ma_offsets.size();
+	ok = ok && (ma_targets.empty() || fwrite(&ma_targets[0], sizeof(unsigned), ma_targets.size(), f) == ma_targets.size());
+	for (vector<string>::const_iterator cit = ma_paths.begin(); ok && cit != ma_paths.end(); ++ cit)
+		ok = fwrite(cit->c_str(), 1, cit->size() + 1, f) == cit->size() + 1;
+	return ok;
+}
@@ -0,0 +1,96 @@
+/*
+
+DependencyGraph.h ... Analysis of the dependency graph
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DEPENDENCYGRAPH_H
+#define DEPENDENCYGRAPH_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdio>
+
+// The dependency graph in compressed sparse row form, with everything derived from it:
+//  - strongly connected components (two-way dependencies are rare, but happen in private frameworks),
+//  - topological levels, where libraries without dependencies are on level 0,
+//  - the transitive closure, as one bitset of components per component.
+// Components are numbered so that a component only depends on components with smaller numbers.
+class DependencyGraph {
+public:
+	static const unsigned npos = ~0u;
+
+private:
+	std::vector<std::string> ma_paths;
+	
+	// the dependencies of node i are ma_targets[ma_offsets[i]] to ma_targets[ma_offsets[i+1]-1].
+	std::vector<unsigned> ma_offsets, ma_targets;
+	// the same for the dependents.
+	std::vector<unsigned> ma_reverse_offsets, ma_reverse_targets;
+	
+	unsigned m_component_count;
+	std::vector<unsigned> ma_components;	// node -> component.
+	std::vector<unsigned> ma_component_offsets, ma_component_members;	// component -> nodes, in CSR form.
+	std::vector<bool> ma_component_cyclic;	// whether the nodes of the component depend on themselves.
+	std::vector<unsigned> ma_levels;	// component -> level.
+	
+	// row c has a bit set for every component reachable from component c through at least one arc.
+	unsigned m_row_words;
+	std::vector<unsigned> ma_closure;
+	std::vector<unsigned> ma_dependency_counts, ma_dependent_counts;	// component -> number of nodes, excluding the node itself.
+	
+	void build_csr(const std::vector<std::pair<unsigned,unsigned> >& arcs);
+	void find_components();
+	void compute_closure();
+	void analyze();
+	
+	inline const unsigned* closure_row(unsigned component) const throw() { return &ma_closure[component * m_row_words]; }
+	inline bool reaches(unsigned from_component, unsigned to_component) const throw() {
+		return (this->closure_row(from_component)[to_component / 32] >> (to_component % 32)) & 1;
+	}
+
+public:
+	// arcs are (dependent, dependency) pairs of indices into paths. Duplicated arcs are ignored.
+	DependencyGraph(const std::vector<std::string>& paths, const std::vector<std::pair<unsigned,unsigned> >& arcs);
+	// read a graph written by write_binary(). Throws a TRException if the file is not one.
+	explicit DependencyGraph(const char* filename);
+	
+	inline unsigned node_count() const throw() { return static_cast<unsigned>(ma_paths.size()); }
+	inline const std::string& path(unsigned node) const throw() { return ma_paths[node]; }
+	
+	inline unsigned fan_out(unsigned node) const throw() { return ma_offsets[node+1] - ma_offsets[node]; }
+	inline unsigned fan_in(unsigned node) const throw() { return ma_reverse_offsets[node+1] - ma_reverse_offsets[node]; }
+	inline unsigned component(unsigned node) const throw() { return ma_components[node]; }
+	inline unsigned level(unsigned node) const throw() { return ma_levels[ma_components[node]]; }
+	inline unsigned dependency_count(unsigned node) const throw() { return ma_dependency_counts[ma_components[node]]; }
+	inline unsigned dependent_count(unsigned node) const throw() { return ma_dependent_counts[ma_components[node]]; }
+	
+	// the nodes with this path, or else all nodes with this file name.
+	std::vector<unsigned> find(const char* name) const;
+	// the nodes which node depends on (or which depend on node), directly or not, in increasing order.
+	std::vector<unsigned> transitive_dependencies(unsigned node) const;
+	std::vector<unsigned> transitive_dependents(unsigned node) const;
+	
+	void write_pajek(std::FILE* f) const;
+	void write_csv(std::FILE* f) const;
+	// the paths and the arcs only. Everything else is recomputed when the graph is read back.
+	bool write_binary(std::FILE* f) const;
+};
+
+#endif
@@ -23,84 +23,305 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // Yes, you'll need Windows for Pajek.
 
 #include "MachO_File.h"
+#include "ImageCache.h"
+#include "Threading.h"
+#include "DependencyGraph.h"
+#include "DirectoryScanner.h"
 #include <utility>
 #include <cstdio>
+#include <cstdlib>
 #include <tr1/unordered_map>
 #include <cstring>
+#include <algorithm>
+#include <getopt.h>
+#include <unistd.h>
 
 using namespace std;
 
-int main (int argc, const char* argv[]) {
-	if (argc >= 2 && strcmp(argv[1], "-h") == 0) {
-		fprintf(stderr, "Usage: dependency_graph [<sys-root>]\n\nIn the stdin, type in the list of executables you want to check.\n");
-	} else {
-		string sysroot = string((argc <= 1) ? "" : argv[1]);
-		
-		tr1::unordered_map<string, int> nodelist;
-		tr1::unordered_set<int> processedlist;
-		int nodes = 0;
-		vector<pair<int, int> > arclist;
+// Interns paths from many threads at once. Each shard has its own lock, so workers seldom wait for each other.
+// The IDs only identify a path; the final node numbers are assigned afterwards in input order.
+class ShardedInternTable {
+private:
+	static const unsigned ShardCount = 16;
+	
+	struct Shard {
+		Mutex mutex;
+		tr1::unordered_map<string, unsigned> ids;
+		vector<const string*> names;
+	};
+	
+	Shard ma_shards[ShardCount];
+
+public:
+	unsigned intern(const string& name) {
+		unsigned shard_index = static_cast<unsigned>(tr1::hash<string>()(name) % ShardCount);
+		Shard& shard = ma_shards[shard_index];
 		
-		while (!feof(stdin)) {
-			char filename_buffer[2048];
-			fgets(filename_buffer, 2048, stdin);
-			size_t filename_length = strlen(filename_buffer);
-			if (filename_buffer[filename_length-1] == '\n')
-				filename_buffer[filename_length-1] = '\0';
-			
-			string filename = string(filename_buffer);
-			tr1::unordered_map<string, int>::const_iterator cit = nodelist.find(filename);
-			
-			bool need_insert_nodelist = false;
-			int current_node_id = nodes;
-			
-			if (cit != nodelist.end()) {
-				if (processedlist.find(cit->second) != processedlist.end())
-					continue;
-				else
-					current_node_id = cit->second;
-			} else
-				need_insert_nodelist = true;
-			
+		ScopedLock lock (shard.mutex);
+		unsigned id = static_cast<unsigned>(shard.names.size()) * ShardCount + shard_index;
+		pair<tr1::unordered_map<string, unsigned>::iterator, bool> res = shard.ids.insert(pair<string, unsigned>(name, id));
+		if (res.second)
+			shard.names.push_back(&res.first->first);
+		return res.first->second;
+	}
+	
+	// only call after all threads are done.
+	inline const string& name(unsigned id) const throw() { return *ma_shards[id % ShardCount].names[id / ShardCount]; }
+};
 
-			try {
-				MachO_File_Simple file = MachO_File_Simple(filename_buffer);
-			
-				if (!file.valid())
-					fprintf(stderr, "Warning: %s is not a valid Mach-O file. Ignoring it.\n", filename_buffer);
-				else {
-					processedlist.insert(current_node_id);
-					if (need_insert_nodelist)
-						nodelist.insert(pair<string,int>(filename, current_node_id));
-					++nodes;
-					
-					vector<string> links = file.linked_libraries(sysroot);
-					for (vector<string>::const_iterator cit2 = links.begin(); cit2 != links.end(); ++ cit2) {
-						tr1::unordered_map<string, int>::const_iterator cit3 = nodelist.find(*cit2);
-						int other_node_id = nodes;
-						if (cit3 == nodelist.end()) {
-							nodelist.insert(pair<string,int>(*cit2, other_node_id));
-							++nodes;
-						} else
-							other_node_id = cit3->second;
-						arclist.push_back(pair<int,int>(current_node_id, other_node_id));
-					}
-				}
-			} catch (const TRException& e) {
-				fprintf(stderr, "A TRException was thrown for '%s'.\n", e.what());
+#pragma mark -
+
+enum InputStatus {
+	IS_Pending,
+	IS_NotMachO,
+	IS_Invalid,
+	IS_Failed,
+	IS_Valid
+};
+
+struct InputFile {
+	string path;
+	InputStatus status;
+	string error;
+	unsigned self;
+	vector<unsigned> links;
+};
+
+struct GraphBuilder {
+	string sysroot;
+	bool sniff_magic;
+	vector<InputFile> inputs;
+	ShardedInternTable names;
+};
+
+static void parse_input(void* context, size_t index) {
+	GraphBuilder* builder = static_cast<GraphBuilder*>(context);
+	InputFile& input = builder->inputs[index];
+	
+	if (builder->sniff_magic && !has_macho_magic(input.path.c_str())) {
+		input.status = IS_NotMachO;
+		return;
+	}
+	
+	try {
+		ImageHandle<MachO_File_Simple> file = ImageCache::shared().open<MachO_File_Simple>(input.path.c_str(), "any", "MachO_File_Simple");
+		if (!file->valid())
+			input.status = IS_Invalid;
+		else {
+			input.self = builder->names.intern(input.path);
+			vector<string> links = file->linked_libraries(builder->sysroot);
+			input.links.reserve(links.size());
+			for (vector<string>::const_iterator cit = links.begin(); cit != links.end(); ++ cit)
+				input.links.push_back(builder->names.intern(*cit));
+			input.status = IS_Valid;
+		}
+	} catch (const exception& e) {
+		// parallel_for jobs must not throw, so bad_alloc from a broken file fails only that file too.
+		input.error = e.what();
+		input.status = IS_Failed;
+	} catch (...) {
+		input.error = "Unknown exception.";
+		input.status = IS_Failed;
+	}
+}
+
+static void add_inputs(const vector<string>& paths, vector<InputFile>& inputs) {
+	inputs.reserve(inputs.size() + paths.size());
+	for (vector<string>::const_iterator cit = paths.begin(); cit != paths.end(); ++ cit) {
+		InputFile input;
+		input.path = *cit;
+		input.status = IS_Pending;
+		inputs.push_back(input);
+	}
+}
+
+// number the nodes in input order, so the result is the same for any number of threads.
+static DependencyGraph* build_graph(const GraphBuilder& builder) {
+	tr1::unordered_map<unsigned, unsigned> node_ids;
+	vector<unsigned> nodelist;
+	vector<bool> processedlist;
+	vector<pair<unsigned, unsigned> > arclist;
+	
+	for (vector<InputFile>::const_iterator iit = builder.inputs.begin(); iit != builder.inputs.end(); ++ iit) {
+		switch (iit->status) {
+			case IS_Failed:
+				fprintf(stderr, "An exception was thrown for '%s': %s\n", iit->path.c_str(), iit->error.c_str());
 				continue;
+			case IS_Invalid:
+				fprintf(stderr, "Warning: %s is not a valid Mach-O file. Ignoring it.\n", iit->path.c_str());
+				continue;
+			case IS_Valid:
+				break;
+			default:
+				continue;
+		}
+		
+		pair<tr1::unordered_map<unsigned, unsigned>::iterator, bool> res = node_ids.insert(pair<unsigned, unsigned>(iit->self, static_cast<unsigned>(nodelist.size())));
+		unsigned current_node_id = res.first->second;
+		if (res.second) {
+			nodelist.push_back(iit->self);
+			processedlist.push_back(false);
+		}
+		if (processedlist[current_node_id])
+			continue;
+		processedlist[current_node_id] = true;
+		
+		for (vector<unsigned>::const_iterator cit = iit->links.begin(); cit != iit->links.end(); ++ cit) {
+			pair<tr1::unordered_map<unsigned, unsigned>::iterator, bool> link_res = node_ids.insert(pair<unsigned, unsigned>(*cit, static_cast<unsigned>(nodelist.size())));
+			if (link_res.second) {
+				nodelist.push_back(*cit);
+				processedlist.push_back(false);
 			}
-			
+			arclist.push_back(pair<unsigned, unsigned>(current_node_id, link_res.first->second));
 		}
+	}
+	
+	vector<string> paths;
+	paths.reserve(nodelist.size());
+	for (vector<unsigned>::const_iterator cit = nodelist.begin(); cit != nodelist.end(); ++ cit)
+		paths.push_back(builder.names.name(*cit));
+	return new DependencyGraph(paths, arclist);
+}
+
+static void print_query(const DependencyGraph& graph, char query, const char* name) {
+	vector<unsigned> nodes = graph.find(name);
+	if (nodes.empty())
+		fprintf(stderr, "Warning: %s is not in the graph.\n", name);
 		
-		printf("*NETWORK Dependency graph.\r\n");
-		printf("*VERTICES %d\r\n", nodes);
-		for (tr1::unordered_map<string, int>::const_iterator cit = nodelist.begin(); cit != nodelist.end(); ++ cit)
-			printf(" %d \"%s\" # %s\r\n", cit->second+1, strrchr(cit->first.c_str(), '/')+1, cit->first.c_str());
-		printf("*ARCS\r\n");
-		for (vector<pair<int, int> >::const_iterator cit = arclist.begin(); cit != arclist.end(); ++ cit)
-			printf(" %d %d 1\r\n", cit->first+1, cit->second+1);
+	for (vector<unsigned>::const_iterator nit = nodes.begin(); nit != nodes.end(); ++ nit) {
+		unsigned node = *nit;
+		switch (query) {
+			case 'L':
+				printf("%s: level %u, component %u, fan-in %u, fan-out %u, %u dependencies, %u dependents\n", graph.path(node).c_str(), graph.level(node), graph.component(node), graph.fan_in(node), graph.fan_out(node), graph.dependency_count(node), graph.dependent_count(node));
+				break;
+			case 'D':
+			case 'R': {
+				vector<unsigned> result = query == 'D' ? graph.transitive_dependencies(node) : graph.transitive_dependents(node);
+				printf("# %s of %s (%u):\n", query == 'D' ? "Dependencies" : "Dependents", graph.path(node).c_str(), static_cast<unsigned>(result.size()));
+				for (vector<unsigned>::const_iterator cit = result.begin(); cit != result.end(); ++ cit)
+					printf("%s\n", graph.path(*cit).c_str());
+				break;
+			}
+		}
+	}
+}
+
+static void print_usage() {
+	fprintf(stderr,
+			"Usage: dependency_graph [<options>] [<sys-root>]\n"
+			"\n"
+			"  -j <threads>  Parse the files on this many threads. Defaults to the number of processors.\n"
+			"  -d <root>     Scan <root> recursively for Mach-O files. May be repeated.\n"
+			"  -i <file>     Read a graph written by -F binary instead of parsing any Mach-O file.\n"
+			"  -F <format>   Output format: pajek (default), csv (with the per-node analysis) or binary.\n"
+			"  -o <file>     Write the output to this file instead of the stdout.\n"
+			"  -D <name>     Print everything <name> depends on, directly or not.\n"
+			"  -R <name>     Print everything which depends on <name>, directly or not.\n"
+			"  -L <name>     Print the level (load-order depth), fan-in and fan-out of <name>.\n"
+			"\n"
+			"<name> is a path, or the file name of a node. With -D, -R or -L, the graph itself is not printed.\n"
+			"Without -d or -i, type in the list of executables you want to check in the stdin.\n");
+}
+
+int main (int argc, char* argv[]) {
+	unsigned thread_count = processor_count();
+	vector<const char*> roots;
+	vector<pair<char, const char*> > queries;
+	const char* input_graph = NULL, *output_filename = NULL, *format = "pajek";
+	int c;
+	while ((c = getopt(argc, argv, "j:d:i:F:o:D:R:L:h")) != -1) {
+		switch (c) {
+			case 'j':
+				thread_count = static_cast<unsigned>(strtoul(optarg, NULL, 10));
+				if (thread_count == 0)
+					thread_count = processor_count();
+				break;
+			case 'd':
+				roots.push_back(optarg);
+				break;
+			case 'i':
+				input_graph = optarg;
+				break;
+			case 'F':
+				format = optarg;
+				break;
+			case 'o':
+				output_filename = optarg;
+				break;
+			case 'D':
+			case 'R':
+			case 'L':
+				queries.push_back(pair<char, const char*>(static_cast<char>(c), optarg));
+				break;
+			default:
+				print_usage();
+				return 0;
+		}
+	}
+	
+	if (strcmp(format, "pajek") != 0 && strcmp(format, "csv") != 0 && strcmp(format, "binary") != 0) {
+		print_usage();
+		return 1;
+	}
+	
+	DependencyGraph* graph = NULL;
+	if (input_graph != NULL) {
+		try {
+			graph = new DependencyGraph(input_graph);
+		} catch (const TRException& e) {
+			fprintf(stderr, "%s\n", e.what());
+			return 1;
+		}
+	} else {
+		GraphBuilder builder;
+		builder.sysroot = string((optind >= argc) ? "" : argv[optind]);
+		// linked libraries are sysroot + absolute path, so a trailing slash would make them differ from the scanned paths.
+		while (!builder.sysroot.empty() && builder.sysroot[builder.sysroot.size()-1] == '/')
+			builder.sysroot.erase(builder.sysroot.size()-1);
+		builder.sniff_magic = !roots.empty();
+		
+		vector<string> paths;
+		if (roots.empty())
+			read_path_list(stdin, paths);
+		else
+			for (vector<const char*>::const_iterator cit = roots.begin(); cit != roots.end(); ++ cit)
+				scan_directory(*cit, paths);
+		add_inputs(paths, builder.inputs);
+				
+		// every input is opened once, so there is no point keeping unused images mapped.
+		ImageCache::shared().set_byte_limit(0);
+		parallel_for(thread_count, builder.inputs.size(), parse_input, &builder);
+		graph = build_graph(builder);
+	}
+	
+	if (!queries.empty()) {
+		for (vector<pair<char, const char*> >::const_iterator cit = queries.begin(); cit != queries.end(); ++ cit)
+			print_query(*graph, cit->first, cit->second);
+	} else {
+		FILE* f = output_filename != NULL ? fopen(output_filename, format[0] == 'b' ? "wb" : "w") : stdout;
+		if (f == NULL) {
+			perror("Cannot open the output file. ");
+			delete graph;
+			return 1;
+		}
+		
+		bool ok = true;
+		if (format[0] == 'p')
+			graph->write_pajek(f);
+		else if (format[0] == 'c')
+			graph->write_csv(f);
+		else
+			ok = graph->write_binary(f);
+			
+		if (f != stdout && fclose(f) != 0)
+			ok = false;
+		if (!ok) {
+			fprintf(stderr, "Cannot write the graph.\n");
+			delete graph;
+			return 1;
+		}
 	}
 	
+	delete graph;
 	return 0;
-}
\ No newline at end of file
+}
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "AbstractARMDumbDisassembler.h"
+#include "ControlFlowGraph.h"
 
 static const char* const regNames[] = {"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "sl", "fp", "ip", "sp", "lr", "pc"};
 const char* AbstractARMDumbDisassembler::register_name(unsigned i) throw() { return regNames[i]; }
@@ -88,94 +89,151 @@ void AbstractARMDumbDisassembler::ldmia (unsigned Rd, unsigned reglist) throw()
 	r[Rd] = index*4;
 }
 
-static char RegListScratchMemory[4*16+1];
 const char* AbstractARMDumbDisassembler::compute_reg_list (unsigned list) throw() {
 	int index = 1;
 	bool printed_something = false;
-	RegListScratchMemory[0] = '{';
+	m_reg_list_buffer[0] = '{';
 	for (unsigned i = 0; i < 16; ++ i) {
 		if (list & (1<<i)) {
 			if (printed_something) {
-				RegListScratchMemory[index++] = ',';
-				RegListScratchMemory[index++] = ' ';
+				m_reg_list_buffer[index++] = ',';
+				m_reg_list_buffer[index++] = ' ';
 			} else
 				printed_something = 1;
 			
 			const char* name = register_name(i);
-			RegListScratchMemory[index++] = name[0];
-			RegListScratchMemory[index++] = name[1];
+			m_reg_list_buffer[index++] = name[0];
+			m_reg_list_buffer[index++] = name[1];
 		}
 	}
-	RegListScratchMemory[index++] = '}';
-	RegListScratchMemory[index++] = '\0';
-	return RegListScratchMemory;
+	m_reg_list_buffer[index++] = '}';
+	m_reg_list_buffer[index++] = '\0';
+	return m_reg_list_buffer;
 }
 
-AbstractARMDumbDisassembler::AbstractARMDumbDisassembler(MachO_File& file, FILE* stream) : m_file(file), m_text_segment_index(file.segment_index_having_name("__TEXT")), m_data_segment_index(file.segment_index_having_name("__DATA")), m_stream(stream) {
+AbstractARMDumbDisassembler::AbstractARMDumbDisassembler(MachO_File& file, FILE* stream) : m_file(file), m_text_segment_index(file.segment_index_having_name("__TEXT")), m_data_segment_index(file.segment_index_having_name("__DATA")), m_deref_guess_segment(0), m_output(stream), m_location(0), m_emulate_only(false), ma_references(NULL), mp_cfg(NULL) {
+	this->initialize();
+}
+
+AbstractARMDumbDisassembler::AbstractARMDumbDisassembler(MachO_File& file, string& output) : m_file(file), m_text_segment_index(file.segment_index_having_name("__TEXT")), m_data_segment_index(file.segment_index_having_name("__DATA")), m_deref_guess_segment(0), m_output(output), m_location(0), m_emulate_only(false), ma_references(NULL), mp_cfg(NULL) {
+	this->initialize();
+}
+
+void AbstractARMDumbDisassembler::initialize() throw() {
+	// start from a known state, so that the output does not depend on what was on the C stack.
+	std::memset(r, 0, sizeof(r));
+	std::memset(stack, 0, sizeof(stack));
+	sp = StackSize-64;
+	
 	if (m_text_segment_index == -1) m_text_segment_index = 0;
 	if (m_data_segment_index == -1) m_data_segment_index = 0;
 }
 
-void AbstractARMDumbDisassembler::print_references(unsigned vm_address, unsigned depth) const throw() {
+void AbstractARMDumbDisassembler::save_state(EmulationState& state) const throw() {
+	std::memcpy(state.r, r, sizeof(r));
+	std::memcpy(state.stack, stack, sizeof(stack));
+}
+
+void AbstractARMDumbDisassembler::restore_state(const EmulationState& state) throw() {
+	std::memcpy(r, state.r, sizeof(r));
+	std::memcpy(stack, state.stack, sizeof(stack));
+}
+
 #define MAX_DEPTH 8
+
+void AbstractARMDumbDisassembler::print_references(unsigned vm_address, unsigned depth) const throw() {
 	if (vm_address == 0)
 		return;
 	
 	if (vm_address/4 < StackSize) {
 		if (vm_address >= sp) {
-			fprintf(m_stream, "sp+%d -> ", vm_address-sp);
+			m_output.write("sp+");
+			m_output.write_decimal(static_cast<int>(vm_address-sp));
+			m_output.write(" -> ");
 			if (depth < MAX_DEPTH)
 				this->print_references(stack[vm_address/4], depth+1);
 			else
-				fprintf(m_stream, "...");
+				m_output.write("...");
 		} else 
-			fprintf(m_stream, "?");
+			m_output.put('?');
 	} else {
 		MachO_File::StringType strtype;
 		const char* str_rep = m_file.string_representation(vm_address, &strtype);
 		if (str_rep != NULL) {
-			MachO_File::print_string_representation(m_stream, str_rep, strtype);
+			MachO_File::print_string_representation(m_output, str_rep, strtype);
 			return;
 		}
 		
 		unsigned deref = this->dereference(vm_address);
 		if (deref != 0) {
-			fprintf(m_stream, "&0x%x -> ", deref);
+			m_output.write("&0x");
+			m_output.write_hex(deref);
+			m_output.write(" -> ");
 			if (depth < MAX_DEPTH)
 				this->print_references(deref, depth+1);
 			else
-				fprintf(m_stream, "...");
+				m_output.write("...");
 		} else 
-			fprintf(m_stream, "?");
+			m_output.put('?');
+	}
+}
+
+void AbstractARMDumbDisassembler::record_reference(unsigned from, unsigned R) {
+	for (unsigned depth = 0; depth <= MAX_DEPTH && R != 0; ++ depth) {
+		if (R/4 < StackSize) {
+			if (R < sp)
+				return;
+			R = stack[R/4];
+		} else {
+			MachO_File::StringType strtype;
+			if (m_file.string_representation(R, &strtype) != NULL) {
+				XrefIndex::Reference reference = {from, R, strtype};
+				ma_references->push_back(reference);
+				return;
+			}
+			R = this->dereference(R);
+		}
 	}
-#undef MAX_DEPTH
 }
 
 void AbstractARMDumbDisassembler::disassemble_in_range(unsigned start_at, size_t range_bytes) {
 	int guess_index = m_text_segment_index;
-	m_file.seek_vm_address(start_at, &guess_index);
-	
-	off_t cur_file_offset = m_file.tell();
+	off_t cur_file_offset = m_file.to_file_offset(start_at, &guess_index);
 	
 	size_t bytes_scanned = 0;
 	unsigned cur_address = start_at;
 	
-	sp = StackSize-64;
-	
 	while (bytes_scanned < range_bytes) {
-		m_file.seek(cur_file_offset);
+		m_location = cur_file_offset;
 		
-		if (m_file.valid()) {
+		if (m_file.valid() && !m_emulate_only) {
 			const char* cursymbol = m_file.string_representation(cur_address);
 			if (cursymbol != NULL) {
-				fprintf(m_stream, "\n ;\n ; %s:\n", cursymbol);
+				m_output.write("\n ;\n ; ");
+				m_output.write(cursymbol);
+				m_output.write(":\n");
 				if (m_file.is_extern_symbol(cur_address))
-					fprintf(m_stream, " ; <extern>\n");
-				fprintf(m_stream, " ;\n");
+					m_output.write(" ; <extern>\n");
+				m_output.write(" ;\n");
 			} else {
 				const MachO_File::ObjCMethod* curmethod = m_file.objc_method_at_vm_address(cur_address);
-				if (curmethod != NULL)
-					fprintf(m_stream, "\n ;\n ; ?[%s %s]:\n ;\n", curmethod->class_name, curmethod->sel_name);
+				if (curmethod != NULL) {
+					m_output.write("\n ;\n ; ?[");
+					m_output.write(curmethod->class_name);
+					m_output.put(' ');
+					m_output.write(curmethod->sel_name);
+					m_output.write("]:\n ;\n");
+				} else if (mp_cfg != NULL) {
+					if (mp_cfg->function_at(cur_address) != NULL) {
+						m_output.write("\n ;\n ; sub_");
+						m_output.write_hex(cur_address);
+						m_output.write(":\n ;\n");
+					} else if (mp_cfg->block_at(cur_address) != NULL) {
+						m_output.write(" ; loc_");
+						m_output.write_hex(cur_address);
+						m_output.write(":\n");
+					}
+				}
 			}
 		}
 		
@@ -185,6 +243,9 @@ void AbstractARMDumbDisassembler::disassemble_in_range(unsigned start_at, size_t
 		cur_address += this_bytes;
 		bytes_scanned += this_bytes;
 		
-		fprintf(m_stream, "\n");
+		if (!m_emulate_only)
+			m_output.put('\n');
 	}
+	
+	m_output.flush();
 }
\ No newline at end of file
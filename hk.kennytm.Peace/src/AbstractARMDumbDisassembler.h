@@ -23,7 +23,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define ABSTRACTARMDUMBDISASSEMBLER_H
 
 #include "MachO_File.h"
+#include "XrefIndex.h"
+#include "OutputWriter.h"
 #include <cstdio>
+#include <cstring>
+#include <vector>
+
+class ControlFlowGraph;
 
 class AbstractARMDumbDisassembler {
 protected:
@@ -35,12 +41,36 @@ protected:
 	
 	MachO_File& m_file;
 	int m_text_segment_index, m_data_segment_index;
-	std::FILE* m_stream;
+	mutable int m_deref_guess_segment;
+	// print_raw_instruction() and print_references() are const, but they still write.
+	mutable OutputWriter m_output;
+	
+	// the file offset of the next instruction. It is kept here instead of as the cursor of m_file,
+	// so that several disassemblers can work on the same (prepared) file concurrently.
+	off_t m_location;
+	
+	// only track the registers and the stack, without printing anything.
+	bool m_emulate_only;
+	
+	// where the references found by record_reference() go, or NULL if they are not collected.
+	std::vector<XrefIndex::Reference>* ma_references;
+	
+	// if set, functions and basic blocks without symbols are labeled in the output.
+	const ControlFlowGraph* mp_cfg;
+	
+	char m_reg_list_buffer[4*16+1];
+	
+	inline unsigned read_integer() throw() {
+		unsigned res;
+		std::memcpy(&res, m_file.data() + m_location, sizeof(unsigned));
+		m_location += sizeof(unsigned);
+		return res;
+	}
 	
 	// some convenient functions....
 	static inline unsigned ror (unsigned value, int shift) throw() { shift &= 31; return (value >> shift) | (value << (32 - shift)); }
 	
-	inline unsigned dereference (unsigned R) const throw() { return (R < StackSize) ? stack[R/sizeof(unsigned)] : m_file.dereference(R); }
+	inline unsigned dereference (unsigned R) const throw() { return (R < StackSize) ? stack[R/sizeof(unsigned)] : m_file.dereference(R, &m_deref_guess_segment); }
 	
 	void store_reference (unsigned R, unsigned value, unsigned mask = ~0) throw();
 	void load_reference (unsigned R, unsigned Rd, unsigned mask = ~0, bool isSigned = false) throw();
@@ -49,10 +79,30 @@ protected:
 	void stmia (unsigned Rd, unsigned reglist) throw();
 	void ldmia (unsigned Rd, unsigned reglist) throw();
 	
-	static const char* compute_reg_list (unsigned list) throw();
+	// follow R the same way print_references() does, and collect the first address with a string representation.
+	void record_reference (unsigned from, unsigned R);
+	
+	const char* compute_reg_list (unsigned list) throw();
+	
+private:
+	void initialize() throw();
 	
 public:
+	// the registers and the emulated stack, carried from one instruction to the next.
+	struct EmulationState {
+		unsigned r[16];
+		unsigned stack[StackSize];
+	};
+	
 	AbstractARMDumbDisassembler(MachO_File& file, std::FILE* stream = stdout);
+	// print into a string instead of a stream.
+	AbstractARMDumbDisassembler(MachO_File& file, std::string& output);
+	
+	void save_state(EmulationState& state) const throw();
+	void restore_state(const EmulationState& state) throw();
+	inline void set_emulate_only(bool emulate_only) throw() { m_emulate_only = emulate_only; }
+	inline void set_reference_collector(std::vector<XrefIndex::Reference>* references) throw() { ma_references = references; }
+	inline void set_control_flow_graph(const ControlFlowGraph* cfg) throw() { mp_cfg = cfg; }
 	
 	virtual void print_raw_instruction(unsigned vm_address, unsigned instruction, const char* decoded, bool hasR = false, unsigned R = 0) const = 0;
 	
@@ -63,6 +113,8 @@ public:
 	virtual unsigned disassemble_at(unsigned current_vm_address) = 0;
 	
 	// note: these are vm_addresses.
+	// The emulation state continues from the previous call, so a range can be disassembled in several pieces.
+	// All output is in the stream when this returns.
 	void disassemble_in_range(unsigned start_at, size_t range_bytes);
 	
 	static const char* register_name(unsigned i) throw();
@@ -0,0 +1,216 @@
+/*
+
+AnalysisCache.cpp ... On-disk cache of analysis results
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "AnalysisCache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "snprintf.h"
+
+using namespace std;
+
+struct AnalysisCacheHeader {
+	char magic[8];
+	unsigned version;
+	unsigned key_size;
+	unsigned body_words;
+	unsigned strings_size;
+	unsigned checksum;
+};
+
+static const char cache_magic[8] = {'P', 'e', 'a', 'c', 'e', 'C', 'c', 'h'};
+
+static inline unsigned padded_size(unsigned size) throw() { return (size + 3) & ~3u; }
+
+static unsigned checksum_of(const void* data, size_t size, unsigned h = 2166136261u) throw() {
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++ i) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+#pragma mark -
+
+static string cache_directory;
+static bool cache_directory_initialized = false;
+
+string AnalysisCache::absolute_path(const char* path) {
+#if _MSC_VER
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, path, _MAX_PATH) == NULL)
+		return string();
+#else
+	char resolved[PATH_MAX];
+	if (realpath(path, resolved) == NULL)
+		return string();
+#endif
+	return resolved;
+}
+
+bool AnalysisCache::set_directory(const char* path) {
+	cache_directory_initialized = true;
+	cache_directory.clear();
+	if (path == NULL || *path == '\0')
+		return true;
+	
+	// store the absolute path, as class-dump-z may chdir() into the output directory.
+	mkdir(path, 0755);
+	cache_directory = absolute_path(path);
+	return !cache_directory.empty();
+}
+
+const char* AnalysisCache::directory() {
+	if (!cache_directory_initialized)
+		set_directory(getenv("PEACE_CACHE_DIR"));
+	return cache_directory.empty() ? NULL : cache_directory.c_str();
+}
+
+string AnalysisCache::path_for_key(const string& key) {
+	char name[32];
+	snprintf(name, sizeof(name), "/%08x%08x.peacecache", checksum_of(key.data(), key.size()), checksum_of(key.data(), key.size(), 0x811c9dc6u));
+	return cache_directory + name;
+}
+
+#pragma mark -
+
+unsigned AnalysisCacheWriter::string_offset(const char* str, size_t length) {
+	string s (str, length);
+	tr1::unordered_map<string, unsigned>::const_iterator cit = ma_string_offsets.find(s);
+	if (cit != ma_string_offsets.end())
+		return cit->second;
+		
+	unsigned offset = static_cast<unsigned>(ma_strings.size());
+	ma_strings.insert(ma_strings.end(), str, str + length);
+	ma_strings.push_back('\0');
+	ma_string_offsets.insert(pair<string, unsigned>(s, offset));
+	return offset;
+}
+
+void AnalysisCacheWriter::write_string(const char* str) {
+	ma_body.push_back(str == NULL ? ~0u : this->string_offset(str, strlen(str)));
+}
+
+bool AnalysisCacheWriter::save(const string& key) const {
+	if (AnalysisCache::directory() == NULL)
+		return false;
+		
+	AnalysisCacheHeader header;
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = AnalysisCache::Version;
+	header.key_size = static_cast<unsigned>(key.size());
+	header.body_words = static_cast<unsigned>(ma_body.size());
+	header.strings_size = static_cast<unsigned>(ma_strings.size());
+	
+	string padded_key = key;
+	padded_key.resize(padded_size(header.key_size), '\0');
+	size_t body_size = ma_body.size() * sizeof(unsigned);
+	
+	header.checksum = checksum_of(padded_key.data(), padded_key.size());
+	if (body_size != 0)
+		header.checksum = checksum_of(&ma_body[0], body_size, header.checksum);
+	if (!ma_strings.empty())
+		header.checksum = checksum_of(&ma_strings[0], ma_strings.size(), header.checksum);
+		
+	AtomicFileWriter writer (AnalysisCache::path_for_key(key));
+	writer.write(&header, sizeof(header));
+	writer.write(padded_key.data(), padded_key.size());
+	if (body_size != 0)
+		writer.write(&ma_body[0], body_size);
+	if (!ma_strings.empty())
+		writer.write(&ma_strings[0], ma_strings.size());
+	return writer.commit();
+}
+
+#pragma mark -
+
+AnalysisCacheReader::AnalysisCacheReader(const string& key) : mp_file(NULL), m_cursor(NULL), m_body_end(NULL), ma_strings(NULL), m_strings_size(0), m_failed(false) {
+	if (AnalysisCache::directory() == NULL)
+		return;
+		
+	string path = AnalysisCache::path_for_key(key);
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(AnalysisCacheHeader))
+		return;
+		
+	try {
+		mp_file = new DataFile(path.c_str());
+	} catch (const TRException&) {
+		return;
+	}
+	
+	const AnalysisCacheHeader* header = mp_file->peek_data_at<AnalysisCacheHeader>(0);
+	const char* key_begin = mp_file->data() + sizeof(AnalysisCacheHeader);
+	size_t key_size = padded_size(static_cast<unsigned>(key.size()));
+	
+	bool ok = header != NULL && memcmp(header->magic, cache_magic, sizeof(cache_magic)) == 0 && header->version == AnalysisCache::Version;
+	ok = ok && header->key_size == key.size() && header->body_words < (1u << 30);
+	ok = ok && static_cast<off_t>(sizeof(AnalysisCacheHeader) + key_size) + static_cast<off_t>(header->body_words)*4 + static_cast<off_t>(header->strings_size) == mp_file->filesize();
+	ok = ok && memcmp(key_begin, key.data(), key.size()) == 0;
+	ok = ok && (header->strings_size == 0 || key_begin[key_size + header->body_words*sizeof(unsigned) + header->strings_size - 1] == '\0');
+	ok = ok && checksum_of(key_begin, static_cast<size_t>(mp_file->filesize()) - sizeof(AnalysisCacheHeader)) == header->checksum;
+	
+	if (!ok) {
+		delete mp_file;
+		mp_file = NULL;
+		return;
+	}
+	
+	m_cursor = reinterpret_cast<const unsigned*>(key_begin + key_size);
+	m_body_end = m_cursor + header->body_words;
+	ma_strings = reinterpret_cast<const char*>(m_body_end);
+	m_strings_size = header->strings_size;
+}
+
+AnalysisCacheReader::~AnalysisCacheReader() throw() {
+	delete mp_file;
+}
+
+unsigned AnalysisCacheReader::read_uint() throw() {
+	if (!valid() || m_cursor == m_body_end) {
+		m_failed = true;
+		return 0;
+	}
+	return *m_cursor++;
+}
+
+const char* AnalysisCacheReader::read_string() throw() {
+	unsigned offset = this->read_uint();
+	if (offset == ~0u)
+		return NULL;
+	if (offset >= m_strings_size) {
+		m_failed = true;
+		return NULL;
+	}
+	return ma_strings + offset;
+}
+
+void AnalysisCacheReader::read_string(string& str) throw() {
+	const char* s = this->read_string();
+	if (s != NULL)
+		str = s;
+	else
+		str.clear();
+}
@@ -0,0 +1,98 @@
+/*
+
+AnalysisCache.h ... On-disk cache of analysis results
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ANALYSISCACHE_H
+#define ANALYSISCACHE_H
+
+#include <vector>
+#include <string>
+#include <tr1/unordered_map>
+#include "DataFile.h"
+
+// Cache files live in one directory, named after a hash of their key. A file is laid out as
+//   AnalysisCacheHeader, key, body (a sequence of 32-bit words), string pool.
+// Strings in the body are offsets into the pool, so strings read back point into the mapped file
+// and stay valid as long as the reader.
+class AnalysisCache {
+public:
+	// bump this whenever the layout of anything written into a cache changes.
+	static const unsigned Version = 4;
+	
+	// the cache is disabled unless a directory is set, either here or by the PEACE_CACHE_DIR environment variable.
+	// Returns false if the directory cannot be created.
+	static bool set_directory(const char* path);
+	static const char* directory();
+	
+	static std::string path_for_key(const std::string& key);
+	// an empty string if the file does not exist.
+	static std::string absolute_path(const char* path);
+};
+
+class AnalysisCacheWriter {
+private:
+	std::vector<unsigned> ma_body;
+	std::vector<char> ma_strings;
+	std::tr1::unordered_map<std::string, unsigned> ma_string_offsets;
+	
+	unsigned string_offset(const char* str, std::size_t length);
+
+public:
+	inline void write_uint(unsigned value) { ma_body.push_back(value); }
+	// NULL is kept distinct from the empty string. Equal strings are stored once.
+	void write_string(const char* str);
+	inline void write_string(const std::string& str) { ma_body.push_back(this->string_offset(str.data(), str.size())); }
+	
+	// write to a temporary file, and then move it over the old one, so readers never see a partial file.
+	bool save(const std::string& key) const;
+};
+
+class AnalysisCacheReader {
+private:
+	DataFile* mp_file;
+	const unsigned* m_cursor;
+	const unsigned* m_body_end;
+	const char* ma_strings;
+	unsigned m_strings_size;
+	bool m_failed;
+	
+	AnalysisCacheReader(const AnalysisCacheReader&);
+	AnalysisCacheReader& operator=(const AnalysisCacheReader&);
+
+public:
+	// open the cache file of the key. The reader is invalid if the file is missing, was written for
+	// another key or version, or does not pass the checksum.
+	explicit AnalysisCacheReader(const std::string& key);
+	~AnalysisCacheReader() throw();
+	
+	inline bool valid() const throw() { return mp_file != NULL && !m_failed; }
+	// true if everything has been read without running out of data.
+	inline bool finished() const throw() { return valid() && m_cursor == m_body_end; }
+	
+	// reading past the end or reading an invalid string makes the reader invalid and returns 0/NULL.
+	unsigned read_uint() throw();
+	const char* read_string() throw();
+	void read_string(std::string& str) throw();
+	
+	// guard against absurd counts in a corrupted file before reserving memory.
+	inline bool can_read(unsigned words) const throw() { return valid() && static_cast<std::size_t>(m_body_end - m_cursor) >= words; }
+};
+
+#endif
@@ -0,0 +1,300 @@
+/*
+
+ControlFlowGraph.cpp ... Functions and basic blocks of Thumb code
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ControlFlowGraph.h"
+#include "MachO_File.h"
+#include "ThumbDumbDisassembler.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// flags of each halfword in the range.
+enum {
+	CF_Instruction = 1,		// an instruction starts here.
+	CF_Leader = 2,			// a basic block starts here.
+	CF_FunctionEntry = 4
+};
+
+namespace {
+	// the code in the range, and what has been found about each halfword.
+	class CodeMap {
+	private:
+		const char* m_code;
+		unsigned m_start, m_end;
+		size_t m_bytes_in_file;
+		
+	public:
+		vector<unsigned char> ma_flags;
+		
+		CodeMap(const MachO_File& file, unsigned start_vm, size_t range_bytes) : m_code(NULL), m_start(start_vm), m_end(start_vm), m_bytes_in_file(0) {
+			off_t offset = file.to_file_offset(start_vm);
+			if (offset == 0 || offset >= file.filesize())
+				return;
+			m_code = file.data() + offset;
+			m_bytes_in_file = static_cast<size_t>(file.filesize() - offset);
+			m_end = static_cast<unsigned>(start_vm + min(range_bytes, m_bytes_in_file));
+			ma_flags.resize((m_end - m_start) / 2);
+		}
+		
+		inline bool contains(unsigned vm_address) const throw() { return vm_address >= m_start && vm_address < m_end && !(vm_address & 1); }
+		inline unsigned char& flags_at(unsigned vm_address) throw() { return ma_flags[(vm_address - m_start) / 2]; }
+		inline unsigned address_of(size_t index) const throw() { return m_start + static_cast<unsigned>(index * 2); }
+		
+		// read the 32-bit word at vm_address, or the last halfword of the file.
+		unsigned fetch(unsigned vm_address) const throw() {
+			size_t offset = vm_address - m_start;
+			unsigned instruction = 0;
+			memcpy(&instruction, m_code + offset, min<size_t>(4, m_bytes_in_file - offset));
+			return instruction;
+		}
+	};
+	
+	struct SeedCollector {
+		CodeMap* code;
+		vector<unsigned>* worklist;
+	};
+}
+
+// symbols and ObjC method implementations in the range start functions.
+static void collect_function_seed(unsigned addr, const char*, MachO_File::StringType type, void* context) {
+	SeedCollector* collector = static_cast<SeedCollector*>(context);
+	if ((type == MachO_File::MOST_Symbol || type == MachO_File::MOST_ObjCMethod) && collector->code->contains(addr)) {
+		unsigned char& flags = collector->code->flags_at(addr);
+		if (!(flags & CF_FunctionEntry)) {
+			flags |= CF_FunctionEntry | CF_Leader;
+			collector->worklist->push_back(addr);
+		}
+	}
+}
+
+static inline void add_leader(CodeMap& code, vector<unsigned>& worklist, unsigned vm_address) {
+	if (code.contains(vm_address)) {
+		code.flags_at(vm_address) |= CF_Leader;
+		worklist.push_back(vm_address);
+	}
+}
+
+static inline bool is_terminator(ThumbDumbDisassembler::FlowType type) throw() {
+	switch (type) {
+		case ThumbDumbDisassembler::FT_ConditionalBranch:
+		case ThumbDumbDisassembler::FT_Branch:
+		case ThumbDumbDisassembler::FT_Return:
+		case ThumbDumbDisassembler::FT_IndirectBranch:
+		case ThumbDumbDisassembler::FT_Stop:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool block_start_less(const ControlFlowGraph::BasicBlock& block, unsigned vm_address) throw() { return block.start < vm_address; }
+static bool block_start_greater(unsigned vm_address, const ControlFlowGraph::BasicBlock& block) throw() { return vm_address < block.start; }
+static bool function_entry_less(const ControlFlowGraph::Function& function, unsigned vm_address) throw() { return function.entry < vm_address; }
+
+#pragma mark -
+
+ControlFlowGraph::ControlFlowGraph(const MachO_File& file, unsigned start_vm, size_t range_bytes) {
+	CodeMap code (file, start_vm, range_bytes);
+	if (code.ma_flags.empty())
+		return;
+		
+	vector<unsigned> function_worklist, block_worklist;
+	SeedCollector collector = {&code, &function_worklist};
+	file.for_each_symbol(&collect_function_seed, &collector);
+	// the range itself is assumed to start with a function.
+	collect_function_seed(start_vm, NULL, MachO_File::MOST_Symbol, &collector);
+	
+	// find all reachable instructions and where the basic blocks start. bl targets are new functions.
+	while (!function_worklist.empty()) {
+		block_worklist.push_back(function_worklist.back());
+		function_worklist.pop_back();
+		
+		while (!block_worklist.empty()) {
+			unsigned vm_address = block_worklist.back();
+			block_worklist.pop_back();
+			
+			while (code.contains(vm_address)) {
+				unsigned char& flags = code.flags_at(vm_address);
+				if (flags & CF_Instruction) {
+					// joined code which has been seen already.
+					flags |= CF_Leader;
+					break;
+				}
+				flags |= CF_Instruction;
+				
+				unsigned length, target;
+				ThumbDumbDisassembler::FlowType type = ThumbDumbDisassembler::control_flow(vm_address, code.fetch(vm_address), &length, &target);
+				if (type == ThumbDumbDisassembler::FT_Call && target != 0)
+					collect_function_seed(target, NULL, MachO_File::MOST_Symbol, &collector);
+					
+				if (type == ThumbDumbDisassembler::FT_ConditionalBranch)
+					add_leader(code, block_worklist, vm_address + length);
+				if (type == ThumbDumbDisassembler::FT_ConditionalBranch || type == ThumbDumbDisassembler::FT_Branch)
+					add_leader(code, block_worklist, target);
+				if (is_terminator(type))
+					break;
+					
+				vm_address += length;
+			}
+		}
+	}
+	
+	// cut the instructions into blocks. The successors are kept as addresses until all blocks are known.
+	vector<unsigned> entries;
+	for (size_t i = 0; i < code.ma_flags.size(); ++ i) {
+		if ((code.ma_flags[i] & (CF_Instruction|CF_Leader)) != (CF_Instruction|CF_Leader))
+			continue;
+			
+		BasicBlock block;
+		block.start = code.address_of(i);
+		block.function = ~0u;
+		block.first_successor = static_cast<unsigned>(ma_successors.size());
+		if (code.ma_flags[i] & CF_FunctionEntry)
+			entries.push_back(block.start);
+			
+		unsigned vm_address = block.start;
+		while (true) {
+			unsigned length, target;
+			ThumbDumbDisassembler::FlowType type = ThumbDumbDisassembler::control_flow(vm_address, code.fetch(vm_address), &length, &target);
+			vm_address += length;
+			
+			if (is_terminator(type)) {
+				if (type == ThumbDumbDisassembler::FT_ConditionalBranch && code.contains(vm_address))
+					ma_successors.push_back(vm_address);
+				if ((type == ThumbDumbDisassembler::FT_ConditionalBranch || type == ThumbDumbDisassembler::FT_Branch) && code.contains(target))
+					ma_successors.push_back(target);
+				break;
+			}
+			if (!code.contains(vm_address) || !(code.flags_at(vm_address) & CF_Instruction))
+				break;
+			if (code.flags_at(vm_address) & CF_Leader) {
+				ma_successors.push_back(vm_address);
+				break;
+			}
+		}
+		
+		block.end = vm_address;
+		block.successor_count = static_cast<unsigned>(ma_successors.size()) - block.first_successor;
+		ma_blocks.push_back(block);
+	}
+	
+	for (vector<unsigned>::iterator it = ma_successors.begin(); it != ma_successors.end(); ++ it)
+		*it = static_cast<unsigned>(this->block_at(*it) - &ma_blocks[0]);
+		
+	this->assign_functions(entries);
+}
+
+// a block belongs to the first function (by address) reaching it without going through another function's entry.
+void ControlFlowGraph::assign_functions(const vector<unsigned>& entries) {
+	vector<unsigned> worklist;
+	for (vector<unsigned>::const_iterator cit = entries.begin(); cit != entries.end(); ++ cit) {
+		unsigned function_index = static_cast<unsigned>(ma_functions.size());
+		Function function;
+		function.entry = *cit;
+		function.end = *cit;
+		function.first_block = 0;
+		function.block_count = 0;
+		ma_functions.push_back(function);
+		
+		unsigned entry_block = static_cast<unsigned>(this->block_at(*cit) - &ma_blocks[0]);
+		if (ma_blocks[entry_block].function != ~0u)
+			continue;
+		ma_blocks[entry_block].function = function_index;
+		worklist.push_back(entry_block);
+		
+		while (!worklist.empty()) {
+			const BasicBlock& block = ma_blocks[worklist.back()];
+			worklist.pop_back();
+			
+			pair<const unsigned*, const unsigned*> successors = this->successors_of(block);
+			for (const unsigned* succ = successors.first; succ != successors.second; ++ succ) {
+				BasicBlock& successor = ma_blocks[*succ];
+				if (successor.function == ~0u && !binary_search(entries.begin(), entries.end(), successor.start)) {
+					successor.function = function_index;
+					worklist.push_back(*succ);
+				}
+			}
+		}
+	}
+	
+	// code only reachable through an overlapping instruction is given to the function before it.
+	unsigned last_function = 0;
+	for (vector<BasicBlock>::iterator it = ma_blocks.begin(); it != ma_blocks.end(); ++ it) {
+		if (it->function == ~0u)
+			it->function = last_function;
+		last_function = it->function;
+	}
+	
+	// group the blocks by function. The blocks are sorted by address, so they stay sorted within each function.
+	for (vector<BasicBlock>::const_iterator cit = ma_blocks.begin(); cit != ma_blocks.end(); ++ cit) {
+		Function& function = ma_functions[cit->function];
+		++ function.block_count;
+		if (cit->end > function.end)
+			function.end = cit->end;
+	}
+	unsigned first_block = 0;
+	for (vector<Function>::iterator it = ma_functions.begin(); it != ma_functions.end(); ++ it) {
+		it->first_block = first_block;
+		first_block += it->block_count;
+	}
+	ma_function_blocks.resize(ma_blocks.size());
+	vector<unsigned> filled (ma_functions.size());
+	for (unsigned i = 0; i < ma_blocks.size(); ++ i) {
+		unsigned function_index = ma_blocks[i].function;
+		ma_function_blocks[ma_functions[function_index].first_block + filled[function_index]++] = i;
+	}
+}
+
+#pragma mark -
+
+const ControlFlowGraph::BasicBlock* ControlFlowGraph::block_at(unsigned vm_address) const throw() {
+	vector<BasicBlock>::const_iterator cit = lower_bound(ma_blocks.begin(), ma_blocks.end(), vm_address, block_start_less);
+	return (cit != ma_blocks.end() && cit->start == vm_address) ? &*cit : NULL;
+}
+
+const ControlFlowGraph::BasicBlock* ControlFlowGraph::block_containing(unsigned vm_address) const throw() {
+	vector<BasicBlock>::const_iterator cit = upper_bound(ma_blocks.begin(), ma_blocks.end(), vm_address, block_start_greater);
+	if (cit == ma_blocks.begin())
+		return NULL;
+	-- cit;
+	return vm_address < cit->end ? &*cit : NULL;
+}
+
+const ControlFlowGraph::Function* ControlFlowGraph::function_at(unsigned vm_address) const throw() {
+	vector<Function>::const_iterator cit = lower_bound(ma_functions.begin(), ma_functions.end(), vm_address, function_entry_less);
+	return (cit != ma_functions.end() && cit->entry == vm_address) ? &*cit : NULL;
+}
+
+const ControlFlowGraph::Function* ControlFlowGraph::function_containing(unsigned vm_address) const throw() {
+	const BasicBlock* block = this->block_containing(vm_address);
+	return block != NULL ? &ma_functions[block->function] : NULL;
+}
+
+pair<const unsigned*, const unsigned*> ControlFlowGraph::successors_of(const BasicBlock& block) const throw() {
+	const unsigned* begin = ma_successors.empty() ? NULL : &ma_successors[0] + block.first_successor;
+	return pair<const unsigned*, const unsigned*>(begin, begin + block.successor_count);
+}
+
+pair<const unsigned*, const unsigned*> ControlFlowGraph::blocks_of(const Function& function) const throw() {
+	const unsigned* begin = ma_function_blocks.empty() ? NULL : &ma_function_blocks[0] + function.first_block;
+	return pair<const unsigned*, const unsigned*>(begin, begin + function.block_count);
+}
@@ -0,0 +1,78 @@
+/*
+
+ControlFlowGraph.h ... Functions and basic blocks of Thumb code
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CONTROLFLOWGRAPH_H
+#define CONTROLFLOWGRAPH_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+class MachO_File;
+
+// The functions and basic blocks of a range of Thumb code, recovered by following the control flow from
+// the symbols, ObjC method implementations and bl targets in the range. Code which is never reached is not included.
+// Everything is stored in flat arrays sorted by address, and the graph is not modified after construction,
+// so it can be shared by threads.
+class ControlFlowGraph {
+public:
+	struct BasicBlock {
+		unsigned start, end;			// [start, end)
+		unsigned function;				// index of the function owning this block.
+		unsigned first_successor;		// index into the successors array.
+		unsigned successor_count;
+	};
+	
+	struct Function {
+		unsigned entry;
+		unsigned end;					// the end of the last block of the function.
+		unsigned first_block;			// index into the function blocks array.
+		unsigned block_count;
+	};
+
+private:
+	std::vector<BasicBlock> ma_blocks;
+	std::vector<unsigned> ma_successors;		// block indices.
+	std::vector<Function> ma_functions;
+	std::vector<unsigned> ma_function_blocks;	// block indices, grouped by function and sorted by address.
+	
+	void assign_functions(const std::vector<unsigned>& entries);
+
+public:
+	ControlFlowGraph(const MachO_File& file, unsigned start_vm, std::size_t range_bytes);
+	
+	inline std::size_t block_count() const throw() { return ma_blocks.size(); }
+	inline std::size_t function_count() const throw() { return ma_functions.size(); }
+	inline const BasicBlock& block(std::size_t i) const throw() { return ma_blocks[i]; }
+	inline const Function& function(std::size_t i) const throw() { return ma_functions[i]; }
+	
+	// NULL if no block or function starts or lies at this address.
+	const BasicBlock* block_at(unsigned vm_address) const throw();
+	const BasicBlock* block_containing(unsigned vm_address) const throw();
+	const Function* function_at(unsigned vm_address) const throw();
+	const Function* function_containing(unsigned vm_address) const throw();
+	
+	// the indices of the successors of a block, and of the blocks of a function.
+	std::pair<const unsigned*, const unsigned*> successors_of(const BasicBlock& block) const throw();
+	std::pair<const unsigned*, const unsigned*> blocks_of(const Function& function) const throw();
+};
+
+#endif
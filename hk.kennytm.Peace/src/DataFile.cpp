@@ -25,8 +25,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/stat.h>
 #include <unistd.h>
 #include <cstring>
+#include <cstdlib>
 #include <string>
 #include "DataFile.h"
+#if _MSC_VER
+#include <io.h>
+#endif
 
 using namespace std;
 
@@ -34,8 +38,11 @@ TRException::TRException(const char* format, ...) {
 	va_list arguments;
 	va_start(arguments, format);
 	int string_length = vsnprintf(NULL, 0, format, arguments);
+	va_end(arguments);
 	m_error = new char[string_length+1];
-	vsnprintf(m_error, string_length, format, arguments);
+	// a va_list cannot be reused after it has been consumed.
+	va_start(arguments, format);
+	vsnprintf(m_error, static_cast<size_t>(string_length+1), format, arguments);
 	va_end(arguments);
 }
 
@@ -162,3 +169,59 @@ eof:
 	m_location = m_filesize;
 	return false;
 }
+
+#pragma mark -
+
+AtomicFileWriter::AtomicFileWriter(const std::string& path) : m_path(path), m_temp_path(path + ".XXXXXX"), m_file(NULL), m_failed(true) {
+#if _MSC_VER
+	if (_mktemp_s(&m_temp_path[0], m_temp_path.size()+1) == 0)
+		m_file = std::fopen(m_temp_path.c_str(), "wb");
+#else
+	int fd = mkstemp(&m_temp_path[0]);
+	if (fd >= 0) {
+		// mkstemp() creates the file readable by the owner only.
+		fchmod(fd, 0644);
+		m_file = fdopen(fd, "wb");
+		if (m_file == NULL) {
+			close(fd);
+			std::remove(m_temp_path.c_str());
+		}
+	}
+#endif
+	m_failed = m_file == NULL;
+}
+
+AtomicFileWriter::~AtomicFileWriter() throw() {
+	if (m_file != NULL) {
+		std::fclose(m_file);
+		std::remove(m_temp_path.c_str());
+	}
+}
+
+void AtomicFileWriter::write(const void* data, std::size_t size) throw() {
+	if (!m_failed && size > 0 && std::fwrite(data, 1, size, m_file) != size)
+		m_failed = true;
+}
+
+bool AtomicFileWriter::commit() throw() {
+	if (m_file == NULL)
+		return false;
+	if (std::fclose(m_file) != 0)
+		m_failed = true;
+	m_file = NULL;
+	
+	if (!m_failed && std::rename(m_temp_path.c_str(), m_path.c_str()) != 0) {
+#if _MSC_VER
+		// Windows does not replace an existing file.
+		std::remove(m_path.c_str());
+		m_failed = std::rename(m_temp_path.c_str(), m_path.c_str()) != 0;
+#else
+		// rename() replaces the file atomically here, so a failure is real (EXDEV, EACCES, ...)
+		// and the old file must stay.
+		m_failed = true;
+#endif
+	}
+	if (m_failed)
+		std::remove(m_temp_path.c_str());
+	return !m_failed;
+}
@@ -149,4 +149,27 @@ public:
 	~DataFile() throw();
 };
 
+// writes a file so that readers never see it half-written: the data go to a uniquely named temporary file
+// next to it, which replaces the file on commit(). Several processes may write the same file at once; the last one wins.
+class AtomicFileWriter {
+private:
+	std::string m_path, m_temp_path;
+	std::FILE* m_file;
+	bool m_failed;
+	
+	AtomicFileWriter(const AtomicFileWriter&);
+	AtomicFileWriter& operator=(const AtomicFileWriter&);
+	
+public:
+	explicit AtomicFileWriter(const std::string& path);
+	// the temporary file is removed if commit() has not been called.
+	~AtomicFileWriter() throw();
+	
+	inline bool failed() const throw() { return m_failed; }
+	void write(const void* data, std::size_t size) throw();
+	
+	// returns false if the file could not be written completely, in which case the old file is left as is.
+	bool commit() throw();
+};
+
 #endif
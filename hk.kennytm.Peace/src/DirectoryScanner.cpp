@@ -0,0 +1,159 @@
+/*
+
+DirectoryScanner.cpp ... Find the Mach-O files under a directory
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DirectoryScanner.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <sys/stat.h>
+#if _MSC_VER
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+using namespace std;
+
+static bool list_directory(const string& directory, vector<string>& entries) {
+#if _MSC_VER
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+	do {
+		if (strcmp(data.cFileName, ".") != 0 && strcmp(data.cFileName, "..") != 0)
+			entries.push_back(data.cFileName);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == NULL)
+		return false;
+	while (const dirent* entry = readdir(dir))
+		if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+			entries.push_back(entry->d_name);
+	closedir(dir);
+#endif
+	return true;
+}
+
+#if !_MSC_VER
+struct ScannedFile {
+	string path;
+	dev_t device;
+	ino_t inode;
+	bool is_link;
+};
+
+// a file reachable under several names, e.g. Foo.framework/Foo -> Versions/A/Foo, is listed only once:
+// by its first real name if there is one, otherwise by its first symlink.
+static void append_distinct_files(const vector<ScannedFile>& files, vector<string>& paths) {
+	typedef map<pair<dev_t, ino_t>, size_t> ChosenMap;
+	ChosenMap chosen;
+	for (size_t i = 0; i < files.size(); ++ i) {
+		pair<ChosenMap::iterator, bool> res = chosen.insert(ChosenMap::value_type(make_pair(files[i].device, files[i].inode), i));
+		if (!res.second && files[res.first->second].is_link && !files[i].is_link)
+			res.first->second = i;
+	}
+	
+	for (size_t i = 0; i < files.size(); ++ i)
+		if (chosen[make_pair(files[i].device, files[i].inode)] == i)
+			paths.push_back(files[i].path);
+}
+#endif
+
+void scan_directory(const string& root, vector<string>& paths, bool dedupe_links) {
+#if !_MSC_VER
+	vector<ScannedFile> files;
+#endif
+	vector<string> pending (1, root);
+	while (!pending.empty()) {
+		string directory = pending.back();
+		pending.pop_back();
+		
+		vector<string> entries;
+		if (!list_directory(directory, entries)) {
+			fprintf(stderr, "Warning: Cannot open directory %s. Ignoring it.\n", directory.c_str());
+			continue;
+		}
+		sort(entries.begin(), entries.end());
+		
+		if (directory.empty() || directory[directory.size()-1] != '/')
+			directory.push_back('/');
+			
+		vector<string> subdirectories;
+		for (vector<string>::const_iterator cit = entries.begin(); cit != entries.end(); ++ cit) {
+			string path = directory + *cit;
+			struct stat st;
+#if _MSC_VER
+			// there are no symlinks to worry about.
+			if (stat(path.c_str(), &st) != 0)
+				continue;
+			if (st.st_mode & _S_IFDIR)
+				subdirectories.push_back(path);
+			else if (st.st_mode & _S_IFREG)
+				paths.push_back(path);
+#else
+			if (lstat(path.c_str(), &st) != 0)
+				continue;
+			bool is_link = S_ISLNK(st.st_mode);
+			if (S_ISDIR(st.st_mode))
+				subdirectories.push_back(path);
+			else if (S_ISREG(st.st_mode) || (is_link && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))) {
+				ScannedFile file = {path, st.st_dev, st.st_ino, is_link};
+				files.push_back(file);
+			}
+#endif
+		}
+		pending.insert(pending.end(), subdirectories.rbegin(), subdirectories.rend());
+	}
+	
+#if !_MSC_VER
+	if (dedupe_links)
+		append_distinct_files(files, paths);
+	else
+		for (vector<ScannedFile>::const_iterator cit = files.begin(); cit != files.end(); ++ cit)
+			paths.push_back(cit->path);
+#endif
+}
+
+void read_path_list(FILE* stream, vector<string>& paths) {
+	char filename_buffer[2048];
+	while (fgets(filename_buffer, sizeof(filename_buffer), stream) != NULL) {
+		size_t filename_length = strlen(filename_buffer);
+		if (filename_length > 0 && filename_buffer[filename_length-1] == '\n')
+			filename_buffer[--filename_length] = '\0';
+		if (filename_length != 0)
+			paths.push_back(filename_buffer);
+	}
+}
+
+bool has_macho_magic(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+	static const unsigned char fat_magic[4] = {0xCA, 0xFE, 0xBA, 0xBE}, mh_magic[4] = {0xCE, 0xFA, 0xED, 0xFE};
+	unsigned char magic[4];
+	bool retval = fread(magic, 1, 4, f) == 4 && (memcmp(magic, fat_magic, 4) == 0 || memcmp(magic, mh_magic, 4) == 0);
+	fclose(f);
+	return retval;
+}
@@ -0,0 +1,41 @@
+/*
+
+DirectoryScanner.h ... Find the Mach-O files under a directory
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// append the regular files under root (and symlinks to them) to paths, like os.walk() in scan_for_macho.py,
+// but in sorted order so that the result does not depend on the file system. Symlinked directories are
+// not followed, to avoid cycles. With dedupe_links, a file found under several names is appended once;
+// otherwise every name is kept, since symlinked install names (libfoo.1.dylib -> libfoo.1.0.dylib) matter.
+void scan_directory(const std::string& root, std::vector<std::string>& paths, bool dedupe_links = false);
+
+// append the non-empty lines of the stream to paths.
+void read_path_list(std::FILE* stream, std::vector<std::string>& paths);
+
+// true if the file starts with the magic of a fat or a little-endian 32-bit Mach-O file.
+bool has_macho_magic(const char* path);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+
+DyldInfoDecoder.cpp ... Decoder of the dyld bind and rebase opcode streams
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DyldInfoDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// the images are 32-bit.
+static const unsigned pointer_size = 4;
+
+DyldInfoDecoder::DyldInfoDecoder(const vector<const segment_command*>& segments) {
+	ma_segments.reserve(segments.size());
+	for (vector<const segment_command*>::const_iterator cit = segments.begin(); cit != segments.end(); ++ cit) {
+		SegmentRange range;
+		range.begin = (*cit)->vmaddr;
+		range.end = (*cit)->vmaddr + (*cit)->vmsize;
+		ma_segments.push_back(range);
+	}
+}
+
+bool DyldInfoDecoder::read_uleb128_slow(const unsigned char*& p, const unsigned char* end, unsigned& value) throw() {
+	unsigned res = 0;
+	int bit = 0;
+	while (p < end) {
+		unsigned char c = *p++;
+		if (bit < 32)
+			res |= static_cast<unsigned>(c & 0x7F) << bit;
+		bit += 7;
+		if (!(c & 0x80)) {
+			value = res;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DyldInfoDecoder::read_sleb128(const unsigned char*& p, const unsigned char* end, int& value) throw() {
+	unsigned res = 0;
+	int bit = 0;
+	while (p < end) {
+		unsigned char c = *p++;
+		if (bit < 32)
+			res |= static_cast<unsigned>(c & 0x7F) << bit;
+		bit += 7;
+		if (!(c & 0x80)) {
+			if (bit < 32 && (c & 0x40))
+				res |= ~0u << bit;
+			value = static_cast<int>(res);
+			return true;
+		}
+	}
+	return false;
+}
+
+#pragma mark -
+
+bool DyldInfoDecoder::decode_binds(const void* stream, size_t size, BindKind kind) {
+	const unsigned char* p = static_cast<const unsigned char*>(stream);
+	const unsigned char* end = p + size;
+	
+	BindRecord rec;
+	rec.address = 0;
+	rec.ordinal = 0;
+	rec.symbol = ~0u;
+	rec.addend = 0;
+	rec.type = BIND_TYPE_POINTER;
+	rec.kind = static_cast<unsigned char>(kind);
+	rec.symbol_flags = 0;
+	
+	const SegmentRange* seg = NULL;
+	
+	while (p < end) {
+		unsigned char imm = static_cast<unsigned char>(*p & BIND_IMMEDIATE_MASK), opcode = static_cast<unsigned char>(*p & BIND_OPCODE_MASK);
+		++ p;
+		
+		unsigned count = 1, skip = 0;
+		
+		switch (opcode) {
+			// the lazy stream has a DONE after every entry, so keep going until the end.
+			case BIND_OPCODE_DONE:
+				continue;
+				
+			case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+				rec.ordinal = imm;
+				continue;
+				
+			case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB: {
+				unsigned ordinal;
+				if (!read_uleb128(p, end, ordinal))
+					return false;
+				rec.ordinal = static_cast<int>(ordinal);
+				continue;
+			}
+			
+			case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+				rec.ordinal = imm ? static_cast<signed char>(BIND_OPCODE_MASK | imm) : 0;
+				continue;
+				
+			case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM: {
+				const void* nul = memchr(p, '\0', static_cast<size_t>(end - p));
+				if (nul == NULL)
+					return false;
+				rec.symbol = static_cast<unsigned>(ma_symbol_names.size());
+				rec.symbol_flags = imm;
+				ma_symbol_names.push_back(reinterpret_cast<const char*>(p));
+				p = static_cast<const unsigned char*>(nul) + 1;
+				continue;
+			}
+			
+			case BIND_OPCODE_SET_TYPE_IMM:
+				rec.type = imm;
+				continue;
+				
+			case BIND_OPCODE_SET_ADDEND_SLEB:
+				if (!read_sleb128(p, end, rec.addend))
+					return false;
+				continue;
+				
+			case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB: {
+				unsigned offset;
+				if (imm >= ma_segments.size() || !read_uleb128(p, end, offset))
+					return false;
+				seg = &ma_segments[imm];
+				rec.address = seg->begin + offset;
+				continue;
+			}
+			
+			case BIND_OPCODE_ADD_ADDR_ULEB: {
+				unsigned delta;
+				if (!read_uleb128(p, end, delta))
+					return false;
+				rec.address += delta;
+				continue;
+			}
+			
+			case BIND_OPCODE_DO_BIND:
+				break;
+				
+			case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+				if (!read_uleb128(p, end, skip))
+					return false;
+				break;
+				
+			case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+				skip = imm * pointer_size;
+				break;
+				
+			case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
+				if (!read_uleb128(p, end, count) || !read_uleb128(p, end, skip))
+					return false;
+				break;
+				
+			default:
+				return false;
+		}
+		
+		// the remaining opcodes bind count times.
+		if (seg == NULL || rec.symbol == ~0u)
+			return false;
+		for (unsigned i = 0; i < count; ++ i) {
+			if (rec.address < seg->begin || rec.address >= seg->end)
+				return false;
+			ma_binds.push_back(rec);
+			rec.address += skip + pointer_size;
+		}
+	}
+	
+	return true;
+}
+
+bool DyldInfoDecoder::decode_rebases(const void* stream, size_t size) {
+	const unsigned char* p = static_cast<const unsigned char*>(stream);
+	const unsigned char* end = p + size;
+	
+	RebaseRecord rec;
+	rec.address = 0;
+	rec.type = REBASE_TYPE_POINTER;
+	
+	const SegmentRange* seg = NULL;
+	
+	while (p < end) {
+		unsigned char imm = static_cast<unsigned char>(*p & REBASE_IMMEDIATE_MASK), opcode = static_cast<unsigned char>(*p & REBASE_OPCODE_MASK);
+		++ p;
+		
+		unsigned count = 1, skip = 0;
+		
+		switch (opcode) {
+			case REBASE_OPCODE_DONE:
+				return true;
+				
+			case REBASE_OPCODE_SET_TYPE_IMM:
+				rec.type = imm;
+				continue;
+				
+			case REBASE_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB: {
+				unsigned offset;
+				if (imm >= ma_segments.size() || !read_uleb128(p, end, offset))
+					return false;
+				seg = &ma_segments[imm];
+				rec.address = seg->begin + offset;
+				continue;
+			}
+			
+			case REBASE_OPCODE_ADD_ADDR_ULEB: {
+				unsigned delta;
+				if (!read_uleb128(p, end, delta))
+					return false;
+				rec.address += delta;
+				continue;
+			}
+			
+			case REBASE_OPCODE_ADD_ADDR_IMM_SCALED:
+				rec.address += imm * pointer_size;
+				continue;
+				
+			case REBASE_OPCODE_DO_REBASE_IMM_TIMES:
+				count = imm;
+				break;
+				
+			case REBASE_OPCODE_DO_REBASE_ULEB_TIMES:
+				if (!read_uleb128(p, end, count))
+					return false;
+				break;
+				
+			case REBASE_OPCODE_DO_REBASE_ADD_ADDR_ULEB:
+				if (!read_uleb128(p, end, skip))
+					return false;
+				break;
+				
+			case REBASE_OPCODE_DO_REBASE_ULEB_TIMES_SKIPPING_ULEB:
+				if (!read_uleb128(p, end, count) || !read_uleb128(p, end, skip))
+					return false;
+				break;
+				
+			default:
+				return false;
+		}
+		
+		if (seg == NULL)
+			return false;
+		for (unsigned i = 0; i < count; ++ i) {
+			if (rec.address < seg->begin || rec.address >= seg->end)
+				return false;
+			ma_rebases.push_back(rec);
+			rec.address += skip + pointer_size;
+		}
+	}
+	
+	return true;
+}
+
+#pragma mark -
+
+struct RebaseRecordComparator {
+	bool operator() (const DyldInfoDecoder::RebaseRecord& a, const DyldInfoDecoder::RebaseRecord& b) const throw() { return a.address < b.address; }
+	bool operator() (const DyldInfoDecoder::RebaseRecord& a, unsigned b) const throw() { return a.address < b; }
+	bool operator() (unsigned a, const DyldInfoDecoder::RebaseRecord& b) const throw() { return a < b.address; }
+};
+
+void DyldInfoDecoder::sort_rebases() {
+	stable_sort(ma_rebases.begin(), ma_rebases.end(), RebaseRecordComparator());
+}
+
+bool DyldInfoDecoder::is_rebase_location(unsigned vm_address) const throw() {
+	return binary_search(ma_rebases.begin(), ma_rebases.end(), vm_address, RebaseRecordComparator());
+}
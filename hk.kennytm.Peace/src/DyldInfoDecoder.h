@@ -0,0 +1,95 @@
+/*
+
+DyldInfoDecoder.h ... Decoder of the dyld bind and rebase opcode streams
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DYLDINFODECODER_H
+#define DYLDINFODECODER_H
+
+#include <mach-o/loader.h>
+#include <vector>
+#include <cstddef>
+
+// Runs the bind, weak-bind, lazy-bind and rebase opcode streams of LC_DYLD_INFO directly from memory,
+// and collects what they do into flat record arrays. Every read is bounds-checked, and addresses
+// are kept inside the segment they were set in, so a malformed stream ends early instead of crashing.
+class DyldInfoDecoder {
+public:
+	enum BindKind {
+		BK_Regular,
+		BK_Weak,
+		BK_Lazy
+	};
+	
+	struct BindRecord {
+		unsigned address;
+		int ordinal;		// may be one of the BIND_SPECIAL_DYLIB_* values.
+		unsigned symbol;	// index for symbol_name().
+		int addend;
+		unsigned char type;
+		unsigned char kind;
+		unsigned char symbol_flags;
+	};
+	
+	struct RebaseRecord {
+		unsigned address;
+		unsigned char type;
+	};
+
+private:
+	struct SegmentRange {
+		unsigned begin, end;
+	};
+	
+	std::vector<SegmentRange> ma_segments;
+	std::vector<BindRecord> ma_binds;
+	std::vector<RebaseRecord> ma_rebases;
+	std::vector<const char*> ma_symbol_names;
+	
+	static bool read_uleb128_slow(const unsigned char*& p, const unsigned char* end, unsigned& value) throw();
+	static bool read_sleb128(const unsigned char*& p, const unsigned char* end, int& value) throw();
+	
+	// most operands fit in one byte.
+	static inline bool read_uleb128(const unsigned char*& p, const unsigned char* end, unsigned& value) throw() {
+		if (p < end && *p < 0x80) {
+			value = *p++;
+			return true;
+		}
+		return read_uleb128_slow(p, end, value);
+	}
+
+public:
+	DyldInfoDecoder() {}
+	explicit DyldInfoDecoder(const std::vector<const segment_command*>& segments);
+	
+	// these return false if the stream is truncated or malformed. Records decoded so far are kept.
+	bool decode_binds(const void* stream, std::size_t size, BindKind kind);
+	bool decode_rebases(const void* stream, std::size_t size);
+	
+	// sort the rebase records by address, for is_rebase_location().
+	void sort_rebases();
+	bool is_rebase_location(unsigned vm_address) const throw();
+	
+	inline const std::vector<BindRecord>& binds() const throw() { return ma_binds; }
+	inline const std::vector<RebaseRecord>& rebases() const throw() { return ma_rebases; }
+	inline const char* symbol_name(unsigned symbol) const throw() { return ma_symbol_names[symbol]; }
+	inline std::size_t symbol_count() const throw() { return ma_symbol_names.size(); }
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+
+ExportTrie.cpp ... Reader of the dyld export trie
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ExportTrie.h"
+#include <cstring>
+
+using namespace std;
+
+ExportTrie::ExportTrie(const void* data, size_t size) : m_begin(static_cast<const unsigned char*>(data)), m_end(static_cast<const unsigned char*>(data) + size) {}
+
+bool ExportTrie::read_uleb128(const unsigned char*& p, const unsigned char* end, unsigned& value) throw() {
+	unsigned res = 0;
+	int bit = 0;
+	while (p < end) {
+		unsigned char c = *p++;
+		if (bit < 32)
+			res |= static_cast<unsigned>(c & 0x7F) << bit;
+		bit += 7;
+		if (!(c & 0x80)) {
+			value = res;
+			return true;
+		}
+	}
+	return false;
+}
+
+// find the end of a string without running beyond end. Returns NULL if it is not terminated.
+static const unsigned char* string_end(const unsigned char* p, const unsigned char* end) throw() {
+	const void* nul = memchr(p, '\0', static_cast<size_t>(end - p));
+	return static_cast<const unsigned char*>(nul);
+}
+
+bool ExportTrie::read_terminal(const unsigned char* p, Entry& entry) const throw() {
+	// p points just after the terminal size.
+	if (!read_uleb128(p, m_end, entry.flags) || !read_uleb128(p, m_end, entry.address))
+		return false;
+		
+	entry.resolver = 0;
+	entry.import_name = NULL;
+	if (entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT) {
+		const unsigned char* name_end = string_end(p, m_end);
+		if (name_end == NULL)
+			return false;
+		entry.import_name = reinterpret_cast<const char*>(p);
+	} else if (entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER) {
+		if (!read_uleb128(p, m_end, entry.resolver))
+			return false;
+	}
+	return true;
+}
+
+bool ExportTrie::lookup(const char* name, Entry* p_entry) const throw() {
+	if (m_begin == m_end)
+		return false;
+		
+	const unsigned char* node = m_begin;
+	size_t depth = 0;
+	
+	while (true) {
+		const unsigned char* p = node;
+		unsigned terminal_size;
+		if (!read_uleb128(p, m_end, terminal_size) || terminal_size > static_cast<size_t>(m_end - p))
+			return false;
+			
+		if (*name == '\0') {
+			if (terminal_size == 0)
+				return false;
+			Entry entry;
+			if (!read_terminal(p, entry))
+				return false;
+			if (p_entry != NULL) {
+				*p_entry = entry;
+				p_entry->name = NULL;
+				p_entry->name_length = 0;
+			}
+			return true;
+		}
+		
+		p += terminal_size;
+		if (p >= m_end)
+			return false;
+		unsigned children_count = *p++;
+		
+		const unsigned char* next_node = NULL;
+		for (unsigned i = 0; i < children_count; ++ i) {
+			const unsigned char* label_end = string_end(p, m_end);
+			if (label_end == NULL)
+				return false;
+			size_t label_length = static_cast<size_t>(label_end - p);
+			bool matched = strncmp(reinterpret_cast<const char*>(p), name, label_length) == 0;
+			
+			p = label_end + 1;
+			unsigned child_offset;
+			if (!read_uleb128(p, m_end, child_offset))
+				return false;
+				
+			if (matched) {
+				if (child_offset >= static_cast<size_t>(m_end - m_begin))
+					return false;
+				name += label_length;
+				next_node = m_begin + child_offset;
+				break;
+			}
+		}
+		
+		// a well-formed trie cannot be deeper than it is long.
+		if (next_node == NULL || ++ depth > static_cast<size_t>(m_end - m_begin))
+			return false;
+		node = next_node;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+ExportTrie::Iterator::Iterator(const ExportTrie& trie) : m_trie(trie), m_nodes_visited(0), m_root_is_terminal(false) {
+	m_entry.name = NULL;
+	m_entry.name_length = 0;
+	if (!trie.empty())
+		m_root_is_terminal = this->enter_node(0);
+}
+
+bool ExportTrie::Iterator::enter_node(unsigned offset) {
+	size_t trie_size = static_cast<size_t>(m_trie.m_end - m_trie.m_begin);
+	// every node occupies at least one byte, so more visits than bytes means there is a cycle.
+	if (offset >= trie_size || ++ m_nodes_visited > trie_size)
+		return false;
+		
+	const unsigned char* p = m_trie.m_begin + offset;
+	unsigned terminal_size;
+	if (!read_uleb128(p, m_trie.m_end, terminal_size) || terminal_size >= static_cast<size_t>(m_trie.m_end - p))
+		return false;
+		
+	const unsigned char* children = p + terminal_size;
+	Frame frame;
+	frame.children_remaining = *children;
+	frame.next_child = children + 1;
+	frame.prefix_length = m_prefix.size();
+	ma_stack.push_back(frame);
+	
+	if (terminal_size != 0 && m_trie.read_terminal(p, m_entry)) {
+		m_entry.name = m_prefix.c_str();
+		m_entry.name_length = m_prefix.size();
+		return true;
+	}
+	return false;
+}
+
+bool ExportTrie::Iterator::next() {
+	if (m_root_is_terminal) {
+		m_root_is_terminal = false;
+		return true;
+	}
+	
+	while (!ma_stack.empty()) {
+		Frame& frame = ma_stack.back();
+		if (frame.children_remaining == 0) {
+			ma_stack.pop_back();
+			continue;
+		}
+		
+		-- frame.children_remaining;
+		const unsigned char* p = frame.next_child;
+		const unsigned char* label_end = string_end(p, m_trie.m_end);
+		if (label_end == NULL) {
+			ma_stack.clear();
+			return false;
+		}
+		const unsigned char* q = label_end + 1;
+		unsigned child_offset;
+		if (!read_uleb128(q, m_trie.m_end, child_offset)) {
+			ma_stack.clear();
+			return false;
+		}
+		frame.next_child = q;
+		
+		m_prefix.resize(frame.prefix_length);
+		m_prefix.append(reinterpret_cast<const char*>(p), static_cast<size_t>(label_end - p));
+		
+		if (this->enter_node(child_offset))
+			return true;
+	}
+	return false;
+}
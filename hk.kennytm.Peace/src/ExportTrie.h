@@ -0,0 +1,93 @@
+/*
+
+ExportTrie.h ... Reader of the dyld export trie
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef EXPORTTRIE_H
+#define EXPORTTRIE_H
+
+#include <mach-o/loader.h>
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#ifndef EXPORT_SYMBOL_FLAGS_REEXPORT
+#define EXPORT_SYMBOL_FLAGS_REEXPORT 0x08
+#endif
+#ifndef EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER
+#define EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER 0x10
+#endif
+
+// Reads the export trie directly from memory. Every read is bounds-checked, and nothing recurses,
+// so a malformed trie ends the walk instead of crashing it.
+class ExportTrie {
+public:
+	struct Entry {
+		const char* name;		// valid until the iterator advances.
+		std::size_t name_length;
+		unsigned flags;
+		unsigned address;		// the library ordinal for re-exports.
+		unsigned resolver;		// for stubs with resolvers.
+		const char* import_name;	// for re-exports.
+	};
+	
+	class Iterator {
+	private:
+		struct Frame {
+			const unsigned char* next_child;
+			unsigned children_remaining;
+			std::size_t prefix_length;
+		};
+		
+		const ExportTrie& m_trie;
+		std::vector<Frame> ma_stack;
+		std::string m_prefix;
+		Entry m_entry;
+		std::size_t m_nodes_visited;
+		bool m_root_is_terminal;
+		
+		bool enter_node(unsigned offset);
+		
+	public:
+		Iterator(const ExportTrie& trie);
+		
+		// advance to the next exported symbol, in the same order as a depth-first walk. Returns false at the end.
+		bool next();
+		inline const Entry& entry() const throw() { return m_entry; }
+	};
+
+private:
+	const unsigned char* m_begin;
+	const unsigned char* m_end;
+	
+	bool read_terminal(const unsigned char* p, Entry& entry) const throw();
+
+public:
+	ExportTrie() : m_begin(NULL), m_end(NULL) {}
+	ExportTrie(const void* data, std::size_t size);
+	
+	inline bool empty() const throw() { return m_begin == m_end; }
+	
+	// find an exported symbol by walking the trie along the name.
+	bool lookup(const char* name, Entry* p_entry = NULL) const throw();
+	
+	static bool read_uleb128(const unsigned char*& p, const unsigned char* end, unsigned& value) throw();
+};
+
+#endif
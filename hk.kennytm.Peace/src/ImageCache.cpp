@@ -0,0 +1,154 @@
+/*
+
+ImageCache.cpp ... Process-wide cache of opened images
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ImageCache.h"
+#include "AnalysisCache.h"
+
+using namespace std;
+
+ImageCache ImageCache::s_shared;
+
+ImageCache::ImageCache() : m_total_bytes(0), m_byte_limit(256u << 20), m_closing(false) {}
+
+ImageCache::~ImageCache() throw() {
+	// images may hold handles to other images, so stop tracking before deleting anything.
+	m_closing = true;
+	for (tr1::unordered_map<string, Entry*>::iterator it = ma_entries.begin(); it != ma_entries.end(); ++ it)
+		if (it->second->image != NULL)
+			it->second->deleter(it->second->image);
+	for (tr1::unordered_map<string, Entry*>::iterator it = ma_entries.begin(); it != ma_entries.end(); ++ it)
+		delete it->second;
+}
+
+void ImageCache::set_byte_limit(size_t limit) {
+	vector<Entry*> evicted;
+	m_mutex.lock();
+	m_byte_limit = limit;
+	this->trim(evicted);
+	m_mutex.unlock();
+	destroy(evicted);
+}
+
+ImageCache::Entry* ImageCache::acquire(const char* path, const char* arch, const char* kind, Creator creator, Deleter deleter) {
+	string canonical_path = AnalysisCache::absolute_path(path);
+	if (canonical_path.empty())
+		canonical_path = path;
+	string key = canonical_path;
+	key.push_back('\0');
+	key += arch;
+	key.push_back('\0');
+	key += kind;
+	
+	m_mutex.lock();
+	tr1::unordered_map<string, Entry*>::iterator it = ma_entries.find(key);
+	if (it != ma_entries.end()) {
+		Entry* entry = it->second;
+		this->add_reference(entry);
+		while (entry->loading)
+			m_loaded.wait(m_mutex);
+		m_mutex.unlock();
+		return entry;
+	}
+	
+	// create the image without holding the lock, so other threads can still use the cache meanwhile.
+	Entry* entry = new Entry;
+	entry->image = NULL;
+	entry->deleter = deleter;
+	entry->key = key;
+	entry->bytes = 0;
+	entry->refcount = 1;
+	entry->loading = true;
+	ma_entries.insert(pair<string, Entry*>(key, entry));
+	m_mutex.unlock();
+	
+	try {
+		entry->image = creator(path, arch);
+		entry->bytes = static_cast<size_t>(entry->image->filesize());
+	} catch (const TRException& e) {
+		entry->error = e.what();
+	} catch (...) {
+		// the threads waiting for this image see it as a failure.
+		entry->error = "Cannot open ";
+		entry->error += path;
+		this->finish_loading(entry);
+		this->release(entry);
+		throw;
+	}
+	
+	this->finish_loading(entry);
+	return entry;
+}
+
+void ImageCache::finish_loading(Entry* entry) throw() {
+	vector<Entry*> evicted;
+	m_mutex.lock();
+	entry->loading = false;
+	m_total_bytes += entry->bytes;
+	this->trim(evicted);
+	m_loaded.broadcast();
+	m_mutex.unlock();
+	destroy(evicted);
+}
+
+#pragma mark -
+
+void ImageCache::add_reference(Entry* entry) throw() {
+	if (entry->refcount ++ == 0)
+		m_lru.erase(entry->lru_position);
+}
+
+void ImageCache::retain(Entry* entry) throw() {
+	ScopedLock lock (m_mutex);
+	this->add_reference(entry);
+}
+
+void ImageCache::release(Entry* entry) throw() {
+	if (m_closing)
+		return;
+		
+	vector<Entry*> evicted;
+	m_mutex.lock();
+	if (-- entry->refcount == 0) {
+		m_lru.push_front(entry);
+		entry->lru_position = m_lru.begin();
+		this->trim(evicted);
+	}
+	m_mutex.unlock();
+	destroy(evicted);
+}
+
+void ImageCache::trim(vector<Entry*>& evicted) {
+	while (m_total_bytes > m_byte_limit && !m_lru.empty()) {
+		Entry* entry = m_lru.back();
+		m_lru.pop_back();
+		ma_entries.erase(entry->key);
+		m_total_bytes -= entry->bytes;
+		evicted.push_back(entry);
+	}
+}
+
+void ImageCache::destroy(const vector<Entry*>& evicted) throw() {
+	for (vector<Entry*>::const_iterator cit = evicted.begin(); cit != evicted.end(); ++ cit) {
+		if ((*cit)->image != NULL)
+			(*cit)->deleter((*cit)->image);
+		delete *cit;
+	}
+}
@@ -0,0 +1,143 @@
+/*
+
+ImageCache.h ... Process-wide cache of opened images
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <cstddef>
+#include <tr1/unordered_map>
+#include "DataFile.h"
+#include "Threading.h"
+
+template <typename T> class ImageHandle;
+
+// Images opened while following library dependencies, shared by everything in the process.
+// An image is identified by its canonical path, the arch, and a kind string which tells apart the
+// different classes (or analyses) built on the same file. Images in use are never evicted; unused
+// ones are kept in LRU order until the total mapped size exceeds the byte limit.
+// Failures are remembered too, so a missing library is only looked for once. An image is only ever
+// created once: other threads asking for it meanwhile wait for the first one to finish.
+class ImageCache {
+public:
+	typedef DataFile* (*Creator)(const char* path, const char* arch);
+	typedef void (*Deleter)(DataFile* image);
+	
+	struct Entry {
+		DataFile* image;	// NULL if the image could not be opened.
+		Deleter deleter;
+		std::string key;
+		std::string error;
+		std::size_t bytes;
+		unsigned refcount;
+		bool loading;	// the image is still being created by the first thread that asked for it.
+		std::list<Entry*>::iterator lru_position;	// only valid when refcount is 0.
+	};
+
+private:
+	static ImageCache s_shared;
+	
+	Mutex m_mutex;
+	Condition m_loaded;
+	std::tr1::unordered_map<std::string, Entry*> ma_entries;
+	std::list<Entry*> m_lru;	// unused entries, most recently used first.
+	std::size_t m_total_bytes, m_byte_limit;
+	bool m_closing;
+	
+	ImageCache();
+	~ImageCache() throw();
+	ImageCache(const ImageCache&);
+	ImageCache& operator=(const ImageCache&);
+	
+	Entry* acquire(const char* path, const char* arch, const char* kind, Creator creator, Deleter deleter);
+	void finish_loading(Entry* entry) throw();
+	
+	// these require m_mutex. Evicted entries must be destroyed after unlocking, since deleting
+	// an image may release the handles it holds.
+	void add_reference(Entry* entry) throw();
+	void trim(std::vector<Entry*>& evicted);
+	static void destroy(const std::vector<Entry*>& evicted) throw();
+	
+	template <typename T>
+	static DataFile* create_image(const char* path, const char* arch) { return new T(path, arch); }
+	template <typename T>
+	static void delete_image(DataFile* image) { delete static_cast<T*>(image); }
+	
+	template <typename T> friend class ImageHandle;
+	void retain(Entry* entry) throw();
+	void release(Entry* entry) throw();
+
+public:
+	static inline ImageCache& shared() throw() { return s_shared; }
+	
+	inline std::size_t byte_limit() const throw() { return m_byte_limit; }
+	void set_byte_limit(std::size_t limit);
+	
+	// open the image through the cache. If the image could not be opened, the original
+	// TRException message is thrown again, now and on every later attempt.
+	// The creator must not open other images through the cache.
+	template <typename T>
+	ImageHandle<T> open(const char* path, const char* arch, const char* kind, Creator creator = &create_image<T>) {
+		ImageHandle<T> handle (this->acquire(path, arch, kind, creator, &delete_image<T>));
+		if (!handle)
+			throw TRException("%s", handle.mp_entry->error.c_str());
+		return handle;
+	}
+};
+
+// A reference to an image in the ImageCache. The image stays open as long as a handle refers to it.
+// Locking only protects the cache itself; an image shared between threads must not be mutated concurrently.
+template <typename T>
+class ImageHandle {
+private:
+	ImageCache::Entry* mp_entry;
+	
+	friend class ImageCache;
+	explicit ImageHandle(ImageCache::Entry* entry) throw() : mp_entry(entry) {}
+
+public:
+	ImageHandle() throw() : mp_entry(NULL) {}
+	ImageHandle(const ImageHandle& other) throw() : mp_entry(other.mp_entry) {
+		if (mp_entry != NULL)
+			ImageCache::shared().retain(mp_entry);
+	}
+	ImageHandle& operator=(const ImageHandle& other) throw() {
+		if (other.mp_entry != NULL)
+			ImageCache::shared().retain(other.mp_entry);
+		if (mp_entry != NULL)
+			ImageCache::shared().release(mp_entry);
+		mp_entry = other.mp_entry;
+		return *this;
+	}
+	~ImageHandle() throw() {
+		if (mp_entry != NULL)
+			ImageCache::shared().release(mp_entry);
+	}
+	
+	inline T* get() const throw() { return mp_entry != NULL ? static_cast<T*>(mp_entry->image) : NULL; }
+	inline T* operator->() const throw() { return this->get(); }
+	inline T& operator*() const throw() { return *this->get(); }
+	inline operator bool() const throw() { return this->get() != NULL; }
+};
+
+#endif
@@ -28,6 +28,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <libkern/OSByteOrder.h>
 #include <algorithm>
 #include "get_arch_from_flag.h"
+#include "ImageCache.h"
+#include "snprintf.h"
 
 using namespace std;
 
@@ -35,6 +37,12 @@ MachO_File_Simple::MachO_File_Simple(const char* path, const char* arch) : DataF
 	
 	const mach_header* mp_header = this->read_data<mach_header>();
 	
+	// too small to be a Mach-O file.
+	if (mp_header == NULL) {
+		m_is_valid = false;
+		return;
+	}
+	
 	if (OSSwapBigToHostInt32(mp_header->magic) == FAT_MAGIC) {
 		struct arch_flag target_arch;
 		if (get_arch_from_flag(arch, &target_arch) == 0) {
@@ -57,7 +65,7 @@ MachO_File_Simple::MachO_File_Simple(const char* path, const char* arch) : DataF
 		mp_header = this->read_data<mach_header>();
 	}
 	
-	if (mp_header->magic != MH_MAGIC) {
+	if (mp_header == NULL || mp_header->magic != MH_MAGIC) {
 		m_is_valid = false;
 		return;
 	} else
@@ -67,7 +75,9 @@ MachO_File_Simple::MachO_File_Simple(const char* path, const char* arch) : DataF
 	ma_load_commands.reserve(mp_header->ncmds);
 	
 	for (unsigned i = 0; i < mp_header->ncmds; ++ i) {
-		const load_command* p_cur_cmd = this->peek_data<load_command>();
+		const load_command* p_cur_cmd = this->peek_data_at<load_command>(this->tell());
+		if (p_cur_cmd == NULL || p_cur_cmd->cmdsize < (p_cur_cmd->cmd == LC_SEGMENT ? sizeof(segment_command) : sizeof(load_command)) || this->tell() + static_cast<off_t>(p_cur_cmd->cmdsize) > this->filesize())
+			throw TRException("MachO_File_Simple::MachO_File_Simple(const char*, const char*):\n\tLoad command %u of \"%s\" is truncated.", i, path);
 		ma_load_commands.push_back(p_cur_cmd);
 		
 		if (p_cur_cmd->cmd == LC_SEGMENT) {
@@ -77,8 +87,12 @@ MachO_File_Simple::MachO_File_Simple(const char* path, const char* arch) : DataF
 			const segment_command* p_cur_seg = reinterpret_cast<const segment_command*>(p_cur_cmd);
 			ma_segments.push_back(p_cur_seg);
 			
-			for (unsigned j = 0; j < p_cur_seg->nsects; ++ j)
-				ma_sections.push_back(this->read_data<section>());
+			for (unsigned j = 0; j < p_cur_seg->nsects; ++ j) {
+				const section* p_cur_sect = this->read_data<section>();
+				if (p_cur_sect == NULL)
+					throw TRException("MachO_File_Simple::MachO_File_Simple(const char*, const char*):\n\tSection %u of segment %u of \"%s\" is truncated.", j, i, path);
+				ma_sections.push_back(p_cur_sect);
+			}
 			
 			this->seek(old_location);
 		} else if (p_cur_cmd->cmd == LC_ENCRYPTION_INFO) {
@@ -92,6 +106,105 @@ MachO_File_Simple::MachO_File_Simple(const char* path, const char* arch) : DataF
 		
 		this->advance(p_cur_cmd->cmdsize);
 	}
+	
+	build_section_intervals();
+}
+
+struct SectionIntervalFileComparator {
+	const vector<MachO_File_Simple::SectionInterval>& intervals;
+	SectionIntervalFileComparator(const vector<MachO_File_Simple::SectionInterval>& intervals_) : intervals(intervals_) {}
+	bool operator() (int a, int b) const throw() { return intervals[a].file_begin < intervals[b].file_begin; }
+};
+
+static bool section_interval_vm_less (const MachO_File_Simple::SectionInterval& a, const MachO_File_Simple::SectionInterval& b) throw() {
+	return a.vm_begin < b.vm_begin;
+}
+
+void MachO_File_Simple::build_section_intervals() {
+	ma_section_intervals.reserve(ma_sections.size());
+	
+	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
+		const section* s = *cit;
+		if (s->size == 0)
+			continue;
+		SectionInterval iv;
+		iv.vm_begin = s->addr;
+		iv.vm_end = s->addr + s->size;
+		unsigned sect_type = s->flags & SECTION_TYPE;
+		if (sect_type == S_ZEROFILL || sect_type == S_GB_ZEROFILL) {
+			iv.file_begin = 0;
+			iv.file_end = 0;
+		} else {
+			iv.file_begin = s->offset;
+			iv.file_end = s->offset + s->size;
+		}
+		ma_section_intervals.push_back(iv);
+	}
+	
+	std::stable_sort(ma_section_intervals.begin(), ma_section_intervals.end(), section_interval_vm_less);
+	
+	ma_file_ordered_intervals.reserve(ma_section_intervals.size());
+	for (unsigned i = 0; i < ma_section_intervals.size(); ++ i)
+		if (ma_section_intervals[i].file_end != 0)
+			ma_file_ordered_intervals.push_back(i);
+	
+	std::stable_sort(ma_file_ordered_intervals.begin(), ma_file_ordered_intervals.end(), SectionIntervalFileComparator(ma_section_intervals));
+}
+
+int MachO_File_Simple::interval_index_of_vm_address(unsigned vm_address, int* p_guess_segment) const throw() {
+	int count = static_cast<int>(ma_section_intervals.size());
+	
+	if (p_guess_segment != NULL && *p_guess_segment >= 0 && *p_guess_segment < count) {
+		const SectionInterval& iv = ma_section_intervals[*p_guess_segment];
+		if (iv.vm_begin <= vm_address && iv.vm_end > vm_address)
+			return *p_guess_segment;
+	}
+	
+	// find the last interval starting at or before vm_address.
+	int lo = 0, hi = count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (ma_section_intervals[mid].vm_begin <= vm_address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	if (lo == 0 || ma_section_intervals[lo-1].vm_end <= vm_address)
+		return -1;
+	
+	if (p_guess_segment != NULL)
+		*p_guess_segment = lo-1;
+	return lo-1;
+}
+
+int MachO_File_Simple::interval_index_of_file_offset(unsigned file_offset, int* p_guess_segment) const throw() {
+	int count = static_cast<int>(ma_section_intervals.size());
+	
+	if (p_guess_segment != NULL && *p_guess_segment >= 0 && *p_guess_segment < count) {
+		const SectionInterval& iv = ma_section_intervals[*p_guess_segment];
+		if (iv.file_begin <= file_offset && iv.file_end > file_offset)
+			return *p_guess_segment;
+	}
+	
+	int lo = 0, hi = static_cast<int>(ma_file_ordered_intervals.size());
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (ma_section_intervals[ma_file_ordered_intervals[mid]].file_begin <= file_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	if (lo == 0)
+		return -1;
+	int i = ma_file_ordered_intervals[lo-1];
+	if (ma_section_intervals[i].file_end <= file_offset)
+		return -1;
+	
+	if (p_guess_segment != NULL)
+		*p_guess_segment = i;
+	return i;
 }
 
 off_t MachO_File_Simple::to_file_offset (unsigned vm_address, int* p_guess_segment) const throw() {
@@ -100,24 +213,12 @@ off_t MachO_File_Simple::to_file_offset (unsigned vm_address, int* p_guess_segme
 	if (vm_address == 0)
 		return 0;
 	
-	const section* seg;
-	if (p_guess_segment != NULL) {
-		seg = ma_sections[*p_guess_segment];
-		if (seg->addr <= vm_address && seg->addr + seg->size > vm_address)
-			return m_origin + vm_address - seg->addr + seg->offset;
-	}
+	int i = interval_index_of_vm_address(vm_address, p_guess_segment);
+	if (i < 0)
+		return 0;
 	
-	unsigned i = 0;
-	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
-		seg = *cit;
-		if (seg->addr <= vm_address && seg->addr + seg->size > vm_address) {
-			if (p_guess_segment != NULL)
-				*p_guess_segment = i;
-			return m_origin + vm_address - seg->addr + seg->offset;
-		}
-		++ i;
-	}
-	return 0;
+	const SectionInterval& iv = ma_section_intervals[i];
+	return m_origin + vm_address - iv.vm_begin + iv.file_begin;
 }
 
 unsigned MachO_File_Simple::to_vm_address (off_t file_offset, int* p_guess_segment) const throw() {
@@ -125,31 +226,20 @@ unsigned MachO_File_Simple::to_vm_address (off_t file_offset, int* p_guess_segme
 		return static_cast<unsigned>(file_offset);
 	
 	file_offset -= m_origin;
+	if (file_offset < 0)
+		return 0;
 	
-	const section* seg;
-	if (p_guess_segment != NULL) {
-		seg = ma_sections[*p_guess_segment];
-		if (seg->offset <= static_cast<size_t>(file_offset) && seg->offset + seg->size > static_cast<size_t>(file_offset))
-			return static_cast<unsigned>(file_offset + seg->addr - seg->offset);
-	}
+	int i = interval_index_of_file_offset(static_cast<unsigned>(file_offset), p_guess_segment);
+	if (i < 0)
+		return 0;
 	
-	unsigned i = 0;
-	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
-		seg = *cit;
-		if (seg->offset <= static_cast<size_t>(file_offset) && seg->offset + seg->size > static_cast<size_t>(file_offset)) {
-			if (p_guess_segment != NULL)
-				*p_guess_segment = i;
-			return static_cast<unsigned>(file_offset + seg->addr - seg->offset);
-		}
-		++ i;
-	}
-	return 0;
+	const SectionInterval& iv = ma_section_intervals[i];
+	return static_cast<unsigned>(file_offset + iv.vm_begin - iv.file_begin);
 }
 
 // try to dereference this vm_address.
-unsigned MachO_File_Simple::dereference(unsigned vm_address) const throw() {
-	static int last_deref_section = 0;
-	const unsigned* ptr = this->peek_data_at_vm_address<unsigned>(vm_address, &last_deref_section);
+unsigned MachO_File_Simple::dereference(unsigned vm_address, int* p_guess_segment) const throw() {
+	const unsigned* ptr = this->peek_data_at_vm_address<unsigned>(vm_address, p_guess_segment);
 	if (ptr == NULL)
 		return 0;
 	else
@@ -198,7 +288,9 @@ tr1::unordered_set<string> MachO_File_Simple::linked_libraries_recursive(const s
 	tr1::unordered_set<string> retval (first_level.begin(), first_level.end());
 
 	while (first_level.size() > 0) {
-		vector<string> second_level = MachO_File_Simple(first_level.back().c_str()).linked_libraries(sysroot);
+		ImageHandle<MachO_File_Simple> library = ImageCache::shared().open<MachO_File_Simple>(first_level.back().c_str(), "any", "MachO_File_Simple");
+		first_level.pop_back();
+		vector<string> second_level = library->linked_libraries(sysroot);
 		
 		for (vector<string>::const_iterator cit = second_level.begin(); cit != second_level.end(); ++ cit) {
 			tr1::unordered_set<string>::const_iterator rv_cit = retval.find(*cit);
@@ -224,192 +316,60 @@ const char* MachO_File_Simple::self_path() const throw() {
 	return NULL;
 }
 
-//------------------------------------------------------------------------------
+const unsigned char* MachO_File_Simple::uuid() const throw() {
+	if (m_is_valid) {
+		for (vector<const load_command*>::const_iterator cit = ma_load_commands.begin(); cit != ma_load_commands.end(); ++ cit)
+			if ((*cit)->cmd == LC_UUID)
+				return reinterpret_cast<const uuid_command*>(*cit)->uuid;
+	}
+	return NULL;
+}
 
-static void fprint_with_escape (FILE* stream, const char* s) {
-	while (true) {
-		switch (*s) {
-			case '\0': return;
-			case '\t': fputs("\\t", stream); break;
-			case '\n': fputs("\\n", stream); break;
-			case '\\': fputs("\\\\", stream); break;
-			case '"': fputs("\\\"", stream); break;
-			case '\a': fputs("\\a", stream); break;
-			case '\b': fputs("\\b", stream); break;
-			case '\f': fputs("\\f", stream); break;
-			case '\r': fputs("\\r", stream); break;
-			case '\v': fputs("\\v", stream); break;
-			default:
-				if (*s < ' ' || *s > '~')
-					fprintf(stream, "\\x%02x", (unsigned char)*s);
-				else
-					fputc(*s, stream);
-				break;
+string MachO_File_Simple::cache_key(const char* path) const {
+	char buffer[64];
+	string key;
+	const unsigned char* p_uuid = this->uuid();
+	if (p_uuid != NULL) {
+		key = "uuid:";
+		for (unsigned i = 0; i < 16; ++ i) {
+			snprintf(buffer, sizeof(buffer), "%02x", p_uuid[i]);
+			key += buffer;
 		}
-		++ s;
+	} else {
+		struct stat file_stat;
+		fstat(m_fd, &file_stat);
+		key = "file:" + AnalysisCache::absolute_path(path);
+		snprintf(buffer, sizeof(buffer), ":%llx:%lx:%llx", static_cast<unsigned long long>(file_stat.st_size), static_cast<unsigned long>(file_stat.st_mtime), static_cast<unsigned long long>(m_origin));
+		key += buffer;
 	}
+	return key;
 }
 
+//------------------------------------------------------------------------------
+
 // static bool nlist_compare(const struct nlist* a, const struct nlist* b) { return a->n_value < b->n_value; }
 static const char* print_string_representation_format_strings_prefix[] = {"", "CFSTR(\"", "\"", "@selector(", "(Class)", "@protocol(", "/*ivar*/"};
 static const char* print_string_representation_format_strings_suffix[] = {"", "\")", "\"", ")", "", ")", ""};
 
-#define PRINT_BIND_OPCODE(...) //printf(__VA_ARGS__)
-
-void MachO_File::bind(uint32_t size) throw() {
-	unsigned libord = 0;
-	const char* sym = NULL;
-	unsigned addr = 0;
+MachO_File::MachO_File(const char* path, const char* arch) : MachO_File_Simple(path, arch), ma_symbols(NULL), m_symbols_length(0), ma_indirect_symbols(NULL), m_indirect_symbols_length(0), ma_strings(NULL), ma_cstrings(NULL), m_cstring_vmaddr(0), m_cstring_table_size(0), ma_relocations(NULL), m_relocations_length(0), mp_dyld_info(NULL), m_prepared_tables(0), m_dyld_info_decoder(ma_segments), m_export_base(0) {
+	if (AnalysisCache::directory() != NULL && m_is_valid)
+		m_cache_key = this->cache_key(path);
 	
-	off_t end = this->tell() + size;
-	
-	while (this->tell() < end) {
-		unsigned char c = static_cast<unsigned char>(this->read_char());
-		
-		uint8_t imm = c & BIND_IMMEDIATE_MASK, opcode = c & BIND_OPCODE_MASK;
-		
-		switch (opcode) {
-			case BIND_OPCODE_DONE:	// 0x
-				PRINT_BIND_OPCODE("Done.\n");
-				break;
-				
-			case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:	// 1x
-				PRINT_BIND_OPCODE("SetDylibOrdinalIMM(%d).\n", imm);
-				libord = imm;
-				break;
-				
-			case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:	// 2x
-				libord = this->read_uleb128<unsigned>();
-				PRINT_BIND_OPCODE("SetDylibOrdinalULEB(%d).\n", libord);
-				break;
-				
-			case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM: {	// 3x
-				int8_t immx = BIND_OPCODE_MASK|imm;
-				libord = imm ? immx : 0;
-				PRINT_BIND_OPCODE("SetDylibSpecialIMM(%d).\n", libord);
-				break;
-			}
-				
-			case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM:	// 4x
-				sym = this->read_string();
-				PRINT_BIND_OPCODE("SetSymbolTrailingFlagsIMM(%s).\n", sym);
-				break;
-				
-			case BIND_OPCODE_SET_TYPE_IMM:	// 5x.
-				PRINT_BIND_OPCODE("SetTypeIMM(%d).\n", imm);
-				break;
-				
-				// seems to do nothing?
-			case BIND_OPCODE_SET_ADDEND_SLEB:	// 6x.
-				this->read_sleb128<int>();
-				PRINT_BIND_OPCODE("SetAddend(...).\n");
-				break;
-				
-			case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:	// 7x
-				addr = ma_segments[imm]->vmaddr + this->read_uleb128<unsigned>();
-				PRINT_BIND_OPCODE("SetSegmentAndOffsetULEB(%d -> %x).\n", imm, addr);
-				break;
-			
-			case BIND_OPCODE_ADD_ADDR_ULEB:	// 8x
-				addr += this->read_uleb128<unsigned>();
-				PRINT_BIND_OPCODE("AddAddrULEB(-> %x).\n", addr);
-				break;
-				
-			case BIND_OPCODE_DO_BIND:	// 9x
-				ma_symbol_references.insert(std::pair<unsigned, const char*>(addr, sym));
-				ma_library_ordinals.insert(std::pair<unsigned, unsigned>(addr, libord));
-				addr += sizeof(void*);
-				PRINT_BIND_OPCODE("DoBind(-> %x).\n", addr);
-				break;
-				
-			case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:	// Ax
-				ma_symbol_references.insert(std::pair<unsigned, const char*>(addr, sym));
-				ma_library_ordinals.insert(std::pair<unsigned, unsigned>(addr, libord));
-				addr += sizeof(void*) + this->read_uleb128<unsigned>();
-				PRINT_BIND_OPCODE("DoBindAddAddrULEB(-> %x).\n", addr);
-				break;
-				
-			case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:	// Bx
-				ma_symbol_references.insert(std::pair<unsigned, const char*>(addr, sym));
-				ma_library_ordinals.insert(std::pair<unsigned, unsigned>(addr, libord));
-				addr += (imm+1)*sizeof(void*);
-				PRINT_BIND_OPCODE("DoBindAddAddrIMMScaled(%d -> %x).\n", imm, addr);
-				break;
-				
-			case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB: {	// Cx
-				unsigned count = this->read_uleb128<unsigned>();
-				unsigned skip = this->read_uleb128<unsigned>();
-				for (unsigned i = 0; i < count; ++ i) {
-					ma_symbol_references.insert(std::pair<unsigned, const char*>(addr, sym));
-					ma_library_ordinals.insert(std::pair<unsigned, unsigned>(addr, libord));
-					addr += skip + sizeof(void*);
-				}
-				PRINT_BIND_OPCODE("DoBindULEBTimesSkippingULEB(%d, %d -> %x).\n", count, skip, addr);
-				break;
-			}
-				
-			default:
-				// throw???
-				break;
-		}
-	}
-}
-
-void MachO_File::process_export_trie_node(off_t start, off_t cur, off_t end, const std::string& prefix) {
-	if (cur < end) {
-		this->seek(cur);
-		unsigned char term_size = static_cast<unsigned char>(this->read_char());
-		if (term_size != 0) {
-			ma_string_store.push_back(prefix);
-			const char* sym = ma_string_store.back().c_str();
-			/*unsigned flags =*/ this->read_uleb128<unsigned>();
-			unsigned addr = this->read_uleb128<unsigned>();
-			ma_symbol_references.insert(std::pair<unsigned, const char*>(addr, sym));
-			ma_is_external_symbol.insert(addr);
-		}
-		this->seek(cur + term_size);
-		unsigned char child_count = static_cast<unsigned char>(this->read_char());
-		off_t last_pos;
-		for (unsigned char i = 0; i < child_count; ++ i) {
-			const char* suffix = this->read_string();
-			unsigned offset = this->read_uleb128<unsigned>();
-			last_pos = this->tell();
-			process_export_trie_node(start, start + offset, end, prefix + suffix);
-			this->seek(last_pos);
-		}
-	}
-}
-
-MachO_File::MachO_File(const char* path, const char* arch) : MachO_File_Simple(path, arch), ma_symbols(NULL), m_symbols_length(0), ma_indirect_symbols(NULL), m_indirect_symbols_length(0), ma_strings(NULL), ma_cstrings(NULL), m_cstring_vmaddr(0), m_relocations_length(0) {
+	// only locate the tables here. The derived tables are built on first use, see prepare().
 	bool ignore_dysymtab = false;
 	for (vector<const load_command*>::const_iterator cit = ma_load_commands.begin(); cit != ma_load_commands.end(); ++ cit) {
 		switch ((*cit)->cmd) {
 			case LC_DYLD_INFO:
-			case LC_DYLD_INFO_ONLY: {
-				const dyld_info_command* p_cur_dyld_info = reinterpret_cast<const dyld_info_command*>(*cit);
-				
-				if (p_cur_dyld_info->bind_size != 0) {
-					this->seek(m_origin + p_cur_dyld_info->bind_off);
-					bind(p_cur_dyld_info->bind_size);
-				}
-				
-				if (p_cur_dyld_info->weak_bind_size != 0) {
-					this->seek(m_origin + p_cur_dyld_info->weak_bind_off);
-					bind(p_cur_dyld_info->weak_bind_size);
-				}
-				
-				if (p_cur_dyld_info->lazy_bind_size != 0) {
-					this->seek(m_origin + p_cur_dyld_info->lazy_bind_off);
-					bind(p_cur_dyld_info->lazy_bind_size);
-				}
-				
-				if (p_cur_dyld_info->export_size != 0) {
-					off_t start = m_origin + p_cur_dyld_info->export_off;
-					process_export_trie_node(start, start, start + p_cur_dyld_info->export_size, "");
+			case LC_DYLD_INFO_ONLY:
+				mp_dyld_info = reinterpret_cast<const dyld_info_command*>(*cit);
+				if (mp_dyld_info->export_size != 0 && m_origin + mp_dyld_info->export_off + mp_dyld_info->export_size <= m_filesize) {
+					m_export_trie = ExportTrie(m_data + m_origin + mp_dyld_info->export_off, mp_dyld_info->export_size);
+					int text_segment_index = this->segment_index_having_name("__TEXT");
+					if (text_segment_index >= 0)
+						m_export_base = ma_segments[text_segment_index]->vmaddr;
 				}
-				
 				ignore_dysymtab = true;
-			}
+				break;
 				
 			case LC_SYMTAB: {
 				const symtab_command* p_cur_symtab = reinterpret_cast<const symtab_command*>(*cit);
@@ -445,108 +405,328 @@ MachO_File::MachO_File(const char* path, const char* arch) : MachO_File_Simple(p
 				break;
 		}
 	}
-		
+	
+	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
+		const section* s = *cit;
+		if ((s->flags & SECTION_TYPE) == S_CSTRING_LITERALS && !file_offset_encrypted(s->offset)) {
+			this->seek(m_origin + s->offset);
+			ma_cstrings = this->peek_data<char>();
+			m_cstring_vmaddr = s->addr;
+			m_cstring_table_size = s->size;
+		}
+	}
+}
+
+void MachO_File::prepare(unsigned tables) const {
+	unsigned missing = tables & ~m_prepared_tables;
+	if (missing == 0)
+		return;
+	
+	// the tables are caches of the file content, so building them does not change the logical state.
+	MachO_File* self = const_cast<MachO_File*>(this);
+	off_t old_location = self->tell();
+	
+	bool should_write_cache = false;
+	if ((missing & MOT_Cached) && !m_cache_key.empty()) {
+		if (self->read_table_cache()) {
+			self->m_prepared_tables |= MOT_Cached;
+			missing &= ~MOT_Cached;
+		} else {
+			missing |= MOT_Cached & ~m_prepared_tables;
+			should_write_cache = true;
+		}
+	}
+	
+	// the bind records are needed for the symbol table.
+	if (missing & MOT_Symbols)
+		missing |= MOT_DyldInfo & ~m_prepared_tables;
+	
+	if (missing & MOT_DyldInfo)
+		self->build_dyld_info_tables();
+	if (missing & MOT_Symbols)
+		self->build_symbol_tables();
+	if (missing & MOT_CFStrings)
+		self->build_cfstring_table();
+	if (missing & MOT_ObjCClasses)
+		self->build_objc_class_table();
+	if (missing & MOT_ObjCSelectors)
+		self->build_objc_selector_table();
+	
+	self->m_symbol_index.freeze();
+	self->m_prepared_tables |= missing;
+	self->seek(old_location);
+	
+	if (should_write_cache)
+		this->write_table_cache();
+}
+
+struct LibraryOrdinalComparator {
+	bool operator() (const pair<unsigned,unsigned>& a, const pair<unsigned,unsigned>& b) const throw() { return a.first < b.first; }
+	bool operator() (const pair<unsigned,unsigned>& a, unsigned b) const throw() { return a.first < b; }
+	bool operator() (unsigned a, const pair<unsigned,unsigned>& b) const throw() { return a < b.first; }
+};
+
+struct LibraryOrdinalAddressEqual {
+	bool operator() (const pair<unsigned,unsigned>& a, const pair<unsigned,unsigned>& b) const throw() { return a.first == b.first; }
+};
+
+void MachO_File::build_dyld_info_tables() {
+	if (mp_dyld_info == NULL)
+		return;
+	
+	const DyldInfoDecoder::BindKind kinds[] = {DyldInfoDecoder::BK_Regular, DyldInfoDecoder::BK_Weak, DyldInfoDecoder::BK_Lazy};
+	const uint32_t offsets[] = {mp_dyld_info->bind_off, mp_dyld_info->weak_bind_off, mp_dyld_info->lazy_bind_off};
+	const uint32_t sizes[] = {mp_dyld_info->bind_size, mp_dyld_info->weak_bind_size, mp_dyld_info->lazy_bind_size};
+	for (unsigned k = 0; k < 3; ++ k)
+		if (sizes[k] != 0 && m_origin + offsets[k] + sizes[k] <= m_filesize)
+			m_dyld_info_decoder.decode_binds(m_data + m_origin + offsets[k], sizes[k], kinds[k]);
+	
+	if (mp_dyld_info->rebase_size != 0 && m_origin + mp_dyld_info->rebase_off + mp_dyld_info->rebase_size <= m_filesize) {
+		m_dyld_info_decoder.decode_rebases(m_data + m_origin + mp_dyld_info->rebase_off, mp_dyld_info->rebase_size);
+		m_dyld_info_decoder.sort_rebases();
+	}
+}
+
+void MachO_File::build_symbol_tables() {
+	const vector<DyldInfoDecoder::BindRecord>& binds = m_dyld_info_decoder.binds();
+	ma_library_ordinals.reserve(binds.size());
+	for (vector<DyldInfoDecoder::BindRecord>::const_iterator cit = binds.begin(); cit != binds.end(); ++ cit) {
+		m_symbol_index.add(cit->address, m_dyld_info_decoder.symbol_name(cit->symbol), MOST_Symbol, false);
+		ma_library_ordinals.push_back(pair<unsigned,unsigned>(cit->address, static_cast<unsigned>(cit->ordinal)));
+	}
+	
+	// re-exports have no address in this image.
+	for (ExportTrie::Iterator it (m_export_trie); it.next(); ) {
+		const ExportTrie::Entry& entry = it.entry();
+		if (entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT)
+			continue;
+		unsigned address = this->export_vm_address(entry);
+		m_symbol_index.add(address, m_string_arena.intern(entry.name, entry.name_length), MOST_Symbol, false);
+		ma_external_symbols.push_back(address);
+	}
+	
 	for (unsigned i = 0; i < m_symbols_length; ++ i) {
-		ma_symbol_references[ma_symbols[i].n_value & ~1] = ma_strings + ma_symbols[i].n_un.n_strx;
+		m_symbol_index.add(ma_symbols[i].n_value & ~1, ma_strings + ma_symbols[i].n_un.n_strx, MOST_Symbol, true);
 		if (ma_symbols[i].n_type & N_EXT) {
-			ma_is_external_symbol.insert(ma_symbols[i].n_value & ~1);
-			ma_library_ordinals.insert(pair<unsigned,unsigned>(ma_symbols[i].n_value & ~1, GET_LIBRARY_ORDINAL(ma_symbols[i].n_desc)));
+			ma_external_symbols.push_back(ma_symbols[i].n_value & ~1);
+			ma_library_ordinals.push_back(pair<unsigned,unsigned>(ma_symbols[i].n_value & ~1, GET_LIBRARY_ORDINAL(ma_symbols[i].n_desc)));
 		}
 	}
 	
 	if (ma_symbols) {
 		for (unsigned i = 0; i < m_relocations_length; ++ i) {
-			ma_symbol_references[ma_relocations[i].r_address & ~1] = ma_strings + ma_symbols[ma_relocations[i].r_symbolnum].n_un.n_strx;
-			ma_library_ordinals.insert(pair<unsigned,unsigned>(ma_relocations[i].r_address & ~1, GET_LIBRARY_ORDINAL(ma_symbols[ma_relocations[i].r_symbolnum].n_desc)));
+			m_symbol_index.add(ma_relocations[i].r_address & ~1, ma_strings + ma_symbols[ma_relocations[i].r_symbolnum].n_un.n_strx, MOST_Symbol, true);
+			ma_library_ordinals.push_back(pair<unsigned,unsigned>(ma_relocations[i].r_address & ~1, GET_LIBRARY_ORDINAL(ma_symbols[ma_relocations[i].r_symbolnum].n_desc)));
 		}
 	}
 	
-	// analyze the sections (to short-cut the indirect symbols)
-	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
-		const section* s = *cit;
-		if (file_offset_encrypted(s->offset))
-			continue;
-		
-		unsigned sect_type = s->flags & SECTION_TYPE;
-		switch (sect_type) {
-			case S_NON_LAZY_SYMBOL_POINTERS:
-			case S_LAZY_SYMBOL_POINTERS:
-			case S_SYMBOL_STUBS: {
+	sort(ma_external_symbols.begin(), ma_external_symbols.end());
+	ma_external_symbols.erase(unique(ma_external_symbols.begin(), ma_external_symbols.end()), ma_external_symbols.end());
+	
+	stable_sort(ma_library_ordinals.begin(), ma_library_ordinals.end(), LibraryOrdinalComparator());
+	ma_library_ordinals.erase(unique(ma_library_ordinals.begin(), ma_library_ordinals.end(), LibraryOrdinalAddressEqual()), ma_library_ordinals.end());
+	
+	// short-cut the indirect symbols.
+	if (ma_symbols && ma_indirect_symbols) {
+		for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
+			const section* s = *cit;
+			if (file_offset_encrypted(s->offset))
+				continue;
+			
+			unsigned sect_type = s->flags & SECTION_TYPE;
+			if (sect_type == S_NON_LAZY_SYMBOL_POINTERS || sect_type == S_LAZY_SYMBOL_POINTERS || sect_type == S_SYMBOL_STUBS) {
 				unsigned stride = s->reserved2 ? s->reserved2 : 4;
 				unsigned end_index = s->reserved1 + s->size/stride;
 				
-				if (ma_symbols && ma_indirect_symbols)
-					for (unsigned i = s->reserved1, vm_address = s->addr; i < end_index; ++ i, vm_address += stride)
-						ma_symbol_references[vm_address & ~1] = ma_strings + ma_symbols[ma_indirect_symbols[i]].n_un.n_strx;
-				
-				break;
+				for (unsigned i = s->reserved1, vm_address = s->addr; i < end_index; ++ i, vm_address += stride)
+					m_symbol_index.add(vm_address & ~1, ma_strings + ma_symbols[ma_indirect_symbols[i]].n_un.n_strx, MOST_Symbol, true);
 			}
-				
-			case S_CSTRING_LITERALS:
-				this->seek(m_origin + s->offset);
-				ma_cstrings = this->peek_data<char>();
-				m_cstring_vmaddr = s->addr;
-				m_cstring_table_size = s->size;
-				break;
-				
-			default:
-				if (!strncmp(s->sectname, "__cfstring", 16)) {
-					this->seek(m_origin + s->offset + 8);
-					for (unsigned i = 0; i < s->size; i += 16) {
-						unsigned vm_address = this->read_integer();
-						this->advance(12);
-						
-						ma_cfstrings[s->addr + i] = ma_cstrings + vm_address - m_cstring_vmaddr;
-					}
-				} else if (!strncmp(s->sectname, "__class_list", 16) || !strncmp(s->sectname, "__objc_classlist", 16)) {
-					int sid_data = 1, sid_text = 0;
-					this->seek(m_origin + s->offset);
-					for (unsigned i = 0; i < s->size; i += 4) {
-						unsigned vm_address = this->read_integer();
-						off_t old_location = this->tell();
-
-						this->seek_vm_address(vm_address + 16, &sid_data);		// get to the data field class.
-						unsigned data_loc = this->read_integer();
-
-						this->seek_vm_address(data_loc, &sid_data);		// get to the name field of the data.
-						unsigned flag = this->read_integer();
-						this->advance(12);
-						this->seek_vm_address(this->read_integer(), &sid_text);	// resolve the location of the string.
-						
-						ObjCMethod m;
-						m.is_class_method = flag & 1;
-						m.class_name = this->peek_data<char>();
-						ma_objc_classes[vm_address] = m.class_name;
-						
-						this->seek_vm_address(data_loc + 20, &sid_data);		// get to the baseMethod field of the data.
-						unsigned baseMethod_loc = this->read_integer();
-						if (baseMethod_loc != 0) {
-							this->seek_vm_address(baseMethod_loc + 4, &sid_data);	// get to the count field of the data.
-							unsigned count = this->read_integer();
-								
-							for (unsigned j = 0; j < count; ++ j) {
-								m.sel_name = this->peek_data_at_vm_address<char>(this->read_integer(), &sid_text);
-								m.types = this->peek_data_at_vm_address<char>(this->read_integer(), &sid_text);
-								ma_objc_methods[this->read_integer() & ~1] = m;
-							}
-						}
-						
-						this->seek(old_location);
-					}
-				} else if (!strncmp(s->sectname, "__objc_selrefs", 16)) {
-					this->seek(m_origin + s->offset);
+		}
+	}
+}
+
+void MachO_File::build_cfstring_table() {
+	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
+		const section* s = *cit;
+		if (file_offset_encrypted(s->offset) || strncmp(s->sectname, "__cfstring", 16))
+			continue;
+		
+		this->seek(m_origin + s->offset + 8);
+		for (unsigned i = 0; i < s->size; i += 16) {
+			unsigned vm_address = this->read_integer();
+			this->advance(12);
+			
+			m_symbol_index.add(s->addr + i, ma_cstrings + vm_address - m_cstring_vmaddr, MOST_CFString, true);
+		}
+	}
+}
+
+void MachO_File::build_objc_class_table() {
+	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
+		const section* s = *cit;
+		if (file_offset_encrypted(s->offset) || (strncmp(s->sectname, "__class_list", 16) && strncmp(s->sectname, "__objc_classlist", 16)))
+			continue;
+		
+		int sid_data = 1, sid_text = 0;
+		this->seek(m_origin + s->offset);
+		for (unsigned i = 0; i < s->size; i += 4) {
+			unsigned vm_address = this->read_integer();
+			off_t old_location = this->tell();
+
+			this->seek_vm_address(vm_address + 16, &sid_data);		// get to the data field class.
+			unsigned data_loc = this->read_integer();
+
+			this->seek_vm_address(data_loc, &sid_data);		// get to the name field of the data.
+			unsigned flag = this->read_integer();
+			this->advance(12);
+			this->seek_vm_address(this->read_integer(), &sid_text);	// resolve the location of the string.
+			
+			ObjCMethod m;
+			m.is_class_method = flag & 1;
+			m.class_name = this->peek_data<char>();
+			m_symbol_index.add(vm_address, m.class_name, MOST_ObjCClass, true);
+			
+			this->seek_vm_address(data_loc + 20, &sid_data);		// get to the baseMethod field of the data.
+			unsigned baseMethod_loc = this->read_integer();
+			if (baseMethod_loc != 0) {
+				this->seek_vm_address(baseMethod_loc + 4, &sid_data);	// get to the count field of the data.
+				unsigned count = this->read_integer();
 					
-					for (unsigned i = 0; i < s->size; i += 4) {
-						unsigned vm_address = this->read_integer();
-						ma_objc_selectors[vm_address] = this->peek_data_at_vm_address<char>(vm_address);
-					}
+				for (unsigned j = 0; j < count; ++ j) {
+					m.sel_name = this->peek_data_at_vm_address<char>(this->read_integer(), &sid_text);
+					m.types = this->peek_data_at_vm_address<char>(this->read_integer(), &sid_text);
+					m_symbol_index.add(this->read_integer() & ~1, m.sel_name, MOST_ObjCMethod, true, ma_objc_methods.size());
+					ma_objc_methods.push_back(m);
 				}
-				
-				break;
+			}
+			
+			this->seek(old_location);
 		}
 	}
 }
+
+void MachO_File::build_objc_selector_table() {
+	for (vector<const section*>::const_iterator cit = ma_sections.begin(); cit != ma_sections.end(); ++ cit) {
+		const section* s = *cit;
+		if (file_offset_encrypted(s->offset) || strncmp(s->sectname, "__objc_selrefs", 16))
+			continue;
 		
+		this->seek(m_origin + s->offset);
+		for (unsigned i = 0; i < s->size; i += 4) {
+			unsigned vm_address = this->read_integer();
+			m_symbol_index.add(vm_address, this->peek_data_at_vm_address<char>(vm_address), MOST_ObjCSelector, true);
+		}
+	}
+}
+		
+MachO_File::~MachO_File() throw() {
+	for (vector<AnalysisCacheReader*>::iterator it = ma_cache_readers.begin(); it != ma_cache_readers.end(); ++ it)
+		delete *it;
+}
+
+#pragma mark -
+
+struct CachedSymbolEntry {
+	unsigned address;
+	unsigned type;
+	unsigned extra;
+	const char* name;
+};
+
+// Layout: symbol index entries, ObjC methods, external symbols, library ordinals. Each part starts with its count.
+bool MachO_File::read_table_cache() {
+	AnalysisCacheReader* reader = new AnalysisCacheReader(m_cache_key + "#tables");
+	
+	vector<CachedSymbolEntry> symbols;
+	unsigned count = reader->read_uint();
+	if (reader->can_read(count))
+		symbols.reserve(count);
+	for (unsigned i = 0; i < count && reader->valid(); ++ i) {
+		CachedSymbolEntry entry;
+		entry.address = reader->read_uint();
+		entry.type = reader->read_uint();
+		entry.extra = reader->read_uint();
+		entry.name = reader->read_string();
+		symbols.push_back(entry);
+	}
+	
+	vector<ObjCMethod> methods;
+	count = reader->read_uint();
+	if (reader->can_read(count))
+		methods.reserve(count);
+	for (unsigned i = 0; i < count && reader->valid(); ++ i) {
+		ObjCMethod m;
+		m.class_name = reader->read_string();
+		m.sel_name = reader->read_string();
+		m.types = reader->read_string();
+		m.is_class_method = reader->read_uint() != 0;
+		methods.push_back(m);
+	}
+	
+	vector<unsigned> external_symbols;
+	count = reader->read_uint();
+	if (reader->can_read(count))
+		external_symbols.reserve(count);
+	for (unsigned i = 0; i < count && reader->valid(); ++ i)
+		external_symbols.push_back(reader->read_uint());
+	
+	vector<pair<unsigned,unsigned> > library_ordinals;
+	count = reader->read_uint();
+	if (reader->can_read(count))
+		library_ordinals.reserve(count);
+	for (unsigned i = 0; i < count && reader->valid(); ++ i) {
+		unsigned address = reader->read_uint();
+		library_ordinals.push_back(pair<unsigned,unsigned>(address, reader->read_uint()));
+	}
+	
+	if (!reader->finished()) {
+		delete reader;
+		return false;
+	}
+	
+	for (vector<CachedSymbolEntry>::const_iterator cit = symbols.begin(); cit != symbols.end(); ++ cit)
+		m_symbol_index.add(cit->address, cit->name, static_cast<unsigned char>(cit->type), false, cit->extra);
+	ma_objc_methods.swap(methods);
+	ma_external_symbols.swap(external_symbols);
+	ma_library_ordinals.swap(library_ordinals);
+	ma_cache_readers.push_back(reader);
+	return true;
+}
+
+void MachO_File::write_table_cache() const {
+	AnalysisCacheWriter writer;
+	
+	writer.write_uint(static_cast<unsigned>(m_symbol_index.size()));
+	for (size_t i = 0; i < m_symbol_index.size(); ++ i) {
+		writer.write_uint(m_symbol_index.address(i));
+		writer.write_uint(m_symbol_index.type(i));
+		writer.write_uint(m_symbol_index.extra(i));
+		writer.write_string(m_symbol_index.name(i));
+	}
+	
+	writer.write_uint(static_cast<unsigned>(ma_objc_methods.size()));
+	for (vector<ObjCMethod>::const_iterator cit = ma_objc_methods.begin(); cit != ma_objc_methods.end(); ++ cit) {
+		writer.write_string(cit->class_name);
+		writer.write_string(cit->sel_name);
+		writer.write_string(cit->types);
+		writer.write_uint(cit->is_class_method);
+	}
+	
+	writer.write_uint(static_cast<unsigned>(ma_external_symbols.size()));
+	for (vector<unsigned>::const_iterator cit = ma_external_symbols.begin(); cit != ma_external_symbols.end(); ++ cit)
+		writer.write_uint(*cit);
+	
+	writer.write_uint(static_cast<unsigned>(ma_library_ordinals.size()));
+	for (vector<pair<unsigned,unsigned> >::const_iterator cit = ma_library_ordinals.begin(); cit != ma_library_ordinals.end(); ++ cit) {
+		writer.write_uint(cit->first);
+		writer.write_uint(cit->second);
+	}
+	
+	writer.save(m_cache_key + "#tables");
+}
+
+#pragma mark -
+
 // try to obtain a string related to this vm_address.
 const char* MachO_File::string_representation (unsigned vm_address, MachO_File::StringType* p_strtype) const throw() {
 	if (!m_is_valid) {
@@ -558,21 +738,21 @@ const char* MachO_File::string_representation (unsigned vm_address, MachO_File::
 	if (vm_address == 0)
 		return NULL;
 	
-	tr1::unordered_map<unsigned,const char*>::const_iterator cit;
+	this->prepare(MOT_Symbols | MOT_CFStrings | MOT_ObjCClasses | MOT_ObjCSelectors);
 	
-#define TrySearchIn(table, stringType) \
-	cit = (table).find(vm_address); \
-	if (cit != (table).end()) { \
-		if (p_strtype != NULL) *p_strtype = (stringType); \
-		return cit->second; \
-	}
+	// more than one kind of string may share an address. Prefer them in this order.
+	static const StringType preferences[] = {MOST_CFString, MOST_Symbol, MOST_ObjCClass, MOST_ObjCSelector};
 	
-	TrySearchIn(ma_cfstrings, MOST_CFString);
-	TrySearchIn(ma_symbol_references, MOST_Symbol);
-	TrySearchIn(ma_objc_classes, MOST_ObjCClass);
-	TrySearchIn(ma_objc_selectors, MOST_ObjCSelector);
-	
-#undef TrySearchIn
+	size_t first = m_symbol_index.lower_bound(vm_address);
+	for (unsigned p = 0; p < sizeof(preferences)/sizeof(preferences[0]); ++ p) {
+		for (size_t i = first; i < m_symbol_index.size() && m_symbol_index.address(i) == vm_address; ++ i) {
+			if (m_symbol_index.type(i) == preferences[p]) {
+				if (p_strtype != NULL)
+					*p_strtype = preferences[p];
+				return m_symbol_index.name(i);
+			}
+		}
+	}
 	
 	if (m_cstring_vmaddr <= vm_address && m_cstring_vmaddr+m_cstring_table_size >= vm_address) {
 		if (p_strtype != NULL)
@@ -592,25 +772,10 @@ const char* MachO_File::nearest_string_representation (unsigned vm_address, unsi
 		return this->peek_data_at<char>(vm_address);
 	}
 	
-	tr1::unordered_map<unsigned, const char*>::const_iterator cit, best_iter;
-	bool first = true;
-	
-#define TrySearchIn(table, stringType) \
-	for (cit = (table).begin(); cit != (table).end(); ++ cit) \
-		if (cit->first > vm_address) { \
-			if (first || best_iter->first > cit->first) { \
-				first = false; \
-				best_iter = cit; \
-				if (p_strtype != NULL) *p_strtype = (stringType); \
-			} \
-		}
-	
-	// TrySearchIn(ma_cfstrings, MOST_CFString);
-	TrySearchIn(ma_symbol_references, MOST_Symbol);
-	// TrySearchIn(ma_objc_classes, MOST_ObjCClass);
-	// TrySearchIn(ma_objc_selectors, MOST_ObjCSelector);
+	this->prepare(MOT_Symbols);
+	size_t best = m_symbol_index.find_next(vm_address, MOST_Symbol);
 	
-	if (first) {
+	if (best == SymbolIndex::npos) {
 		if (m_cstring_vmaddr <= vm_address && m_cstring_vmaddr+m_cstring_table_size >= vm_address) {
 			if (p_strtype != NULL)
 				*p_strtype = MOST_CString;
@@ -620,32 +785,36 @@ const char* MachO_File::nearest_string_representation (unsigned vm_address, unsi
 		} else
 			return NULL;
 	} else {
+		if (p_strtype != NULL)
+			*p_strtype = MOST_Symbol;
 		if (offset != NULL)
-			*offset = best_iter->first - vm_address;
-		return best_iter->second;
+			*offset = m_symbol_index.address(best) - vm_address;
+		return m_symbol_index.name(best);
 	}
 }
 	
-void MachO_File::print_string_representation(FILE* stream, const char* str, MachO_File::StringType strtype) throw() {
-	fputs(print_string_representation_format_strings_prefix[strtype], stream);
-	fprint_with_escape(stream, str);
-	fputs(print_string_representation_format_strings_suffix[strtype], stream);		
+void MachO_File::print_string_representation(OutputWriter& output, const char* str, MachO_File::StringType strtype) throw() {
+	output.write(print_string_representation_format_strings_prefix[strtype]);
+	output.write_escaped(str);
+	output.write(print_string_representation_format_strings_suffix[strtype]);
 }
 
 const MachO_File::ObjCMethod* MachO_File::objc_method_at_vm_address(unsigned vm_address) const throw() {
 	if (m_is_valid) {
-		tr1::unordered_map<unsigned,MachO_File::ObjCMethod>::const_iterator cit = ma_objc_methods.find(vm_address);
-		if (cit == ma_objc_methods.end())
+		this->prepare(MOT_ObjCClasses);
+		size_t i = m_symbol_index.find(vm_address, MOST_ObjCMethod);
+		if (i == SymbolIndex::npos)
 			return NULL;
 		else
-			return &(cit->second);
+			return &ma_objc_methods[m_symbol_index.extra(i)];
 	} else
 		return NULL;
 }
 
 const char* MachO_File::library_of_relocated_symbol(unsigned vm_address) const throw() {
-	tr1::unordered_map<unsigned,unsigned>::const_iterator lit = ma_library_ordinals.find(vm_address & ~1);
-	if (lit == ma_library_ordinals.end())
+	this->prepare(MOT_Symbols);
+	vector<pair<unsigned,unsigned> >::const_iterator lit = lower_bound(ma_library_ordinals.begin(), ma_library_ordinals.end(), vm_address & ~1, LibraryOrdinalComparator());
+	if (lit == ma_library_ordinals.end() || lit->first != (vm_address & ~1))
 		return NULL;
 
 	unsigned cur_ordinal = lit->second;
@@ -665,35 +834,41 @@ const char* MachO_File::library_of_relocated_symbol(unsigned vm_address) const t
 }
 
 void MachO_File::for_each_symbol (void(*p_func)(unsigned addr, const char* symbol, StringType type, void* context), void* context) const {
-	std::tr1::unordered_map<unsigned,const char*>::const_iterator cit;
-	
-	for (cit = ma_symbol_references.begin(); cit != ma_symbol_references.end(); ++ cit)
-		p_func(cit->first, cit->second, MOST_Symbol, context);
-	
-	for (cit = ma_cfstrings.begin(); cit != ma_cfstrings.end(); ++ cit)
-		p_func(cit->first, cit->second, MOST_CFString, context);
-	
-	for (cit = ma_objc_classes.begin(); cit != ma_objc_classes.end(); ++ cit)
-		p_func(cit->first, cit->second, MOST_ObjCClass, context);
-	
-	for (cit = ma_objc_selectors.begin(); cit != ma_objc_selectors.end(); ++ cit)
-		p_func(cit->first, cit->second, MOST_ObjCSelector, context);
+	this->prepare_all();
 	
 	std::string str;
-	for (std::tr1::unordered_map<unsigned, ObjCMethod>::const_iterator cit2 = ma_objc_methods.begin(); cit2 != ma_objc_methods.end(); ++ cit2) {
-		str = cit2->second.is_class_method ? "+[" : "-[";
-		str += cit2->second.class_name;
-		str += ' ';
-		str += cit2->second.sel_name;
-		str += ']';
-		p_func(cit2->first, str.c_str(), MOST_ObjCMethod, context);
+	for (size_t i = 0; i < m_symbol_index.size(); ++ i) {
+		StringType type = static_cast<StringType>(m_symbol_index.type(i));
+		if (type == MOST_ObjCMethod) {
+			const ObjCMethod& method = ma_objc_methods[m_symbol_index.extra(i)];
+			str = method.is_class_method ? "+[" : "-[";
+			str += method.class_name;
+			str += ' ';
+			str += method.sel_name;
+			str += ']';
+			p_func(m_symbol_index.address(i), str.c_str(), MOST_ObjCMethod, context);
+		} else
+			p_func(m_symbol_index.address(i), m_symbol_index.name(i), type, context);
 	}
 }
 
+bool MachO_File::lookup_export(const char* sym, unsigned* p_address, unsigned* p_flags) const throw() {
+	ExportTrie::Entry entry;
+	if (!m_export_trie.lookup(sym, &entry))
+		return false;
+	if (p_address != NULL)
+		*p_address = (entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT) ? entry.address : this->export_vm_address(entry);
+	if (p_flags != NULL)
+		*p_flags = entry.flags;
+	return true;
+}
+
 unsigned MachO_File::address_of_symbol(const char* sym) const throw() {
-	for (std::tr1::unordered_map<unsigned,const char*>::const_iterator cit = ma_symbol_references.begin(); cit != ma_symbol_references.end(); ++ cit) {
-		if (strcmp(sym, cit->second) == 0)
-			return cit->first;
-	}
-	return 0;
+	unsigned flags, address;
+	if (this->lookup_export(sym, &address, &flags) && !(flags & EXPORT_SYMBOL_FLAGS_REEXPORT))
+		return address;
+	
+	this->prepare(MOT_Symbols);
+	size_t i = m_symbol_index.find_name(sym, MOST_Symbol);
+	return i != SymbolIndex::npos ? m_symbol_index.address(i) : 0;
 }
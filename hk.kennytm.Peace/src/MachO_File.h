@@ -34,6 +34,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <string>
 #include "DataFile.h"
+#include "SymbolIndex.h"
+#include "StringArena.h"
+#include "ExportTrie.h"
+#include "DyldInfoDecoder.h"
+#include "AnalysisCache.h"
+#include "OutputWriter.h"
 
 class MachO_File_Simple : public DataFile {
 public:
@@ -44,15 +50,31 @@ public:
 		bool is_class_method;
 	};
 	
+	// A section as a half-open interval in VM and file space. File offsets are relative to m_origin.
+	struct SectionInterval {
+		unsigned vm_begin, vm_end;
+		unsigned file_begin, file_end;
+	};
+	
 protected:
 	std::vector<const load_command*> ma_load_commands;
 	std::vector<const segment_command*> ma_segments;
 	std::vector<const section*> ma_sections;
 	
+	// sorted by vm_begin. The "guess segment" cursors index into this table.
+	std::vector<SectionInterval> ma_section_intervals;
+	// indices into ma_section_intervals, sorted by file_begin. Zerofill sections are excluded.
+	std::vector<int> ma_file_ordered_intervals;
+	
 	bool m_is_valid;
 	off_t m_origin;
 	off_t m_crypt_begin, m_crypt_end;
 	
+private:
+	void build_section_intervals();
+	int interval_index_of_vm_address(unsigned vm_address, int* p_guess_segment) const throw();
+	int interval_index_of_file_offset(unsigned file_offset, int* p_guess_segment) const throw();
+	
 public:
 	inline bool valid() const throw() { return m_is_valid; }
 	MachO_File_Simple(const char* path, const char* arch = "any");
@@ -61,7 +83,8 @@ public:
 	unsigned to_vm_address (off_t file_offset, int* p_guess_segment = NULL) const throw();
 	
 	// try to dereference this vm_address.
-	unsigned dereference(unsigned vm_address) const throw();
+	// the cursor is owned by the caller, so different threads can translate addresses of the same file concurrently.
+	unsigned dereference(unsigned vm_address, int* p_guess_segment = NULL) const throw();
 	int segment_index_having_name(const char* name) const;
 	const section* section_having_name (const char* segment_name, const char* section_name) const;
 	
@@ -90,6 +113,11 @@ public:
 	inline bool vm_address_encrypted(unsigned vm_address, int* p_guess_segment = NULL) { return file_offset_encrypted(to_file_offset(vm_address, p_guess_segment)); } 
 	
 	inline unsigned text_segment_vm_adress() const { return m_is_valid ? ma_segments[segment_index_having_name("__TEXT")]->vmaddr : 0; }
+	
+	// the 16 bytes of LC_UUID, or NULL if there is none.
+	const unsigned char* uuid() const throw();
+	// identifies the analyzed image for AnalysisCache: the UUID if any, otherwise the path, size and modification time.
+	std::string cache_key(const char* path) const;
 };
 
 //------------------------------------------------------------------------------
@@ -111,25 +139,45 @@ private:
 	const relocation_info* ma_relocations;
 	unsigned m_relocations_length;
 	
-	// VMAddress :-> string
-	std::tr1::unordered_map<unsigned,const char*> ma_symbol_references;
-	std::tr1::unordered_map<unsigned,const char*> ma_cfstrings;
+	const dyld_info_command* mp_dyld_info;
+	unsigned m_prepared_tables;
 	
-	std::tr1::unordered_map<unsigned,const char*> ma_objc_classes;
-	std::tr1::unordered_map<unsigned,const char*> ma_objc_selectors;
+protected:
+	// derived strings which are not in the file, e.g. export trie names.
+	StringArena m_string_arena;
 	
-	std::tr1::unordered_map<unsigned,ObjCMethod> ma_objc_methods;
+	// empty if the cache is disabled. Each kind of data appends its own suffix to the key.
+	// Strings read from a cache point into the reader, so the readers are kept until destruction.
+	std::string m_cache_key;
+	std::vector<AnalysisCacheReader*> ma_cache_readers;
 	
-	std::tr1::unordered_set<unsigned> ma_is_external_symbol;
-	std::tr1::unordered_map<unsigned,unsigned> ma_library_ordinals;
+private:
 	
-	std::vector<std::string> ma_string_store;
+	// VMAddress :-> string, for symbols, CFStrings, ObjC classes, selectors and methods.
+	// The extra field of an ObjC method entry is the index to ma_objc_methods.
+	SymbolIndex m_symbol_index;
+	std::vector<ObjCMethod> ma_objc_methods;
+	
+	// sorted by address. For the library ordinals, the first one recorded at an address wins.
+	std::vector<unsigned> ma_external_symbols;
+	std::vector<std::pair<unsigned,unsigned> > ma_library_ordinals;
 	
 	// 10.6 compressed mach-o formats.
-	void bind(uint32_t size) throw();
-	void process_export_trie_node(off_t start, off_t cur, off_t end, const std::string& prefix);
-	void process_export_trie(off_t start, off_t end) throw();
+	DyldInfoDecoder m_dyld_info_decoder;
+	ExportTrie m_export_trie;
+	// export trie addresses are offsets from the mach_header, i.e. the start of __TEXT.
+	unsigned m_export_base;
+	
+	inline unsigned export_vm_address(const ExportTrie::Entry& entry) const throw() { return (m_export_base + entry.address) & ~1u; }
 	
+	void build_symbol_tables();
+	void build_dyld_info_tables();
+	void build_cfstring_table();
+	void build_objc_class_table();
+	void build_objc_selector_table();
+	
+	bool read_table_cache();
+	void write_table_cache() const;
 public:
 	enum StringType {
 		MOST_Symbol,
@@ -142,24 +190,61 @@ public:
 		MOST_ObjCMethod
 	};
 	
+	enum DerivedTable {
+		MOT_Symbols = 1,
+		MOT_CFStrings = 2,
+		MOT_ObjCClasses = 4,
+		MOT_ObjCSelectors = 8,
+		MOT_DyldInfo = 16,
+		MOT_All = 31,
+		
+		// tables which are stored in the cache. The others are cheap to build from the file.
+		MOT_Cached = MOT_Symbols | MOT_CFStrings | MOT_ObjCClasses | MOT_ObjCSelectors
+	};
+	
 	MachO_File(const char* path, const char* arch = "any");
+	~MachO_File() throw();
+	
+	// The tables derived from the file are built on first use. Call prepare_all() for eager loading,
+	// and before sharing the object between threads, since building a table is not thread-safe.
+	// If the AnalysisCache is enabled, the MOT_Cached tables are read from, or built and written to, the cache together.
+	void prepare(unsigned tables) const;
+	inline void prepare_all() const { this->prepare(MOT_All); }
 	
 	// try to obtain a string related to this vm_address.
 	const char* string_representation (unsigned vm_address, StringType* p_strtype = NULL) const throw();
 	const char* nearest_string_representation (unsigned vm_address, unsigned* offset, StringType* p_strtype = NULL) const throw();
 	
-	static void print_string_representation(std::FILE* stream, const char* str, StringType strtype = MOST_Symbol) throw();
+	static void print_string_representation(OutputWriter& output, const char* str, StringType strtype = MOST_Symbol) throw();
 	
 	inline bool is_extern_symbol(unsigned vm_address) const throw() {
-		return ma_is_external_symbol.find(vm_address) != ma_is_external_symbol.end();
+		this->prepare(MOT_Symbols);
+		return std::binary_search(ma_external_symbols.begin(), ma_external_symbols.end(), vm_address);
+	}
+	
+	// whether dyld slides the pointer at this vm_address when the image is not loaded at its preferred address.
+	inline bool is_rebase_location(unsigned vm_address) const throw() {
+		this->prepare(MOT_DyldInfo);
+		return m_dyld_info_decoder.is_rebase_location(vm_address);
+	}
+	
+	// the decoded bind and rebase records of a 10.6 compressed mach-o file.
+	inline const DyldInfoDecoder& dyld_info() const {
+		this->prepare(MOT_DyldInfo);
+		return m_dyld_info_decoder;
 	}
 	
 	inline bool is_symbol(unsigned vm_address) const throw() {
-		return ma_symbol_references.find(vm_address) != ma_symbol_references.end();
+		this->prepare(MOT_Symbols);
+		return m_symbol_index.find(vm_address, MOST_Symbol) != SymbolIndex::npos;
 	}
 	
 	unsigned address_of_symbol(const char* sym) const throw();
 	
+	// look up a symbol in the export trie without building the symbol tables.
+	// The address is a vm_address, except for re-exports, where it is the library ordinal.
+	bool lookup_export(const char* sym, unsigned* p_address, unsigned* p_flags = NULL) const throw();
+	
 	const ObjCMethod* objc_method_at_vm_address(unsigned vm_address) const throw();
 	
 	const char* library_of_relocated_symbol(unsigned vm_address) const throw();
@@ -0,0 +1,184 @@
+/*
+
+OutputWriter.cpp ... Buffered text output for the command-line tools
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "OutputWriter.h"
+
+using namespace std;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static const char decimal_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// 0 = printed as is, 'x' = printed as \xNN, anything else = printed as \ followed by that character.
+// '\0' is marked too, so that the scan in write_escaped() stops at the end of the string without another test.
+static char escapes[256];
+
+static struct EscapesBuilder {
+	EscapesBuilder() {
+		for (unsigned c = 0; c < 256; ++ c)
+			escapes[c] = (c < ' ' || c > '~') ? 'x' : '\0';
+		escapes[static_cast<unsigned char>('\t')] = 't';
+		escapes[static_cast<unsigned char>('\n')] = 'n';
+		escapes[static_cast<unsigned char>('\\')] = '\\';
+		escapes[static_cast<unsigned char>('"')] = '"';
+		escapes[static_cast<unsigned char>('\a')] = 'a';
+		escapes[static_cast<unsigned char>('\b')] = 'b';
+		escapes[static_cast<unsigned char>('\f')] = 'f';
+		escapes[static_cast<unsigned char>('\r')] = 'r';
+		escapes[static_cast<unsigned char>('\v')] = 'v';
+	}
+} escapes_builder;
+
+#pragma mark -
+
+OutputWriter::OutputWriter(FILE* stream, size_t buffer_size) : m_stream(stream), mp_destination(NULL), ma_buffer(NULL), m_capacity(buffer_size < MinimumBufferSize ? MinimumBufferSize : buffer_size), m_used(0) {
+	ma_buffer = new char[m_capacity];
+}
+
+OutputWriter::OutputWriter(string& destination, size_t buffer_size) : m_stream(NULL), mp_destination(&destination), ma_buffer(NULL), m_capacity(buffer_size < MinimumBufferSize ? MinimumBufferSize : buffer_size), m_used(0) {
+	ma_buffer = new char[m_capacity];
+}
+
+OutputWriter::~OutputWriter() throw() {
+	flush();
+	delete[] ma_buffer;
+}
+
+void OutputWriter::flush() throw() {
+	if (m_used > 0) {
+		if (mp_destination != NULL)
+			mp_destination->append(ma_buffer, m_used);
+		else
+			fwrite(ma_buffer, 1, m_used, m_stream);
+		m_used = 0;
+	}
+}
+
+void OutputWriter::write(const char* data, size_t length) throw() {
+	if (m_capacity - m_used < length) {
+		flush();
+		// too large to be worth copying.
+		if (length >= m_capacity) {
+			if (mp_destination != NULL)
+				mp_destination->append(data, length);
+			else
+				fwrite(data, 1, length, m_stream);
+			return;
+		}
+	}
+	memcpy(ma_buffer + m_used, data, length);
+	m_used += length;
+}
+
+void OutputWriter::write_hex(unsigned value, unsigned width, char pad) throw() {
+	unsigned digits = 1u + (value > 0xF) + (value > 0xFF) + (value > 0xFFF) + (value > 0xFFFF)
+					+ (value > 0xFFFFF) + (value > 0xFFFFFF) + (value > 0xFFFFFFF);
+	for (; width > 8; -- width)
+		put(pad);
+		
+	unsigned length = digits < width ? width : digits;
+	char* out = reserve(length);
+	// the digits are filled in from the right, and whatever is left in front is padding.
+	char* end = out + length;
+	for (unsigned i = 0; i < digits; ++ i) {
+		*--end = hex_digits[value & 0xF];
+		value >>= 4;
+	}
+	memset(out, pad, length - digits);
+	m_used += length;
+}
+
+void OutputWriter::write_decimal(int value) throw() {
+	char temp[12];
+	char* end = temp + sizeof(temp);
+	char* begin = end;
+	
+	unsigned magnitude = value < 0 ? 0u - static_cast<unsigned>(value) : static_cast<unsigned>(value);
+	while (magnitude >= 100) {
+		const char* pair = decimal_pairs + 2*(magnitude % 100);
+		magnitude /= 100;
+		*--begin = pair[1];
+		*--begin = pair[0];
+	}
+	if (magnitude >= 10) {
+		const char* pair = decimal_pairs + 2*magnitude;
+		*--begin = pair[1];
+		*--begin = pair[0];
+	} else
+		*--begin = static_cast<char>('0' + magnitude);
+	if (value < 0)
+		*--begin = '-';
+		
+	write(begin, static_cast<size_t>(end - begin));
+}
+
+void OutputWriter::write_padded(const char* str, size_t width) throw() {
+	size_t length = strlen(str);
+	write(str, length);
+	
+	while (length < width) {
+		size_t spaces = width - length;
+		if (spaces > MinimumBufferSize)
+			spaces = MinimumBufferSize;
+		memset(reserve(spaces), ' ', spaces);
+		m_used += spaces;
+		length += spaces;
+	}
+}
+
+void OutputWriter::write_escaped(const char* str) throw() {
+	// copy the runs of printable characters in one go.
+	const char* run = str;
+	while (true) {
+		unsigned char c = static_cast<unsigned char>(*str);
+		char escape = escapes[c];
+		if (escape == '\0') {
+			++ str;
+			continue;
+		}
+		
+		write(run, static_cast<size_t>(str - run));
+		if (c == '\0')
+			return;
+			
+		char* out = reserve(4);
+		out[0] = '\\';
+		out[1] = escape;
+		if (escape == 'x') {
+			out[2] = hex_digits[c >> 4];
+			out[3] = hex_digits[c & 0xF];
+			m_used += 4;
+		} else
+			m_used += 2;
+			
+		run = ++ str;
+	}
+}
@@ -0,0 +1,82 @@
+/*
+
+OutputWriter.h ... Buffered text output for the command-line tools
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <string>
+
+// Collects formatted text in a large buffer and hands it to the stream in big blocks, so printing a line
+// costs a few memcpy's instead of a vfprintf call (and a lock of the stream) per field.
+// The formatters produce exactly what the printf conversions mentioned next to them do.
+// Anything written to the stream directly in between must be preceded by a flush().
+class OutputWriter {
+private:
+	std::FILE* m_stream;
+	std::string* mp_destination;	// used instead of the stream if not NULL.
+	char* ma_buffer;
+	std::size_t m_capacity, m_used;
+	
+	OutputWriter(const OutputWriter&);
+	OutputWriter& operator=(const OutputWriter&);
+	
+	// make room for n (<= MinimumBufferSize) contiguous bytes.
+	inline char* reserve(std::size_t n) throw() {
+		if (m_capacity - m_used < n)
+			flush();
+		return ma_buffer + m_used;
+	}
+
+public:
+	static const std::size_t DefaultBufferSize = 1 << 16;
+	static const std::size_t MinimumBufferSize = 64;
+	
+	explicit OutputWriter(std::FILE* stream, std::size_t buffer_size = DefaultBufferSize);
+	// append to a string instead of writing to a stream.
+	explicit OutputWriter(std::string& destination, std::size_t buffer_size = DefaultBufferSize);
+	~OutputWriter() throw();
+	
+	// write the buffered text to the stream (or the string). The stream itself is not fflush'ed.
+	void flush() throw();
+	
+	inline void put(char c) throw() {
+		if (m_used == m_capacity)
+			flush();
+		ma_buffer[m_used++] = c;
+	}
+	
+	void write(const char* data, std::size_t length) throw();
+	inline void write(const char* str) throw() { this->write(str, std::strlen(str)); }
+	
+	// %x, or %0*x / %*x with pad = '0' / ' '.
+	void write_hex(unsigned value, unsigned width = 0, char pad = '0') throw();
+	// %d
+	void write_decimal(int value) throw();
+	// %-*s
+	void write_padded(const char* str, std::size_t width) throw();
+	// the string with C escapes (\n, \", \x7f, ...), as it would appear in a string literal.
+	void write_escaped(const char* str) throw();
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+
+StringArena.cpp ... Interned strings in bump-allocated blocks
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "StringArena.h"
+
+using namespace std;
+
+static inline unsigned hash_string(const char* s, size_t length) throw() {
+	unsigned h = 2166136261u;
+	for (size_t i = 0; i < length; ++ i) {
+		h ^= static_cast<unsigned char>(s[i]);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+StringArena::StringArena() : m_cursor(NULL), m_remaining(0), ma_buckets(64, static_cast<const char*>(NULL)), ma_bucket_hashes(64, 0), m_count(0) {}
+
+StringArena::~StringArena() throw() {
+	for (vector<char*>::iterator it = ma_blocks.begin(); it != ma_blocks.end(); ++ it)
+		delete[] *it;
+}
+
+char* StringArena::allocate(size_t size) {
+	// large strings get a block of their own, so the current block is not wasted.
+	if (size > BlockSize/4) {
+		char* block = new char[size];
+		ma_blocks.push_back(block);
+		return block;
+	}
+	
+	if (size > m_remaining) {
+		m_cursor = new char[BlockSize];
+		ma_blocks.push_back(m_cursor);
+		m_remaining = BlockSize;
+	}
+	
+	char* retval = m_cursor;
+	m_cursor += size;
+	m_remaining -= size;
+	return retval;
+}
+
+void StringArena::grow_buckets() {
+	size_t new_bucket_count = ma_buckets.size() * 2;
+	vector<const char*> new_buckets (new_bucket_count, static_cast<const char*>(NULL));
+	vector<unsigned> new_hashes (new_bucket_count, 0);
+	
+	for (size_t i = 0; i < ma_buckets.size(); ++ i) {
+		if (ma_buckets[i] == NULL)
+			continue;
+		size_t b = ma_bucket_hashes[i] & (new_bucket_count-1);
+		while (new_buckets[b] != NULL)
+			b = (b+1) & (new_bucket_count-1);
+		new_buckets[b] = ma_buckets[i];
+		new_hashes[b] = ma_bucket_hashes[i];
+	}
+	
+	ma_buckets.swap(new_buckets);
+	ma_bucket_hashes.swap(new_hashes);
+}
+
+const char* StringArena::intern(const char* str, size_t length) {
+	unsigned hash = hash_string(str, length);
+	size_t mask = ma_buckets.size()-1;
+	size_t b = hash & mask;
+	
+	for (; ma_buckets[b] != NULL; b = (b+1) & mask) {
+		const char* candidate = ma_buckets[b];
+		if (ma_bucket_hashes[b] == hash && strncmp(candidate, str, length) == 0 && candidate[length] == '\0')
+			return candidate;
+	}
+	
+	char* copy = this->allocate(length+1);
+	memcpy(copy, str, length);
+	copy[length] = '\0';
+	
+	ma_buckets[b] = copy;
+	ma_bucket_hashes[b] = hash;
+	++ m_count;
+	if (2*m_count > ma_buckets.size())
+		this->grow_buckets();
+		
+	return copy;
+}
@@ -0,0 +1,61 @@
+/*
+
+StringArena.h ... Interned strings in bump-allocated blocks
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+
+// Owns C strings that live as long as the arena. Equal strings are stored once,
+// and the returned pointers never move.
+class StringArena {
+private:
+	static const std::size_t BlockSize = 0x10000;
+	
+	std::vector<char*> ma_blocks;
+	char* m_cursor;
+	std::size_t m_remaining;
+	
+	// open-addressing table of interned strings, with their hashes.
+	std::vector<const char*> ma_buckets;
+	std::vector<unsigned> ma_bucket_hashes;
+	std::size_t m_count;
+	
+	char* allocate(std::size_t size);
+	void grow_buckets();
+	
+	StringArena(const StringArena&);
+	StringArena& operator=(const StringArena&);
+
+public:
+	StringArena();
+	~StringArena() throw();
+	
+	const char* intern(const char* str, std::size_t length);
+	inline const char* intern(const char* str) { return this->intern(str, std::strlen(str)); }
+	inline const char* intern(const std::string& str) { return this->intern(str.data(), str.size()); }
+	
+	inline std::size_t size() const throw() { return m_count; }
+};
+
+#endif
@@ -0,0 +1,212 @@
+/*
+
+SymbolIndex.cpp ... Address-sorted symbol index
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "SymbolIndex.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static inline unsigned hash_name(const char* s) throw() {
+	unsigned h = 2166136261u;
+	for (; *s != '\0'; ++ s) {
+		h ^= static_cast<unsigned char>(*s);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+struct PendingEntryComparator {
+	template <typename T>
+	bool operator() (const T& a, const T& b) const throw() {
+		if (a.address != b.address)
+			return a.address < b.address;
+		if (a.type != b.type)
+			return a.type < b.type;
+		return a.sequence < b.sequence;
+	}
+};
+
+void SymbolIndex::add(unsigned vm_address, const char* str, unsigned char strtype, bool replace_existing, unsigned extra_value) {
+	PendingEntry e;
+	e.address = vm_address;
+	e.name = str;
+	e.extra = extra_value;
+	e.sequence = ma_pending.size();
+	e.type = strtype;
+	e.replace_existing = replace_existing;
+	ma_pending.push_back(e);
+}
+
+void SymbolIndex::freeze() {
+	if (ma_pending.empty())
+		return;
+		
+	sort(ma_pending.begin(), ma_pending.end(), PendingEntryComparator());
+	
+	// resolve duplicates among the pending entries: the last replacing entry wins, otherwise the first one.
+	vector<PendingEntry> resolved;
+	resolved.reserve(ma_pending.size());
+	for (vector<PendingEntry>::const_iterator cit = ma_pending.begin(); cit != ma_pending.end(); ) {
+		vector<PendingEntry>::const_iterator group_end = cit+1;
+		const PendingEntry* winner = &*cit;
+		while (group_end != ma_pending.end() && group_end->address == cit->address && group_end->type == cit->type) {
+			if (group_end->replace_existing)
+				winner = &*group_end;
+			++ group_end;
+		}
+		resolved.push_back(*winner);
+		cit = group_end;
+	}
+	vector<PendingEntry>().swap(ma_pending);
+	
+	// merge with the existing table.
+	size_t old_size = ma_addresses.size();
+	vector<unsigned> addresses, extras;
+	vector<const char*> names;
+	vector<unsigned char> types;
+	addresses.reserve(old_size + resolved.size());
+	extras.reserve(old_size + resolved.size());
+	names.reserve(old_size + resolved.size());
+	types.reserve(old_size + resolved.size());
+	
+	size_t i = 0;
+	vector<PendingEntry>::const_iterator pit = resolved.begin();
+	while (i < old_size || pit != resolved.end()) {
+		bool take_old;
+		bool skip_old = false;
+		if (pit == resolved.end())
+			take_old = true;
+		else if (i == old_size)
+			take_old = false;
+		else if (ma_addresses[i] != pit->address)
+			take_old = ma_addresses[i] < pit->address;
+		else if (ma_types[i] != pit->type)
+			take_old = ma_types[i] < pit->type;
+		else {
+			take_old = !pit->replace_existing;
+			if (take_old)
+				++ pit;
+			else
+				skip_old = true;
+		}
+		
+		if (take_old) {
+			addresses.push_back(ma_addresses[i]);
+			names.push_back(ma_names[i]);
+			types.push_back(ma_types[i]);
+			extras.push_back(ma_extras[i]);
+			++ i;
+		} else {
+			addresses.push_back(pit->address);
+			names.push_back(pit->name);
+			types.push_back(pit->type);
+			extras.push_back(pit->extra);
+			++ pit;
+			if (skip_old)
+				++ i;
+		}
+	}
+	
+	ma_addresses.swap(addresses);
+	ma_names.swap(names);
+	ma_types.swap(types);
+	ma_extras.swap(extras);
+	
+	rebuild_auxiliary_indices();
+}
+
+void SymbolIndex::rebuild_auxiliary_indices() {
+	size_t count = ma_addresses.size();
+	
+	ma_positions_by_type.clear();
+	for (size_t i = 0; i < count; ++ i) {
+		if (ma_types[i] >= ma_positions_by_type.size())
+			ma_positions_by_type.resize(ma_types[i]+1);
+		ma_positions_by_type[ma_types[i]].push_back(i);
+	}
+	
+	size_t bucket_count = 16;
+	while (bucket_count < 2*count)
+		bucket_count *= 2;
+	ma_name_buckets.assign(bucket_count, 0);
+	
+	for (size_t i = 0; i < count; ++ i) {
+		if (ma_names[i] == NULL)
+			continue;
+		size_t b = hash_name(ma_names[i]) & (bucket_count-1);
+		bool duplicated = false;
+		while (ma_name_buckets[b] != 0) {
+			size_t j = ma_name_buckets[b]-1;
+			if (ma_types[j] == ma_types[i] && strcmp(ma_names[j], ma_names[i]) == 0) {
+				duplicated = true;
+				break;
+			}
+			b = (b+1) & (bucket_count-1);
+		}
+		if (!duplicated)
+			ma_name_buckets[b] = i+1;
+	}
+}
+
+size_t SymbolIndex::lower_bound(unsigned vm_address) const throw() {
+	return std::lower_bound(ma_addresses.begin(), ma_addresses.end(), vm_address) - ma_addresses.begin();
+}
+
+size_t SymbolIndex::upper_bound(unsigned vm_address) const throw() {
+	return std::upper_bound(ma_addresses.begin(), ma_addresses.end(), vm_address) - ma_addresses.begin();
+}
+
+size_t SymbolIndex::find(unsigned vm_address, unsigned char strtype) const throw() {
+	for (size_t i = this->lower_bound(vm_address); i < ma_addresses.size() && ma_addresses[i] == vm_address; ++ i)
+		if (ma_types[i] == strtype)
+			return i;
+	return npos;
+}
+
+size_t SymbolIndex::find_next(unsigned vm_address, unsigned char strtype) const throw() {
+	if (strtype >= ma_positions_by_type.size())
+		return npos;
+		
+	const vector<unsigned>& positions = ma_positions_by_type[strtype];
+	size_t lo = 0, hi = positions.size();
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (ma_addresses[positions[mid]] <= vm_address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < positions.size() ? positions[lo] : npos;
+}
+
+size_t SymbolIndex::find_name(const char* str, unsigned char strtype) const throw() {
+	if (ma_name_buckets.empty())
+		return npos;
+		
+	size_t mask = ma_name_buckets.size()-1;
+	for (size_t b = hash_name(str) & mask; ma_name_buckets[b] != 0; b = (b+1) & mask) {
+		size_t j = ma_name_buckets[b]-1;
+		if (ma_types[j] == strtype && strcmp(ma_names[j], str) == 0)
+			return j;
+	}
+	return npos;
+}
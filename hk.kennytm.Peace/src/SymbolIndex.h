@@ -0,0 +1,85 @@
+/*
+
+SymbolIndex.h ... Address-sorted symbol index
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SYMBOLINDEX_H
+#define SYMBOLINDEX_H
+
+#include <vector>
+#include <cstddef>
+
+// A flat (structure-of-arrays) table of (address, type) -> name entries, sorted by address then type.
+// Entries are collected with add() and become searchable after freeze(). freeze() may be called again
+// after more entries are added, which merges them into the existing table.
+class SymbolIndex {
+public:
+	static const std::size_t npos = ~static_cast<std::size_t>(0);
+
+private:
+	struct PendingEntry {
+		unsigned address;
+		const char* name;
+		unsigned extra;
+		unsigned sequence;
+		unsigned char type;
+		bool replace_existing;
+	};
+	
+	std::vector<PendingEntry> ma_pending;
+	
+	std::vector<unsigned> ma_addresses;
+	std::vector<const char*> ma_names;
+	std::vector<unsigned char> ma_types;
+	std::vector<unsigned> ma_extras;
+	
+	// positions of each type in the table, in address order.
+	std::vector<std::vector<unsigned> > ma_positions_by_type;
+	// open-addressing hash table of (position+1), keyed by name.
+	std::vector<unsigned> ma_name_buckets;
+	
+	void rebuild_auxiliary_indices();
+
+public:
+	// if replace_existing is false, the entry is dropped when another one of the same address and type
+	// has been added before (like unordered_map::insert). Otherwise it overwrites (like operator[]).
+	void add(unsigned vm_address, const char* str, unsigned char strtype, bool replace_existing, unsigned extra_value = 0);
+	void freeze();
+	
+	inline std::size_t size() const throw() { return ma_addresses.size(); }
+	inline bool empty() const throw() { return ma_addresses.empty(); }
+	
+	inline unsigned address(std::size_t i) const throw() { return ma_addresses[i]; }
+	inline const char* name(std::size_t i) const throw() { return ma_names[i]; }
+	inline unsigned char type(std::size_t i) const throw() { return ma_types[i]; }
+	inline unsigned extra(std::size_t i) const throw() { return ma_extras[i]; }
+	
+	// first entry with address >= vm_address.
+	std::size_t lower_bound(unsigned vm_address) const throw();
+	// first entry with address > vm_address.
+	std::size_t upper_bound(unsigned vm_address) const throw();
+	
+	std::size_t find(unsigned vm_address, unsigned char strtype) const throw();
+	// first entry of this type with address > vm_address.
+	std::size_t find_next(unsigned vm_address, unsigned char strtype) const throw();
+	// the entry of this type with the lowest address having this name.
+	std::size_t find_name(const char* str, unsigned char strtype) const throw();
+};
+
+#endif
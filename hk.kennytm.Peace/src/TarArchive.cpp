@@ -0,0 +1,281 @@
+/*
+
+TarArchive.cpp ... Writing and reading uncompressed tar archives.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "TarArchive.h"
+#include "DataFile.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <sys/stat.h>
+#if _MSC_VER
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+using namespace std;
+
+// Layout of a ustar header block. Numbers are in octal, terminated by a NUL.
+enum {
+	TH_Name = 0,		// 100 bytes
+	TH_Mode = 100,		// 8
+	TH_UID = 108,		// 8
+	TH_GID = 116,		// 8
+	TH_Size = 124,		// 12
+	TH_MTime = 136,		// 12
+	TH_Checksum = 148,	// 8
+	TH_Type = 156,		// 1
+	TH_Magic = 257,		// 6, then the version (2)
+	TH_Prefix = 345,	// 155
+	TH_BlockSize = 512
+};
+
+static void write_octal(char* field, size_t width, unsigned long value) {
+	for (size_t i = width-1; i > 0; -- i) {
+		field[i-1] = static_cast<char>('0' + (value & 7));
+		value >>= 3;
+	}
+	field[width-1] = '\0';
+}
+
+static unsigned long read_octal(const char* field, size_t width) {
+	unsigned long value = 0;
+	for (size_t i = 0; i < width && field[i] >= '0' && field[i] <= '7'; ++ i)
+		value = value * 8 + static_cast<unsigned long>(field[i] - '0');
+	return value;
+}
+
+// the checksum is computed with the checksum field itself taken as spaces.
+static unsigned long header_checksum(const char* header) {
+	unsigned long sum = 0;
+	for (size_t i = 0; i < TH_BlockSize; ++ i)
+		sum += (i >= TH_Checksum && i < TH_Checksum + 8) ? ' ' : static_cast<unsigned char>(header[i]);
+	return sum;
+}
+
+static string field_string(const char* field, size_t width) {
+	const void* nul = memchr(field, '\0', width);
+	return string(field, nul != NULL ? static_cast<const char*>(nul) : field + width);
+}
+
+#pragma mark -
+
+TarWriter::TarWriter(const char* path) : m_owns_file(strcmp(path, "-") != 0), m_failed(false), m_finished(false), m_mtime(static_cast<unsigned long>(time(NULL))), m_buffer(1 << 20) {
+	if (m_owns_file) {
+		m_file = fopen(path, "wb");
+		if (m_file == NULL)
+			throw TRException("Cannot create archive '%s'.", path);
+	} else {
+		m_file = stdout;
+#if _MSC_VER
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+	setvbuf(m_file, &m_buffer[0], _IOFBF, m_buffer.size());
+}
+
+TarWriter::TarWriter() : m_file(NULL), m_owns_file(false), m_failed(false), m_finished(false), m_mtime(0) {}
+
+TarWriter::~TarWriter() throw() {
+	finish();
+}
+
+void TarWriter::write_data(const char* data, size_t size) throw() {
+	static const char padding[TH_BlockSize] = "";
+	if (size > 0 && fwrite(data, 1, size, m_file) != size)
+		m_failed = true;
+	size_t padding_size = (TH_BlockSize - size % TH_BlockSize) % TH_BlockSize;
+	if (padding_size > 0 && fwrite(padding, 1, padding_size, m_file) != padding_size)
+		m_failed = true;
+}
+
+void TarWriter::write_header(const string& name, size_t size, char type) throw() {
+	// ustar can split a long name at a slash, into a prefix of up to 155 characters and a name of up to 100.
+	size_t prefix_length = 0;
+	if (name.size() > 100) {
+		size_t slash = name.find('/', name.size() - 101);
+		if (slash != string::npos && slash != 0 && slash <= 155)
+			prefix_length = slash;
+		else {
+			write_header("././@LongLink", name.size()+1, 'L');
+			write_data(name.c_str(), name.size()+1);
+		}
+	}
+	
+	char header[TH_BlockSize];
+	memset(header, 0, sizeof(header));
+	if (prefix_length != 0) {
+		memcpy(header+TH_Prefix, name.data(), prefix_length);
+		strncpy(header+TH_Name, name.c_str()+prefix_length+1, 100);
+	} else
+		strncpy(header+TH_Name, name.c_str(), 100);	// truncated if a long name entry has been written.
+	write_octal(header+TH_Mode, 8, 0644);
+	write_octal(header+TH_UID, 8, 0);
+	write_octal(header+TH_GID, 8, 0);
+	write_octal(header+TH_Size, 12, size);
+	write_octal(header+TH_MTime, 12, m_mtime);
+	header[TH_Type] = type;
+	memcpy(header+TH_Magic, "ustar\0" "00", 8);
+	
+	// 6 digits, a NUL and a space.
+	write_octal(header+TH_Checksum, 7, header_checksum(header));
+	header[TH_Checksum+7] = ' ';
+	
+	write_data(header, sizeof(header));
+}
+
+void TarWriter::add_file(const string& name, const string& contents) throw() {
+	ScopedLock lock (m_mutex);
+	if (m_file == NULL) {
+		ma_staged_files.push_back(pair<string, string>(name, contents));
+		return;
+	}
+	write_header(name, contents.size(), '0');
+	write_data(contents.data(), contents.size());
+}
+
+void TarWriter::add_files_from(TarWriter& staged) throw() {
+	vector<pair<string, string> > files;
+	{
+		ScopedLock staged_lock (staged.m_mutex);
+		files.swap(staged.ma_staged_files);
+	}
+	
+	ScopedLock lock (m_mutex);
+	for (vector<pair<string, string> >::const_iterator cit = files.begin(); cit != files.end(); ++ cit) {
+		if (m_file == NULL)
+			ma_staged_files.push_back(*cit);
+		else {
+			write_header(cit->first, cit->second.size(), '0');
+			write_data(cit->second.data(), cit->second.size());
+		}
+	}
+}
+
+bool TarWriter::finish() throw() {
+	ScopedLock lock (m_mutex);
+	if (m_file == NULL)
+		return !m_failed;
+	if (!m_finished) {
+		m_finished = true;
+		// the end of an archive is marked by 2 empty blocks.
+		static const char end_blocks[2*TH_BlockSize] = "";
+		if (fwrite(end_blocks, 1, sizeof(end_blocks), m_file) != sizeof(end_blocks) || fflush(m_file) != 0)
+			m_failed = true;
+		if (m_owns_file) {
+			if (fclose(m_file) != 0)
+				m_failed = true;
+		} else
+			setvbuf(m_file, NULL, _IOFBF, BUFSIZ);
+	}
+	return !m_failed;
+}
+
+#pragma mark -
+
+TarReader::TarReader(const char* path) : m_owns_file(strcmp(path, "-") != 0) {
+	if (m_owns_file) {
+		m_file = fopen(path, "rb");
+		if (m_file == NULL)
+			throw TRException("Cannot open archive '%s'.", path);
+	} else {
+		m_file = stdin;
+#if _MSC_VER
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	}
+	
+	struct stat st;
+	m_size = fstat(fileno(m_file), &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG ? static_cast<long>(st.st_size) : -1;
+}
+
+TarReader::~TarReader() throw() {
+	if (m_owns_file)
+		fclose(m_file);
+}
+
+bool TarReader::next(string& name, string& contents) {
+	string long_name;
+	char header[TH_BlockSize];
+	while (true) {
+		size_t read_size = fread(header, 1, sizeof(header), m_file);
+		if (read_size == 0 || (read_size == sizeof(header) && header[0] == '\0'))
+			return false;
+		if (read_size != sizeof(header))
+			throw TRException("Truncated tar archive.");
+		if (read_octal(header+TH_Checksum, 8) != header_checksum(header))
+			throw TRException("Corrupted tar header.");
+			
+		// the size is not trusted with an allocation: it must fit in what is left of the archive, and
+		// a pipe is read in pieces, so the contents only grow as far as there is data.
+		size_t size = read_octal(header+TH_Size, 12);
+		if (m_size >= 0) {
+			long position = ftell(m_file);
+			if (position < 0 || position > m_size || size > static_cast<unsigned long>(m_size - position))
+				throw TRException("Truncated tar archive.");
+		}
+		
+		string data;
+		while (data.size() < size) {
+			size_t piece_size = min(size - data.size(), static_cast<size_t>(1 << 20));
+			size_t old_size = data.size();
+			data.resize(old_size + piece_size);
+			if (fread(&data[old_size], 1, piece_size, m_file) != piece_size)
+				throw TRException("Truncated tar archive.");
+		}
+		size_t padding_size = (TH_BlockSize - size % TH_BlockSize) % TH_BlockSize;
+		char padding[TH_BlockSize];
+		if (padding_size > 0 && fread(padding, 1, padding_size, m_file) != padding_size)
+			throw TRException("Truncated tar archive.");
+			
+		char type = header[TH_Type];
+		if (type == 'L') {
+			long_name = field_string(data.data(), data.size());
+			continue;
+		} else if (type == '0' || type == '\0') {
+			if (!long_name.empty())
+				name.swap(long_name);
+			else {
+				name = field_string(header+TH_Prefix, 155);
+				if (!name.empty())
+					name.push_back('/');
+				name += field_string(header+TH_Name, 100);
+			}
+			contents.swap(data);
+			return true;
+		}
+		long_name.clear();
+	}
+}
+
+bool make_directories(const string& path) {
+	struct stat st;
+	if (path.empty() || stat(path.c_str(), &st) == 0)
+		return true;
+	size_t slash = path.find_last_of('/', path.size() - 2);
+	if (slash != string::npos && slash != 0 && !make_directories(path.substr(0, slash)))
+		return false;
+#if _MSC_VER
+	return _mkdir(path.c_str()) == 0 || stat(path.c_str(), &st) == 0;
+#else
+	return mkdir(path.c_str(), 0755) == 0 || stat(path.c_str(), &st) == 0;
+#endif
+}
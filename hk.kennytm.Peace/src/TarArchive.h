@@ -0,0 +1,89 @@
+/*
+
+TarArchive.h ... Writing and reading uncompressed tar archives.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TARARCHIVE_H
+#define TARARCHIVE_H
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include "Threading.h"
+
+// writes regular files into a ustar archive through one buffered stream, so a whole set of files costs a single
+// file creation. Names too long for ustar are stored with GNU long name entries.
+class TarWriter {
+private:
+	std::FILE* m_file;
+	bool m_owns_file, m_failed, m_finished;
+	unsigned long m_mtime;
+	Mutex m_mutex;
+	std::vector<char> m_buffer;
+	// the files of a writer without a file.
+	std::vector<std::pair<std::string, std::string> > ma_staged_files;
+	
+	TarWriter(const TarWriter&);
+	TarWriter& operator=(const TarWriter&);
+	
+	void write_header(const std::string& name, std::size_t size, char type) throw();
+	void write_data(const char* data, std::size_t size) throw();
+
+public:
+	// "-" writes to stdout. Throws TRException if the file cannot be created.
+	explicit TarWriter(const char* path);
+	// a writer without a file keeps the files in memory, until add_files_from() moves them into another writer.
+	TarWriter();
+	~TarWriter() throw();
+	
+	// can be called from several threads. Every file is written in one piece.
+	void add_file(const std::string& name, const std::string& contents) throw();
+	// add all files of a writer without a file, in the order they were added to it, with nothing in between.
+	void add_files_from(TarWriter& staged) throw();
+	
+	// write the end of the archive. Returns false if anything failed to be written.
+	bool finish() throw();
+};
+
+// reads the regular files of a ustar or GNU tar archive. Other entries are skipped.
+class TarReader {
+private:
+	std::FILE* m_file;
+	bool m_owns_file;
+	// the size of the archive, or -1 if it is read from a pipe.
+	long m_size;
+	
+	TarReader(const TarReader&);
+	TarReader& operator=(const TarReader&);
+
+public:
+	// "-" reads from stdin. Throws TRException if the file cannot be opened.
+	explicit TarReader(const char* path);
+	~TarReader() throw();
+	
+	// read the next file. Returns false at the end of the archive, and throws TRException if the archive is corrupted.
+	bool next(std::string& name, std::string& contents);
+};
+
+// create the directory and its missing parents, like mkdir -p.
+bool make_directories(const std::string& path);
+
+#endif
@@ -0,0 +1,103 @@
+/*
+
+Threading.cpp ... Minimal portable mutex and worker pool
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "Threading.h"
+#include <vector>
+#if _MSC_VER
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+struct ParallelForState {
+	Mutex mutex;
+	size_t next, count;
+	void (*job)(void* context, size_t index);
+	void* context;
+};
+
+#if _MSC_VER
+static unsigned __stdcall parallel_for_worker(void* state_ptr) {
+#else
+static void* parallel_for_worker(void* state_ptr) {
+#endif
+	ParallelForState* state = static_cast<ParallelForState*>(state_ptr);
+	while (true) {
+		size_t index;
+		{
+			ScopedLock lock (state->mutex);
+			if (state->next == state->count)
+				break;
+			index = state->next ++;
+		}
+		state->job(state->context, index);
+	}
+	return 0;
+}
+
+void parallel_for(unsigned thread_count, size_t count, void (*job)(void* context, size_t index), void* context) {
+	ParallelForState state;
+	state.next = 0;
+	state.count = count;
+	state.job = job;
+	state.context = context;
+	
+	if (thread_count > count)
+		thread_count = static_cast<unsigned>(count);
+		
+	// if a thread cannot be started, the others simply do more of the work.
+#if _MSC_VER
+	vector<HANDLE> threads;
+	for (unsigned i = 1; i < thread_count; ++ i) {
+		HANDLE thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, parallel_for_worker, &state, 0, NULL));
+		if (thread != 0)
+			threads.push_back(thread);
+	}
+	parallel_for_worker(&state);
+	for (vector<HANDLE>::const_iterator cit = threads.begin(); cit != threads.end(); ++ cit) {
+		WaitForSingleObject(*cit, INFINITE);
+		CloseHandle(*cit);
+	}
+#else
+	vector<pthread_t> threads;
+	for (unsigned i = 1; i < thread_count; ++ i) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, parallel_for_worker, &state) == 0)
+			threads.push_back(thread);
+	}
+	parallel_for_worker(&state);
+	for (vector<pthread_t>::const_iterator cit = threads.begin(); cit != threads.end(); ++ cit)
+		pthread_join(*cit, NULL);
+#endif
+}
+
+unsigned processor_count() throw() {
+#if _MSC_VER
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? static_cast<unsigned>(info.dwNumberOfProcessors) : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? static_cast<unsigned>(count) : 1;
+#endif
+}
@@ -0,0 +1,105 @@
+/*
+
+Threading.h ... Minimal portable mutex and worker pool
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef THREADING_H
+#define THREADING_H
+
+#if _MSC_VER
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <cstddef>
+
+class Mutex {
+private:
+#if _MSC_VER
+	CRITICAL_SECTION m_section;
+#else
+	pthread_mutex_t m_mutex;
+#endif
+
+	Mutex(const Mutex&);
+	Mutex& operator=(const Mutex&);
+	
+	friend class Condition;
+
+public:
+#if _MSC_VER
+	Mutex() { InitializeCriticalSection(&m_section); }
+	~Mutex() throw() { DeleteCriticalSection(&m_section); }
+	inline void lock() throw() { EnterCriticalSection(&m_section); }
+	inline void unlock() throw() { LeaveCriticalSection(&m_section); }
+#else
+	Mutex() { pthread_mutex_init(&m_mutex, NULL); }
+	~Mutex() throw() { pthread_mutex_destroy(&m_mutex); }
+	inline void lock() throw() { pthread_mutex_lock(&m_mutex); }
+	inline void unlock() throw() { pthread_mutex_unlock(&m_mutex); }
+#endif
+};
+
+// a condition variable, always waited on with the same Mutex locked.
+class Condition {
+private:
+#if _MSC_VER
+	CONDITION_VARIABLE m_condition;
+#else
+	pthread_cond_t m_condition;
+#endif
+
+	Condition(const Condition&);
+	Condition& operator=(const Condition&);
+
+public:
+#if _MSC_VER
+	Condition() { InitializeConditionVariable(&m_condition); }
+	~Condition() throw() {}
+	inline void wait(Mutex& mutex) throw() { SleepConditionVariableCS(&m_condition, &mutex.m_section, INFINITE); }
+	inline void broadcast() throw() { WakeAllConditionVariable(&m_condition); }
+#else
+	Condition() { pthread_cond_init(&m_condition, NULL); }
+	~Condition() throw() { pthread_cond_destroy(&m_condition); }
+	inline void wait(Mutex& mutex) throw() { pthread_cond_wait(&m_condition, &mutex.m_mutex); }
+	inline void broadcast() throw() { pthread_cond_broadcast(&m_condition); }
+#endif
+};
+
+// holds the mutex until the end of the scope.
+class ScopedLock {
+private:
+	Mutex& m_mutex;
+	
+	ScopedLock(const ScopedLock&);
+	ScopedLock& operator=(const ScopedLock&);
+
+public:
+	explicit ScopedLock(Mutex& mutex) throw() : m_mutex(mutex) { m_mutex.lock(); }
+	~ScopedLock() throw() { m_mutex.unlock(); }
+};
+
+// call job(context, i) for every i in [0, count), using up to thread_count threads (including the calling one).
+// Indices are handed out in increasing order. The job must not throw.
+void parallel_for(unsigned thread_count, std::size_t count, void (*job)(void* context, std::size_t index), void* context);
+
+// the number of processors, or 1 if unknown.
+unsigned processor_count() throw();
+
+#endif
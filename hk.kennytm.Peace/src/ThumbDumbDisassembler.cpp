@@ -142,433 +142,611 @@ static const char* const ops_rev[] = {"rev", "rev16", "rev??", "revsh"};
 static const char* const ops_xt[] = {"sxth", "sxtb", "uxth", "uxtb"};
 
 void ThumbDumbDisassembler::print_raw_instruction(unsigned vm_address, unsigned instruction, const char* decoded, bool hasR, unsigned R) const {
-	fprintf(m_stream, "%08x\t%s%04x\t%-48s", vm_address, (instruction&0xFFFF0000?"":"    "), instruction, decoded);
+	m_output.write_hex(vm_address, 8);
+	m_output.put('\t');
+	if (!(instruction & 0xFFFF0000))
+		m_output.write("    ");
+	m_output.write_hex(instruction, 4);
+	m_output.put('\t');
+	m_output.write_padded(decoded, 48);
 	if (hasR) {
-		fprintf(m_stream, "; %8x = ", R);
+		m_output.write("; ");
+		m_output.write_hex(R, 8, ' ');
+		m_output.write(" = ");
 		this->print_references(R);
 	}
 }
 
-unsigned ThumbDumbDisassembler::disassemble_at(unsigned vm_address) {
-	pc = vm_address+4;
-#define Print(x) this->print_raw_instruction(vm_address, instruction, decoded, true, (x))
-#define PrintWithoutComments this->print_raw_instruction(vm_address, instruction, decoded, false, 0)
-	
-	unsigned instruction = m_file.read_integer();
-	unsigned instr2 = instruction >> 16;
-	instruction &= 0xFFFF;
-	
-	char decoded[80];
+#pragma mark -
+
+enum ThumbKind {
+	TK_Undefined,
+	TK_ConditionalBranch,
+	TK_Branch,
+	TK_BranchWithLink,	// the first half of bl/blx.
+	TK_BranchWithExchange,
+	TK_DataProcessing1,
+	TK_DataProcessing2,
+	TK_DataProcessing3,
+	TK_DataProcessing4,
+	TK_DataProcessing5,
+	TK_DataProcessing6,
+	TK_DataProcessing7,
+	TK_DataProcessing8,
+	TK_LoadStore1,
+	TK_LoadStore2,
+	TK_LoadStore3,
+	TK_LoadStore4,
+	TK_LoadStoreMultiple1,
+	TK_LoadStoreMultiple2,
+	TK_Breakpoint,
+	TK_ChangeProcessorState,
+	TK_Reverse,
+	TK_SetEndianness,
+	TK_SoftwareInterrupt,
+	TK_Extend
+};
+
+// An instruction class with the operand fields already extracted. Branch offsets are stored as 16-bit two's complement.
+struct ThumbDumbDisassembler::Decoding {
+	unsigned char kind;
+	unsigned char op;
+	unsigned char Rd, Rn, Rm;
+	unsigned short imm;		// the immediate (already scaled), branch offset, or register list.
+};
+
+static inline unsigned short branch_offset(unsigned imm, unsigned sign_bit) throw() {
+	int delta = static_cast<int>(imm << 1);
+	if (imm & sign_bit)
+		delta |= ~static_cast<int>((sign_bit << 2) - 1);
+	return static_cast<unsigned short>(delta);
+}
+
+// The patterns are tested in this order, so the earlier ones take precedence.
+ThumbDumbDisassembler::Decoding ThumbDumbDisassembler::decode_by_patterns(unsigned instruction) throw() {
+	Decoding d = {TK_Undefined, 0, 0, 0, 0, 0};
 	unsigned op_code;
-	const char* op;
 	
 	// Conditional branch
 	if ( (instruction & _(1111,____,____,____)) == _(1101,____,____,____) ) {
-		op_code = (instruction & _(____,1111,____,____)) >> 8;
-		op = ops_cond[op_code];
-		
-		unsigned imm = (instruction & _(____,____,1111,1111));
-		int delta = imm << 1;
-		if (imm & (1<<7))
-			delta |= ~_(____,___1,1111,1111);
-		
-		unsigned jump = pc + delta;
-		snprintf(decoded, 80, "b%-7s 0x%x", op, jump);
-		
-		Print(jump);
+		d.kind = TK_ConditionalBranch;
+		d.op = static_cast<unsigned char>((instruction & _(____,1111,____,____)) >> 8);
+		d.imm = branch_offset(instruction & _(____,____,1111,1111), 1<<7);
 		
 		// Unconditional branch
 	} else if ( (instruction & _(111_,1___,____,____)) == _(111_,0___,____,____) ) {
-		op_code = (instruction & _(___1,1___,____,____));
-		unsigned imm = (instruction & _(____,_111,1111,1111));
-		
-		int delta = imm << 1;
-		if (imm & (1<<10))
-			delta |= ~_(____,1111,1111,1111);
-		
-		if (!op_code) {
-			// a simple unconditional branch.
-			unsigned jump = pc + delta;
-			snprintf(decoded, 80, "b        0x%x", jump);
-			
-			Print(jump);
-			
-		} else {
-			// need to read one more instruction.
-			instruction |= instr2 << 16;
-			
-			if ( (instr2 & _(111_,1___,____,____)) == _(111_,1___,____,____) ) {
-				op_code = instr2 & (1<<12);
-				unsigned imm2 = instr2 & _(____,_111,1111,1111);
-				unsigned jump = (delta << 11 | imm2<<1) + pc;
-				
-				if (!op_code)
-					jump &= ~3;
-				
-				snprintf(decoded, 80, "%-8s 0x%x", op_code?"bl":"blx", jump);
-				Print(jump);
-				
-			} else {
-				snprintf(decoded, 80, "  ?");
-				PrintWithoutComments;
-			}
-			
-			// we assume the bl/blx will return something.
-			// NULL is the best thing we can predict.
-			r[0] = 0;
-			
-			return 4;
-		}
+		d.kind = (instruction & _(___1,1___,____,____)) ? TK_BranchWithLink : TK_Branch;
+		d.imm = branch_offset(instruction & _(____,_111,1111,1111), 1<<10);
 		
 		// Branch with Exchange
 	} else if ( (instruction & _(1111,1111,____,____)) == _(0100,0111,____,____) ) {
-		op_code = (instruction & (1<<7));
-		unsigned Rm = (instruction & _(____,____,_111,1___)) >> 3;
-		
-		snprintf(decoded, 80, "blx      %s", register_name(Rm));
-		Print(r[Rm]);
-		
-		r[0] = 0;
+		d.kind = TK_BranchWithExchange;
+		d.op = (instruction & (1<<7)) ? 1 : 0;	// blx
+		d.Rm = static_cast<unsigned char>((instruction & _(____,____,_111,1___)) >> 3);
 		
 		// Data-processing, format 1
 	} else if ( (instruction & _(1111,11__,____,____)) == _(0001,10__,____,____) ) {
-		op_code = (instruction & (1<<9));
-		op = op_code ? "sub" : "add";
-		
-		unsigned Rm = (instruction & _(____,___1,11__,____)) >> 6;
-		unsigned Rn = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd = (instruction & _(____,____,____,_111));
-		
-		snprintf(decoded, 80, "%-8s %s, %s, %s", op, register_name(Rd), register_name(Rn), register_name(Rm));
-		r[Rd] = op_code ? (r[Rn] - r[Rm]) : (r[Rn] + r[Rm]);
-		
-		Print(r[Rd]);
+		d.kind = TK_DataProcessing1;
+		d.op = (instruction & (1<<9)) ? 1 : 0;
+		d.Rm = static_cast<unsigned char>((instruction & _(____,___1,11__,____)) >> 6);
+		d.Rn = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
 		// Data-processing, format 2
 	} else if ( (instruction & _(1111,11__,____,____)) == _(0001,11__,____,____) ) {
-		op_code = (instruction & (1<<9));
-		
-		op = op_code ? "sub" : "add";
-		unsigned imm = (instruction & _(____,___1,11__,____)) >> 6;
-		unsigned Rn  = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd  = (instruction & _(____,____,____,_111));
-		
-		snprintf(decoded, 80, "%-8s %s, %s, #%d", op, register_name(Rd), register_name(Rn), imm);
-		r[Rd] = op_code ? (r[Rn] - imm) : (r[Rn] + imm);
-		
-		Print(r[Rd]);
+		d.kind = TK_DataProcessing2;
+		d.op = (instruction & (1<<9)) ? 1 : 0;
+		d.imm = static_cast<unsigned short>((instruction & _(____,___1,11__,____)) >> 6);
+		d.Rn = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
 		// Data-processing, format 3
 	} else if ( (instruction & _(111_,____,____,____)) == _(001_,____,____,____) ) {
-		op_code = (instruction & _(___1,1___,____,____)) >> 11;
-		op = ops_dp3[op_code];
-		
-		unsigned RdRn = (instruction & _(____,_111,____,____)) >> 8;
-		unsigned imm = (instruction & _(____,____,1111,1111));
-		
-		snprintf(decoded, 80, "%-8s %s, #%d", op, register_name(RdRn), imm);
-		
-		switch (op_code) {
-			case 2: r[RdRn] += imm; break;
-			case 3: r[RdRn] -= imm; break;
-			case 0: r[RdRn] = imm; break;
-		}
-		
-		Print(r[RdRn]);
+		d.kind = TK_DataProcessing3;
+		d.op = static_cast<unsigned char>((instruction & _(___1,1___,____,____)) >> 11);
+		d.Rd = static_cast<unsigned char>((instruction & _(____,_111,____,____)) >> 8);
+		d.imm = static_cast<unsigned short>(instruction & _(____,____,1111,1111));
 		
 		// Data-processing, format 4
 	} else if ( (instruction & _(111_,____,____,____)) == _(000_,____,____,____) ) {
-		op_code = (instruction & _(___1,1___,____,____)) >> 11;
-		op = ops_dp4[op_code];
-		
-		unsigned imm = (instruction & _(____,_111,11__,____)) >> 6;
-		unsigned Rm  = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd  = (instruction & _(____,____,____,_111));
-		
-		snprintf(decoded, 80, "%-8s %s, %s, #%d", op, register_name(Rd), register_name(Rm), imm);
-		
-		switch (op_code) {
-			case 0: r[Rd] = r[Rm] << imm; break;
-			case 1: r[Rd] = ((unsigned)r[Rm]) >> imm; break;
-			case 2: r[Rd] = r[Rm] >> imm; break;
-		}
-		
-		Print(r[Rd]);
+		d.kind = TK_DataProcessing4;
+		d.op = static_cast<unsigned char>((instruction & _(___1,1___,____,____)) >> 11);
+		d.imm = static_cast<unsigned short>((instruction & _(____,_111,11__,____)) >> 6);
+		d.Rm = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
 		// Data-processing, format 5
 	} else if ( (instruction & _(1111,11__,____,____)) == _(0100,00__,____,____) ) {
-		op_code = (instruction & _(____,__11,11__,____)) >> 6;
-		op = ops_dp5[op_code];
-		
-		unsigned Rm = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd = (instruction & _(____,____,____,_111));
-		
-		snprintf(decoded, 80, "%-8s %s, %s", op, register_name(Rd), register_name(Rm));
-		
-		switch (op_code) {
-			case 15: r[Rd] = ~r[Rm]; break;
-				// FIXME: check carry flag.
-			case 5: r[Rd] += r[Rm]; break;
-			case 6: r[Rd] -= r[Rm]; break;
-			case 9: r[Rd] = -r[Rm]; break;
-			case 13: r[Rd] *= r[Rm]; break;
-			case 2: r[Rd] <<= r[Rm]; break;
-			case 3: r[Rd] = ((unsigned)r[Rd]) >> r[Rm]; break;
-			case 4: r[Rd] >>= r[Rm]; break;
-			case 7: r[Rd] = ror((unsigned)r[Rd], r[Rm]); break;
-			case 0: r[Rd] &= r[Rm]; break;
-			case 1: r[Rd] ^= r[Rm]; break;
-			case 12: r[Rd] |= r[Rm]; break;
-			case 14: r[Rd] &= ~r[Rm]; break;
-		}
-		
-		Print(r[Rd]);
+		d.kind = TK_DataProcessing5;
+		d.op = static_cast<unsigned char>((instruction & _(____,__11,11__,____)) >> 6);
+		d.Rm = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
 		// Data-processing, format 6
 	} else if ( (instruction & _(1111,____,____,____)) == _(1010,____,____,____) ) {
-		op_code = (instruction & (1<<11));
-		
-		unsigned Rd =  (instruction & _(____,_111,____,____)) >> 8;
-		unsigned imm = (instruction & _(____,____,1111,1111)) * 4;
-		
-		snprintf(decoded, 80, "add      %s, %s, #%d", register_name(Rd), op_code?"sp":"pc", imm);
-		r[Rd] = (op_code?sp:pc) + imm;
-		
-		Print(r[Rd]);
+		d.kind = TK_DataProcessing6;
+		d.op = (instruction & (1<<11)) ? 1 : 0;
+		d.Rd = static_cast<unsigned char>((instruction & _(____,_111,____,____)) >> 8);
+		d.imm = static_cast<unsigned short>((instruction & _(____,____,1111,1111)) * 4);
 		
 		// Data-processing, format 7
 	} else if ( (instruction & _(1111,1111,____,____)) == _(1011,0000,____,____) ) {
-		op_code = (instruction & (1<<7));
-		
-		unsigned imm = (instruction & _(____,____,_111,1111)) * 4;
-		
-		snprintf(decoded, 80, "%-8s sp, sp, #%d", op_code ? "sub" : "add", imm);
-		if (op_code)
-			sp -= imm;
-		else
-			sp += imm;
-		
-		PrintWithoutComments;
+		d.kind = TK_DataProcessing7;
+		d.op = (instruction & (1<<7)) ? 1 : 0;
+		d.imm = static_cast<unsigned short>((instruction & _(____,____,_111,1111)) * 4);
 		
 		// Data-processing, format 8
 	} else if ( (instruction & _(1111,11__,____,____)) == _(0100,01__,____,____) ) {
-		op_code = (instruction & _(____,__11,____,____)) >> 8;
-		op = ops_dp8[op_code];
-		
-		unsigned Rm = (instruction & _(____,____,_111,1___)) >> 3;
-		unsigned RdRn = (instruction & _(____,____,____,_111)) | (instruction & (1<<7))>>4;
-		
-		snprintf(decoded, 80, "%-8s %s, %s", op, register_name(RdRn), register_name(Rm));
-		
-		// don't change pc while instrumenting the program flow.
-		if (RdRn != 15) {
-			switch (op_code) {
-				case 2: r[RdRn] = r[Rm]; break;
-				case 0: r[RdRn] += r[Rm]; break;
-			}
-			
-			Print(r[RdRn]);
-		} else {
-			switch (op_code) {
-				case 2: Print(r[Rm]); break;
-				case 0: Print(pc + r[Rm]); break;
-			}
-		}
+		d.kind = TK_DataProcessing8;
+		d.op = static_cast<unsigned char>((instruction & _(____,__11,____,____)) >> 8);
+		d.Rm = static_cast<unsigned char>((instruction & _(____,____,_111,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>((instruction & _(____,____,____,_111)) | (instruction & (1<<7))>>4);
 		
 		// Load & Store, format 1
 	} else if ( (op_code = ((instruction & _(1111,1___,____,____)) >> 11)) >= 12 && op_code <= 17 ) {
-		op_code -= 12;
-		op = ops_ls1[op_code];
-		
+		d.kind = TK_LoadStore1;
+		d.op = static_cast<unsigned char>(op_code - 12);
 		unsigned imm = (instruction & _(____,_111,11__,____)) >> 6;
-		int mask;
-		switch (op_code & ~1) {
-			case 0: imm *= 4; mask = 0xFFFFFFFF; break;
-			case 4: imm *= 2; mask = 0xFFFF; break;
-			default: mask = 0xFF; break;
+		switch (d.op & ~1) {
+			case 0: imm *= 4; break;
+			case 4: imm *= 2; break;
 		}
-		unsigned Rn = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd = (instruction & _(____,____,____,_111));
-		
-		snprintf(decoded, 80, "%-8s %s, [%s, #%d]", op, register_name(Rd), register_name(Rn), imm);
-		
-		if (op_code & 1)
-			this->load_reference(r[Rn]+imm, Rd, mask); 
-		else
-			this->store_reference(r[Rn]+imm, r[Rd], mask);
-		
-		Print(r[Rd] & mask);
+		d.imm = static_cast<unsigned short>(imm);
+		d.Rn = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
 		// Load & Store, format 2
 	} else if ( (instruction & _(1111,____,____,____)) == _(0101,____,____,____) ) {
-		op_code = (instruction & _(____,111_,____,____)) >> 9;
-		op = ops_ls2[op_code];
-		
-		unsigned Rm = (instruction & _(____,___1,11__,____)) >> 6;
-		unsigned Rn = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd = (instruction & _(____,____,____,_111));
-		
-		int mask, isSigned = (op_code == 3 || op_code == 7);
-		switch (op_code) {
-			case 4: 
-			case 0: mask = 0xFFFFFFFF; break;
-			case 5:
-			case 7: 
-			case 1: mask = 0xFFFF; break;
-			case 6:
-			case 3: 
-			case 2: mask = 0xFF; break;
-		}
-		
-		snprintf(decoded, 80, "%-8s %s, [%s, %s]", op, register_name(Rd), register_name(Rn), register_name(Rm));
-		
-		if (op_code >= 3)
-			this->load_reference(r[Rn]+r[Rm], Rd, mask, isSigned);
-		else
-			this->store_reference(r[Rn]+r[Rm], r[Rd], mask);
-		
-		Print(r[Rd] & (isSigned ? ~0 : mask));
+		d.kind = TK_LoadStore2;
+		d.op = static_cast<unsigned char>((instruction & _(____,111_,____,____)) >> 9);
+		d.Rm = static_cast<unsigned char>((instruction & _(____,___1,11__,____)) >> 6);
+		d.Rn = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
 		// Load & Store, format 3
 	} else if ( (instruction & _(1111,1___,____,____)) == _(0100,1___,____,____) ) {
-		unsigned Rd  = (instruction & _(____,_111,____,____)) >> 8;
-		unsigned imm = (instruction & _(____,____,1111,1111)) * 4;
-		
-		snprintf(decoded, 80, "ldr      %s, [pc, #%d]", register_name(Rd), imm);
-		this->load_reference((pc&~3) + imm, Rd);
-		
-		Print(r[Rd]);
+		d.kind = TK_LoadStore3;
+		d.Rd = static_cast<unsigned char>((instruction & _(____,_111,____,____)) >> 8);
+		d.imm = static_cast<unsigned short>((instruction & _(____,____,1111,1111)) * 4);
 		
 		// Load & Store, format 4
 	} else if ( (instruction & _(1111,____,____,____)) == _(1001,____,____,____) ) {
-		op_code = (instruction & (1<<11));
-		
-		unsigned  Rd = (instruction & _(____,_111,____,____)) >> 8;
-		unsigned imm = (instruction & _(____,____,1111,1111)) * 4;
-		snprintf(decoded, 80, "%-8s %s, [sp, #%d]", op_code?"ldr":"str", register_name(Rd), imm);
-		
-		if (op_code) {
-			this->load_reference(sp + imm, Rd);
-		} else {
-			this->store_reference(sp + imm, r[Rd]);
-		}
-		
-		Print(r[Rd]);
+		d.kind = TK_LoadStore4;
+		d.op = (instruction & (1<<11)) ? 1 : 0;
+		d.Rd = static_cast<unsigned char>((instruction & _(____,_111,____,____)) >> 8);
+		d.imm = static_cast<unsigned short>((instruction & _(____,____,1111,1111)) * 4);
 		
 		// Load/Store multiple, format 1
 	} else if ( (instruction & _(1111,____,____,____)) == _(1100,____,____,____) ) {
-		op_code = (instruction & (1<<11));
-		
-		unsigned Rd = (instruction & _(____,_111,____,____)) >> 8;
-		unsigned reglist = (instruction & _(____,____,1111,1111));
-		
-		snprintf(decoded, 80, "%-8s %s, %s", op_code?"ldmia":"stmia", register_name(Rd), compute_reg_list(reglist));
-		
-		if (op_code)
-			ldmia(Rd, reglist);
-		else
-			stmia(Rd, reglist);
-		
-		PrintWithoutComments;
+		d.kind = TK_LoadStoreMultiple1;
+		d.op = (instruction & (1<<11)) ? 1 : 0;
+		d.Rd = static_cast<unsigned char>((instruction & _(____,_111,____,____)) >> 8);
+		d.imm = static_cast<unsigned short>(instruction & _(____,____,1111,1111));
 		
 		// Load/Store multiple, format 2
 	} else if ( (instruction & _(1111,_11_,____,____)) == _(1011,_10_,____,____) ) {
-		op_code = (instruction & (1<<11));
-		
+		d.kind = TK_LoadStoreMultiple2;
+		d.op = (instruction & (1<<11)) ? 1 : 0;
 		unsigned reglist = (instruction & _(____,____,1111,1111));
-		if (instruction & (1<<8)) {
-			if (op_code)	// pop
-				reglist |= (1<<15);
-			else {
-				reglist |= (1<<14);
-				fprintf(m_stream, "\n\n");
-			}
-		}
+		if (instruction & (1<<8))
+			reglist |= d.op ? (1<<15) : (1<<14);	// pop pc / push lr
+		d.imm = static_cast<unsigned short>(reglist);
 		
-		snprintf(decoded, 80, "%-8s %s", op_code?"pop":"push", compute_reg_list(reglist));
-		
-		if (op_code)
-			ldmia(13, reglist);
-		else
-			stmdb(13, reglist);
-		
-		PrintWithoutComments;
-		
-		if (reglist & (1 << 15))
-			fprintf(m_stream, "\n");
-	
 		// BKPT
 	} else if ( (instruction & _(1111,1111,____,____)) == _(1011,1110,____,____) ) {
-		snprintf(decoded, 80, "bkpt     %d", instruction & 0xFF);
-		PrintWithoutComments;
-	
+		d.kind = TK_Breakpoint;
+		d.imm = static_cast<unsigned short>(instruction & 0xFF);
+		
 		// CPS
 	} else if ( (instruction & _(1111,1111,111_,1___)) == _(1011,0110,011_,0___) ) {
-		snprintf(decoded, 80, "cpsi%c    %s%s%s",
-				 (instruction&(1<<4))?'d':'e',
-				 (instruction&(1<<2))?"a":"",
-				 (instruction&(1<<1))?"i":"",
-				 (instruction&(1<<0))?"f":"");
-		PrintWithoutComments;
+		d.kind = TK_ChangeProcessorState;
+		d.op = (instruction & (1<<4)) ? 1 : 0;
+		d.imm = static_cast<unsigned short>(instruction & 7);
 		
 		// REV
 	} else if ( (instruction & _(1111,1111,____,____)) == _(1011,1010,____,____) ) {
-		op_code = (instruction & _(____,____,11__,____)) >> 6;
-		op = ops_rev[op_code];
-		
-		unsigned Rn = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd = (instruction & _(____,____,____,_111));
-
-		snprintf(decoded, 80, "%-8s %s, %s", op, register_name(Rd), register_name(Rn));
-		
-		switch (op_code) {
-			case 0:
-				r[Rd] = (r[Rn]&0xFF)<<24 | (r[Rn]&0xFF00)<<8 | (r[Rn]&0xFF0000)>>8 | ((unsigned)(r[Rn]&0xFF000000))>>24;
-				break;
-			case 1:
-				r[Rd] = (r[Rn]&0xFF)<<8 | (r[Rn]&0xFF00)>>8 | (r[Rn]&0xFF0000)<<8 | ((unsigned)(r[Rn]&0xFF000000))>>8;
-				break;
-			case 3:
-				r[Rd] = (r[Rn]&0xFF)<<8 | (r[Rn]&0xFF00)>>8;
-				if (r[Rd]&0xF0000)
-					r[Rd] |= 0xFFFF0000;
-				break;
-		}
+		d.kind = TK_Reverse;
+		d.op = static_cast<unsigned char>((instruction & _(____,____,11__,____)) >> 6);
+		d.Rn = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
 		
-		Print(r[Rd]);
-	
 		// SETEND
-		// FIXME: We're ignoring it.
 	} else if ( (instruction & _(1111,1111,1111,_111)) == _(1011,0110,0101,_000) ) {
-		snprintf(decoded, 80, "setend   %ce", instruction&(1<<3)?'b':'l');
-		PrintWithoutComments;
+		d.kind = TK_SetEndianness;
+		d.op = (instruction & (1<<3)) ? 1 : 0;
 		
 		// SWI
 	} else if ( (instruction & _(1111,1111,____,____)) == _(1101,1111,____,____) ) {
-		snprintf(decoded, 80, "swi      %d", instruction & 0xFF);
-		PrintWithoutComments;
+		d.kind = TK_SoftwareInterrupt;
+		d.imm = static_cast<unsigned short>(instruction & 0xFF);
 		
 		// Signed/Unsigned extension.
 	} else if ( (instruction & _(1111,1111,____,____)) == _(1011,0010,____,____) ) {
-		op_code = (instruction & _(____,____,11__,____)) >> 6;
-		op = ops_xt[op_code];
-		
-		unsigned Rn = (instruction & _(____,____,__11,1___)) >> 3;
-		unsigned Rd = (instruction & _(____,____,____,_111));
-		
-		snprintf(decoded, 80, "%-8s %s, %s", op, register_name(Rd), register_name(Rn));
-		
-		unsigned mask = (op_code & 1) ? 0xFF : 0xFFFF;
-		r[Rd] = r[Rn] & mask;
-		if ((op_code & 2) && (r[Rd] & ((mask+1)>>1))) {
-			r[Rd] |= ~mask;
+		d.kind = TK_Extend;
+		d.op = static_cast<unsigned char>((instruction & _(____,____,11__,____)) >> 6);
+		d.Rn = static_cast<unsigned char>((instruction & _(____,____,__11,1___)) >> 3);
+		d.Rd = static_cast<unsigned char>(instruction & _(____,____,____,_111));
+	}
+	
+	// Exception-generating instructions, or undefined instructions, are left as TK_Undefined.
+	return d;
+}
+
+// Every 16-bit opcode decoded in advance, so disassembling an instruction is one lookup and one switch.
+// The table is filled before main() runs, so it can be shared by threads without locking.
+ThumbDumbDisassembler::Decoding ThumbDumbDisassembler::s_decoding_table[0x10000];
+
+struct ThumbDumbDisassembler::DecodingTableBuilder {
+	DecodingTableBuilder() {
+		for (unsigned i = 0; i < 0x10000; ++ i)
+			s_decoding_table[i] = decode_by_patterns(i);
+	}
+};
+const ThumbDumbDisassembler::DecodingTableBuilder ThumbDumbDisassembler::s_decoding_table_builder;
+
+unsigned ThumbDumbDisassembler::instruction_length(unsigned first_halfword) throw() {
+	return s_decoding_table[first_halfword & 0xFFFF].kind == TK_BranchWithLink ? 4 : 2;
+}
+
+ThumbDumbDisassembler::FlowType ThumbDumbDisassembler::control_flow(unsigned vm_address, unsigned instruction, unsigned* p_length, unsigned* p_target) throw() {
+	const Decoding& d = s_decoding_table[instruction & 0xFFFF];
+	unsigned next_pc = vm_address + 4;
+	int delta = static_cast<short>(d.imm);
+	*p_length = 2;
+	*p_target = 0;
+	
+	switch (d.kind) {
+		case TK_ConditionalBranch:
+			// the "always" condition is undefined, and the "never" condition is swi.
+			if (d.op == 14)
+				return FT_Stop;
+			else if (d.op == 15)
+				return FT_Sequential;
+			*p_target = next_pc + delta;
+			return FT_ConditionalBranch;
+			
+		case TK_Branch:
+			*p_target = next_pc + delta;
+			return FT_Branch;
+			
+		case TK_BranchWithLink: {
+			*p_length = 4;
+			unsigned instr2 = instruction >> 16;
+			if ( (instr2 & _(111_,1___,____,____)) != _(111_,1___,____,____) )
+				return FT_Stop;
+			// blx switches to ARM code, which we cannot follow.
+			if (instr2 & (1<<12))
+				*p_target = (delta << 11 | (instr2 & _(____,_111,1111,1111))<<1) + next_pc;
+			return FT_Call;
+		}
+			
+		case TK_BranchWithExchange:
+			if (d.op)
+				return FT_IndirectCall;
+			return d.Rm == 14 ? FT_Return : FT_IndirectBranch;
+			
+		case TK_DataProcessing8:
+			if (d.Rd == 15 && (d.op == 0 || d.op == 2))
+				return (d.op == 2 && d.Rm == 14) ? FT_Return : FT_IndirectBranch;
+			return FT_Sequential;
+			
+		case TK_LoadStoreMultiple2:
+			return (d.op && (d.imm & (1<<15))) ? FT_Return : FT_Sequential;
+			
+		case TK_Breakpoint:
+		case TK_Undefined:
+			return FT_Stop;
+			
+		default:
+			return FT_Sequential;
+	}
+}
+
+unsigned ThumbDumbDisassembler::checksum_decodings(const unsigned short* opcodes, size_t count, bool table_driven) throw() {
+	unsigned checksum = 0;
+	if (table_driven) {
+		for (size_t i = 0; i < count; ++ i) {
+			const Decoding& d = s_decoding_table[opcodes[i]];
+			checksum = checksum * 31 + d.kind + d.op + d.Rd + d.Rn + d.Rm + d.imm;
 		}
-		Print(r[Rd]);
-		
-	// Exception-generating instructions, or undefined instructions.	
 	} else {
-		snprintf(decoded, 80, "  ?");
-		PrintWithoutComments;
+		for (size_t i = 0; i < count; ++ i) {
+			Decoding d = decode_by_patterns(opcodes[i]);
+			checksum = checksum * 31 + d.kind + d.op + d.Rd + d.Rn + d.Rm + d.imm;
+		}
+	}
+	return checksum;
+}
+
+#pragma mark -
+
+static const unsigned ls1_masks[] = {0xFFFFFFFF, 0xFFFFFFFF, 0xFF, 0xFF, 0xFFFF, 0xFFFF};
+static const unsigned ls2_masks[] = {0xFFFFFFFF, 0xFFFF, 0xFF, 0xFF, 0xFFFFFFFF, 0xFFFF, 0xFF, 0xFFFF};
+
+unsigned ThumbDumbDisassembler::disassemble_at(unsigned vm_address) {
+	pc = vm_address+4;
+	// nothing is formatted when only emulating.
+#define Format(...) do { if (!m_emulate_only) snprintf(decoded, 80, __VA_ARGS__); } while (0)
+#define Print(x) do { \
+	unsigned referenced = (x); \
+	if (ma_references != NULL) \
+		this->record_reference(vm_address, referenced); \
+	if (!m_emulate_only) \
+		this->print_raw_instruction(vm_address, instruction, decoded, true, referenced); \
+} while (0)
+#define PrintWithoutComments do { if (!m_emulate_only) this->print_raw_instruction(vm_address, instruction, decoded, false, 0); } while (0)
+	
+	unsigned instruction = this->read_integer();
+	unsigned instr2 = instruction >> 16;
+	instruction &= 0xFFFF;
+	
+	Decoding computed_decoding;
+	if (!m_table_driven)
+		computed_decoding = decode_by_patterns(instruction);
+	const Decoding& d = m_table_driven ? s_decoding_table[instruction] : computed_decoding;
+	
+	char decoded[80];
+	const char* op;
+	unsigned Rd = d.Rd, Rn = d.Rn, Rm = d.Rm, imm = d.imm;
+	int delta = static_cast<short>(d.imm);
+	
+	switch (d.kind) {
+		case TK_ConditionalBranch: {
+			unsigned jump = pc + delta;
+			Format("b%-7s 0x%x", ops_cond[d.op], jump);
+			Print(jump);
+			break;
+		}
+			
+		case TK_Branch: {
+			// a simple unconditional branch.
+			unsigned jump = pc + delta;
+			Format("b        0x%x", jump);
+			Print(jump);
+			break;
+		}
+			
+		case TK_BranchWithLink:
+			// need to read one more instruction.
+			instruction |= instr2 << 16;
+			
+			if ( (instr2 & _(111_,1___,____,____)) == _(111_,1___,____,____) ) {
+				unsigned op_code = instr2 & (1<<12);
+				unsigned imm2 = instr2 & _(____,_111,1111,1111);
+				unsigned jump = (delta << 11 | imm2<<1) + pc;
+				
+				if (!op_code)
+					jump &= ~3;
+				
+				Format("%-8s 0x%x", op_code?"bl":"blx", jump);
+				Print(jump);
+				
+			} else {
+				Format("  ?");
+				PrintWithoutComments;
+			}
+			
+			// we assume the bl/blx will return something.
+			// NULL is the best thing we can predict.
+			r[0] = 0;
+			
+			return 4;
+			
+		case TK_BranchWithExchange:
+			Format("blx      %s", register_name(Rm));
+			Print(r[Rm]);
+			r[0] = 0;
+			break;
+			
+		case TK_DataProcessing1:
+			Format("%-8s %s, %s, %s", d.op ? "sub" : "add", register_name(Rd), register_name(Rn), register_name(Rm));
+			r[Rd] = d.op ? (r[Rn] - r[Rm]) : (r[Rn] + r[Rm]);
+			Print(r[Rd]);
+			break;
+			
+		case TK_DataProcessing2:
+			Format("%-8s %s, %s, #%d", d.op ? "sub" : "add", register_name(Rd), register_name(Rn), imm);
+			r[Rd] = d.op ? (r[Rn] - imm) : (r[Rn] + imm);
+			Print(r[Rd]);
+			break;
+			
+		case TK_DataProcessing3:
+			Format("%-8s %s, #%d", ops_dp3[d.op], register_name(Rd), imm);
+			switch (d.op) {
+				case 2: r[Rd] += imm; break;
+				case 3: r[Rd] -= imm; break;
+				case 0: r[Rd] = imm; break;
+			}
+			Print(r[Rd]);
+			break;
+			
+		case TK_DataProcessing4:
+			Format("%-8s %s, %s, #%d", ops_dp4[d.op], register_name(Rd), register_name(Rm), imm);
+			switch (d.op) {
+				case 0: r[Rd] = r[Rm] << imm; break;
+				case 1: r[Rd] = ((unsigned)r[Rm]) >> imm; break;
+				case 2: r[Rd] = r[Rm] >> imm; break;
+			}
+			Print(r[Rd]);
+			break;
+			
+		case TK_DataProcessing5:
+			Format("%-8s %s, %s", ops_dp5[d.op], register_name(Rd), register_name(Rm));
+			switch (d.op) {
+				case 15: r[Rd] = ~r[Rm]; break;
+					// FIXME: check carry flag.
+				case 5: r[Rd] += r[Rm]; break;
+				case 6: r[Rd] -= r[Rm]; break;
+				case 9: r[Rd] = -r[Rm]; break;
+				case 13: r[Rd] *= r[Rm]; break;
+				case 2: r[Rd] <<= r[Rm]; break;
+				case 3: r[Rd] = ((unsigned)r[Rd]) >> r[Rm]; break;
+				case 4: r[Rd] >>= r[Rm]; break;
+				case 7: r[Rd] = ror((unsigned)r[Rd], r[Rm]); break;
+				case 0: r[Rd] &= r[Rm]; break;
+				case 1: r[Rd] ^= r[Rm]; break;
+				case 12: r[Rd] |= r[Rm]; break;
+				case 14: r[Rd] &= ~r[Rm]; break;
+			}
+			Print(r[Rd]);
+			break;
+			
+		case TK_DataProcessing6:
+			Format("add      %s, %s, #%d", register_name(Rd), d.op?"sp":"pc", imm);
+			r[Rd] = (d.op?sp:pc) + imm;
+			Print(r[Rd]);
+			break;
+			
+		case TK_DataProcessing7:
+			Format("%-8s sp, sp, #%d", d.op ? "sub" : "add", imm);
+			if (d.op)
+				sp -= imm;
+			else
+				sp += imm;
+			PrintWithoutComments;
+			break;
+			
+		case TK_DataProcessing8:
+			Format("%-8s %s, %s", ops_dp8[d.op], register_name(Rd), register_name(Rm));
+			
+			// don't change pc while instrumenting the program flow.
+			if (Rd != 15) {
+				switch (d.op) {
+					case 2: r[Rd] = r[Rm]; break;
+					case 0: r[Rd] += r[Rm]; break;
+				}
+				Print(r[Rd]);
+			} else {
+				switch (d.op) {
+					case 2: Print(r[Rm]); break;
+					case 0: Print(pc + r[Rm]); break;
+				}
+			}
+			break;
+			
+		case TK_LoadStore1: {
+			unsigned mask = ls1_masks[d.op];
+			Format("%-8s %s, [%s, #%d]", ops_ls1[d.op], register_name(Rd), register_name(Rn), imm);
+			if (d.op & 1)
+				this->load_reference(r[Rn]+imm, Rd, mask); 
+			else
+				this->store_reference(r[Rn]+imm, r[Rd], mask);
+			Print(r[Rd] & mask);
+			break;
+		}
+			
+		case TK_LoadStore2: {
+			unsigned mask = ls2_masks[d.op];
+			bool isSigned = (d.op == 3 || d.op == 7);
+			Format("%-8s %s, [%s, %s]", ops_ls2[d.op], register_name(Rd), register_name(Rn), register_name(Rm));
+			if (d.op >= 3)
+				this->load_reference(r[Rn]+r[Rm], Rd, mask, isSigned);
+			else
+				this->store_reference(r[Rn]+r[Rm], r[Rd], mask);
+			Print(r[Rd] & (isSigned ? ~0 : mask));
+			break;
+		}
+			
+		case TK_LoadStore3:
+			Format("ldr      %s, [pc, #%d]", register_name(Rd), imm);
+			this->load_reference((pc&~3) + imm, Rd);
+			Print(r[Rd]);
+			break;
+			
+		case TK_LoadStore4:
+			Format("%-8s %s, [sp, #%d]", d.op?"ldr":"str", register_name(Rd), imm);
+			if (d.op)
+				this->load_reference(sp + imm, Rd);
+			else
+				this->store_reference(sp + imm, r[Rd]);
+			Print(r[Rd]);
+			break;
+			
+		case TK_LoadStoreMultiple1:
+			Format("%-8s %s, %s", d.op?"ldmia":"stmia", register_name(Rd), compute_reg_list(imm));
+			if (d.op)
+				ldmia(Rd, imm);
+			else
+				stmia(Rd, imm);
+			PrintWithoutComments;
+			break;
+			
+		case TK_LoadStoreMultiple2:
+			// a push of lr starts a new function.
+			if (!d.op && (imm & (1<<14)) && !m_emulate_only)
+				m_output.write("\n\n");
+			
+			Format("%-8s %s", d.op?"pop":"push", compute_reg_list(imm));
+			if (d.op)
+				ldmia(13, imm);
+			else
+				stmdb(13, imm);
+			PrintWithoutComments;
+			
+			if ((imm & (1 << 15)) && !m_emulate_only)
+				m_output.put('\n');
+			break;
+			
+		case TK_Breakpoint:
+			Format("bkpt     %d", imm);
+			PrintWithoutComments;
+			break;
+			
+		case TK_ChangeProcessorState:
+			Format("cpsi%c    %s%s%s",
+					 d.op?'d':'e',
+					 (imm&(1<<2))?"a":"",
+					 (imm&(1<<1))?"i":"",
+					 (imm&(1<<0))?"f":"");
+			PrintWithoutComments;
+			break;
+			
+		case TK_Reverse:
+			op = ops_rev[d.op];
+			Format("%-8s %s, %s", op, register_name(Rd), register_name(Rn));
+			switch (d.op) {
+				case 0:
+					r[Rd] = (r[Rn]&0xFF)<<24 | (r[Rn]&0xFF00)<<8 | (r[Rn]&0xFF0000)>>8 | ((unsigned)(r[Rn]&0xFF000000))>>24;
+					break;
+				case 1:
+					r[Rd] = (r[Rn]&0xFF)<<8 | (r[Rn]&0xFF00)>>8 | (r[Rn]&0xFF0000)<<8 | ((unsigned)(r[Rn]&0xFF000000))>>8;
+					break;
+				case 3:
+					r[Rd] = (r[Rn]&0xFF)<<8 | (r[Rn]&0xFF00)>>8;
+					if (r[Rd]&0xF0000)
+						r[Rd] |= 0xFFFF0000;
+					break;
+			}
+			Print(r[Rd]);
+			break;
+			
+		// FIXME: We're ignoring it.
+		case TK_SetEndianness:
+			Format("setend   %ce", d.op?'b':'l');
+			PrintWithoutComments;
+			break;
+			
+		case TK_SoftwareInterrupt:
+			Format("swi      %d", imm);
+			PrintWithoutComments;
+			break;
+			
+		case TK_Extend: {
+			op = ops_xt[d.op];
+			Format("%-8s %s, %s", op, register_name(Rd), register_name(Rn));
+			unsigned mask = (d.op & 1) ? 0xFF : 0xFFFF;
+			r[Rd] = r[Rn] & mask;
+			if ((d.op & 2) && (r[Rd] & ((mask+1)>>1))) {
+				r[Rd] |= ~mask;
+			}
+			Print(r[Rd]);
+			break;
+		}
+			
+		default:
+			Format("  ?");
+			PrintWithoutComments;
+			break;
 	}
 	
 	return 2;
@@ -25,11 +25,48 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "AbstractARMDumbDisassembler.h"
 
 class ThumbDumbDisassembler : public AbstractARMDumbDisassembler {
+	struct Decoding;
+	struct DecodingTableBuilder;
+	friend struct DecodingTableBuilder;
+	
+	static Decoding s_decoding_table[0x10000];
+	static const DecodingTableBuilder s_decoding_table_builder;
+	
+	bool m_table_driven;
+	
+	static Decoding decode_by_patterns(unsigned instruction) throw();
+	
 public:
-	ThumbDumbDisassembler(MachO_File& file, std::FILE* stream = stdout) : AbstractARMDumbDisassembler(file, stream) {}
+	// how an instruction changes the program flow.
+	enum FlowType {
+		FT_Sequential,
+		FT_ConditionalBranch,
+		FT_Branch,
+		FT_Call,			// the target is 0 if the callee is ARM code.
+		FT_IndirectCall,
+		FT_Return,
+		FT_IndirectBranch,
+		FT_Stop				// undefined instructions and breakpoints.
+	};
+	
+	ThumbDumbDisassembler(MachO_File& file, std::FILE* stream = stdout) : AbstractARMDumbDisassembler(file, stream), m_table_driven(true) {}
+	ThumbDumbDisassembler(MachO_File& file, std::string& output) : AbstractARMDumbDisassembler(file, output), m_table_driven(true) {}
 	
 	virtual void print_raw_instruction(unsigned vm_address, unsigned instruction, const char* decoded, bool hasR, unsigned R) const;
 	virtual unsigned disassemble_at(unsigned vm_address);
+	
+	// decode with the precomputed table (the default), or by matching the instruction patterns one by one.
+	void set_table_driven(bool table_driven) throw() { m_table_driven = table_driven; }
+	
+	// the number of bytes disassemble_at() consumes for an instruction starting with this halfword: 4 for bl/blx, 2 otherwise.
+	static unsigned instruction_length(unsigned first_halfword) throw();
+	
+	// classify the instruction at vm_address. "instruction" is the 32-bit word read there, so that the second half of bl/blx is available.
+	// The instruction length is written to *p_length, and the branch or call target, if known, to *p_target.
+	static FlowType control_flow(unsigned vm_address, unsigned instruction, unsigned* p_length, unsigned* p_target) throw();
+	
+	// decode the opcodes without disassembling them, returning a checksum of the decoded fields. Used for benchmarking.
+	static unsigned checksum_decodings(const unsigned short* opcodes, std::size_t count, bool table_driven) throw();
 };
 
 #endif
\ No newline at end of file
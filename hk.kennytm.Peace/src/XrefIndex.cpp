@@ -0,0 +1,192 @@
+/*
+
+XrefIndex.cpp ... Cross-reference index of disassembled code
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "XrefIndex.h"
+#include "MachO_File.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <tr1/unordered_map>
+
+using namespace std;
+
+struct XrefIndexHeader {
+	char magic[8];
+	unsigned version;
+	unsigned target_count;
+	unsigned referrer_count;
+	unsigned strings_size;
+};
+
+static const char xref_magic[8] = {'P', 'e', 'a', 'c', 'e', 'X', 'r', 'f'};
+
+static bool reference_less(const XrefIndex::Reference& a, const XrefIndex::Reference& b) throw() {
+	return a.to < b.to || (a.to == b.to && a.from < b.from);
+}
+
+static bool reference_equal(const XrefIndex::Reference& a, const XrefIndex::Reference& b) throw() {
+	return a.to == b.to && a.from == b.from;
+}
+
+static bool target_address_less(const XrefIndex::Target& target, unsigned address) throw() {
+	return target.address < address;
+}
+
+struct XrefIndex::NameComparator {
+	const XrefIndex* index;
+	const vector<Target>* targets;
+	const vector<char>* strings;
+	
+	const char* name(unsigned i) const throw() {
+		if (targets != NULL)
+			return &(*strings)[(*targets)[i].name];
+		return i < index->m_target_count ? index->name_of(index->ma_targets[i]) : "";
+	}
+	
+	bool operator() (unsigned a, unsigned b) const throw() { return strcmp(name(a), name(b)) < 0; }
+	bool operator() (unsigned a, const char* b) const throw() { return strcmp(name(a), b) < 0; }
+	bool operator() (const char* a, unsigned b) const throw() { return strcmp(a, name(b)) < 0; }
+};
+
+#pragma mark -
+
+bool XrefIndex::write(const char* path, const MachO_File& file, vector<Reference>& references) {
+	sort(references.begin(), references.end(), reference_less);
+	references.erase(unique(references.begin(), references.end(), reference_equal), references.end());
+	
+	vector<Target> targets;
+	vector<unsigned> referrers;
+	vector<char> strings;
+	tr1::unordered_map<string, unsigned> string_offsets;
+	referrers.reserve(references.size());
+	
+	for (vector<Reference>::const_iterator cit = references.begin(); cit != references.end(); ++ cit) {
+		if (targets.empty() || targets.back().address != cit->to) {
+			const char* name = file.string_representation(cit->to);
+			string name_string = name != NULL ? name : "";
+			
+			Target target;
+			target.address = cit->to;
+			target.kind = cit->kind;
+			target.first_referrer = static_cast<unsigned>(referrers.size());
+			target.referrer_count = 0;
+			
+			tr1::unordered_map<string, unsigned>::const_iterator offset_it = string_offsets.find(name_string);
+			if (offset_it != string_offsets.end())
+				target.name = offset_it->second;
+			else {
+				target.name = static_cast<unsigned>(strings.size());
+				strings.insert(strings.end(), name_string.begin(), name_string.end());
+				strings.push_back('\0');
+				string_offsets.insert(pair<string, unsigned>(name_string, target.name));
+			}
+			
+			targets.push_back(target);
+		}
+		referrers.push_back(cit->from);
+		++ targets.back().referrer_count;
+	}
+	
+	// the targets are sorted by address, so a stable sort keeps targets of the same name in address order.
+	vector<unsigned> targets_by_name (targets.size());
+	for (unsigned i = 0; i < targets.size(); ++ i)
+		targets_by_name[i] = i;
+	NameComparator comparator = {NULL, &targets, &strings};
+	stable_sort(targets_by_name.begin(), targets_by_name.end(), comparator);
+	
+	XrefIndexHeader header;
+	memcpy(header.magic, xref_magic, sizeof(xref_magic));
+	header.version = Version;
+	header.target_count = static_cast<unsigned>(targets.size());
+	header.referrer_count = static_cast<unsigned>(referrers.size());
+	header.strings_size = static_cast<unsigned>(strings.size());
+	
+	AtomicFileWriter writer (path);
+	writer.write(&header, sizeof(header));
+	if (!targets.empty()) {
+		writer.write(&targets[0], targets.size() * sizeof(Target));
+		writer.write(&targets_by_name[0], targets_by_name.size() * sizeof(unsigned));
+	}
+	if (!referrers.empty())
+		writer.write(&referrers[0], referrers.size() * sizeof(unsigned));
+	if (!strings.empty())
+		writer.write(&strings[0], strings.size());
+	return writer.commit();
+}
+
+#pragma mark -
+
+XrefIndex::XrefIndex(const char* path) : mp_file(new DataFile(path)) {
+	const XrefIndexHeader* header = mp_file->peek_data_at<XrefIndexHeader>(0);
+	
+	// only the sizes are checked here, so opening the index does not touch the whole file.
+	// The entries are checked as they are used.
+	bool ok = header != NULL && memcmp(header->magic, xref_magic, sizeof(xref_magic)) == 0 && header->version == Version;
+	ok = ok && header->target_count < (1u << 26) && header->referrer_count < (1u << 30);
+	ok = ok && static_cast<off_t>(sizeof(XrefIndexHeader)) + static_cast<off_t>(header->target_count) * static_cast<off_t>(sizeof(Target) + sizeof(unsigned))
+			+ static_cast<off_t>(header->referrer_count) * static_cast<off_t>(sizeof(unsigned)) + static_cast<off_t>(header->strings_size) == mp_file->filesize();
+	ok = ok && (header->strings_size == 0 || mp_file->data()[mp_file->filesize()-1] == '\0');
+	
+	if (!ok) {
+		delete mp_file;
+		throw TRException("XrefIndex::XrefIndex(const char*):\n\t\"%s\" is not a cross-reference index of this version.", path);
+	}
+	
+	m_target_count = header->target_count;
+	m_referrer_count = header->referrer_count;
+	m_strings_size = header->strings_size;
+	
+	const char* cursor = mp_file->data() + sizeof(XrefIndexHeader);
+	ma_targets = reinterpret_cast<const Target*>(cursor);
+	cursor += m_target_count * sizeof(Target);
+	ma_targets_by_name = reinterpret_cast<const unsigned*>(cursor);
+	cursor += m_target_count * sizeof(unsigned);
+	ma_referrers = reinterpret_cast<const unsigned*>(cursor);
+	cursor += m_referrer_count * sizeof(unsigned);
+	ma_strings = cursor;
+}
+
+XrefIndex::~XrefIndex() throw() {
+	delete mp_file;
+}
+
+const XrefIndex::Target* XrefIndex::target_at(unsigned address) const throw() {
+	const Target* targets_end = ma_targets + m_target_count;
+	const Target* target = lower_bound(ma_targets, targets_end, address, target_address_less);
+	return (target != targets_end && target->address == address) ? target : NULL;
+}
+
+pair<const unsigned*, const unsigned*> XrefIndex::targets_named(const char* name) const throw() {
+	NameComparator comparator = {this, NULL, NULL};
+	return equal_range(ma_targets_by_name, ma_targets_by_name + m_target_count, name, comparator);
+}
+
+const char* XrefIndex::name_of(const Target& target) const throw() {
+	return target.name < m_strings_size ? ma_strings + target.name : "";
+}
+
+pair<const unsigned*, const unsigned*> XrefIndex::referrers_of(const Target& target) const throw() {
+	if (target.first_referrer > m_referrer_count || target.referrer_count > m_referrer_count - target.first_referrer)
+		return pair<const unsigned*, const unsigned*>(ma_referrers, ma_referrers);
+	const unsigned* begin = ma_referrers + target.first_referrer;
+	return pair<const unsigned*, const unsigned*>(begin, begin + target.referrer_count);
+}
@@ -0,0 +1,89 @@
+/*
+
+XrefIndex.h ... Cross-reference index of disassembled code
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef XREFINDEX_H
+#define XREFINDEX_H
+
+#include <vector>
+#include <utility>
+#include "DataFile.h"
+
+class MachO_File;
+
+// An index file is laid out as
+//   XrefIndexHeader, targets (sorted by address), target indices sorted by name, referrers, string pool.
+// The referrers of a target are the addresses of the instructions referencing it, stored contiguously and sorted.
+// The file is mapped and searched in place, so a query does not need the image or a pass over the whole index.
+class XrefIndex {
+public:
+	// bump this whenever the layout changes.
+	static const unsigned Version = 1;
+	
+	// the instruction at "from" references "to", which has a string representation of type "kind" (a MachO_File::StringType).
+	struct Reference {
+		unsigned from, to, kind;
+	};
+	
+	struct Target {
+		unsigned address;
+		unsigned kind;
+		unsigned name;				// offset into the string pool.
+		unsigned first_referrer;
+		unsigned referrer_count;
+	};
+
+private:
+	DataFile* mp_file;
+	const Target* ma_targets;
+	const unsigned* ma_targets_by_name;
+	const unsigned* ma_referrers;
+	const char* ma_strings;
+	unsigned m_target_count, m_referrer_count, m_strings_size;
+	
+	XrefIndex(const XrefIndex&);
+	XrefIndex& operator=(const XrefIndex&);
+	
+	struct NameComparator;
+
+public:
+	// sort and deduplicate the references, and write them with the names of their targets in "file".
+	// Returns false if the index cannot be written.
+	static bool write(const char* path, const MachO_File& file, std::vector<Reference>& references);
+	
+	// throws TRException if the file is not a valid index.
+	explicit XrefIndex(const char* path);
+	~XrefIndex() throw();
+	
+	inline unsigned target_count() const throw() { return m_target_count; }
+	inline unsigned referrer_count() const throw() { return m_referrer_count; }
+	inline const Target& target(unsigned i) const throw() { return ma_targets[i]; }
+	
+	// NULL if nothing references this address.
+	const Target* target_at(unsigned address) const throw();
+	// the indices of all targets having this name.
+	std::pair<const unsigned*, const unsigned*> targets_named(const char* name) const throw();
+	
+	// a target read from a corrupted file has no name and no referrers.
+	const char* name_of(const Target& target) const throw();
+	std::pair<const unsigned*, const unsigned*> referrers_of(const Target& target) const throw();
+};
+
+#endif
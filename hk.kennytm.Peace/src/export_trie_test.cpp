@@ -0,0 +1,87 @@
+/*
+
+export_trie_test.cpp ... Test if exported symbols resolve to their nlist addresses.
+
+Copyright (C) 2009  KennyTM~
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MachO_File.h"
+#include <mach-o/nlist.h>
+#include <cstdio>
+#include <cstring>
+
+// an image having both an export trie and a symbol table lists every export twice.
+// The nlist n_value is a vm_address, so the export trie must give the same one.
+class ExportTrieTestFile : public MachO_File {
+public:
+	ExportTrieTestFile(const char* path) : MachO_File(path) {}
+	
+	// returns the number of mismatches, or -1 if nothing was checked.
+	int check(const char* only_symbol) {
+		unsigned checked = 0, mismatches = 0;
+		
+		for (std::vector<const load_command*>::const_iterator cit = ma_load_commands.begin(); cit != ma_load_commands.end(); ++ cit) {
+			if ((*cit)->cmd != LC_SYMTAB)
+				continue;
+				
+			const symtab_command* symtab = reinterpret_cast<const symtab_command*>(*cit);
+			const struct nlist* symbols = this->peek_data_at<struct nlist>(m_origin + symtab->symoff);
+			const char* strings = this->peek_data_at<char>(m_origin + symtab->stroff);
+			if (symbols == NULL || strings == NULL)
+				continue;
+				
+			for (unsigned i = 0; i < symtab->nsyms; ++ i) {
+				if ((symbols[i].n_type & N_TYPE) != N_SECT || !(symbols[i].n_type & N_EXT))
+					continue;
+				const char* name = strings + symbols[i].n_un.n_strx;
+				if (only_symbol != NULL && std::strcmp(name, only_symbol) != 0)
+					continue;
+					
+				unsigned address, flags;
+				if (!this->lookup_export(name, &address, &flags) || (flags & EXPORT_SYMBOL_FLAGS_REEXPORT))
+					continue;
+					
+				unsigned expected = symbols[i].n_value & ~1u;
+				unsigned resolved = this->address_of_symbol(name);
+				++ checked;
+				if (address != expected || resolved != expected) {
+					std::printf("%s: nlist %08x, lookup_export %08x, address_of_symbol %08x\n", name, expected, address, resolved);
+					++ mismatches;
+				}
+			}
+		}
+		
+		return checked == 0 ? -1 : static_cast<int>(mismatches);
+	}
+};
+
+int main (int argc, const char* argv[]) {
+	if (argc < 2) {
+		std::printf("Usage: export_trie_test <file> [<symbol>]\n");
+		return 2;
+	}
+	
+	ExportTrieTestFile f (argv[1]);
+	int mismatches = f.check(argc >= 3 ? argv[2] : NULL);
+	if (mismatches < 0) {
+		std::printf("No exported symbol is also in the symbol table.\n");
+		return 1;
+	}
+	
+	std::printf("%d mismatches.\n", mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
@@ -45,32 +45,49 @@ static const char* const rights[] = {
 };
 
 static void g(unsigned addr, const char* symbol, MachO_File::StringType type, void* context) {
-	printf("%08x %c %s%s%s\n", addr, tns[type], lefts[type], symbol, rights[type]);
+	OutputWriter& output = *static_cast<OutputWriter*>(context);
+	output.write_hex(addr, 8);
+	output.put(' ');
+	output.put(tns[type]);
+	output.put(' ');
+	output.write(lefts[type]);
+	output.write(symbol);
+	output.write(rights[type]);
+	output.put('\n');
 }
 
 int main (int argc, const char* argv[]) {
 	if (argc == 1) {
-		std::printf("Usage: list_symbols [-arch <arch>] <file>\n");
+		std::printf("Usage: list_symbols [-arch <arch>] [-cache <dir>] <file>\n");
 	} else {
-		const char* filename = NULL, *arch = "any";
-		bool read_arch = false;
+		const char* filename = NULL, *arch = "any", *cache_dir = NULL;
+		bool read_arch = false, read_cache_dir = false;
 		
 		for (int i = 1; i < argc; ++ i) {
 			if (std::strcmp(argv[i], "-arch") == 0) {
 				read_arch = true;
+			} else if (std::strcmp(argv[i], "-cache") == 0) {
+				read_cache_dir = true;
 			} else {
 				if (read_arch) {
 					arch = argv[i];
 					read_arch = false;
+				} else if (read_cache_dir) {
+					cache_dir = argv[i];
+					read_cache_dir = false;
 				} else {
 					filename = argv[i];
 				}
 			}
 		}
 		
+		if (cache_dir != NULL && !AnalysisCache::set_directory(cache_dir))
+			std::fprintf(stderr, "list_symbols: cannot use '%s' as the cache directory.\n", cache_dir);
+		
 		if (filename) {
 			MachO_File f (filename, arch);
-			f.for_each_symbol(g, &f);
+			OutputWriter output (stdout);
+			f.for_each_symbol(g, &output);
 		}
 	}
 }
\ No newline at end of file
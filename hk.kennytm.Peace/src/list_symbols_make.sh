@@ -1,3 +1,3 @@
 #!/bin/sh
 
-g++ -m32 -O2 list_symbols.cpp get_arch_from_flag.c MachO_File.cpp DataFile.cpp -I../include -I/opt/local/include -o list_symbols
+g++ -m32 -O2 -pthread list_symbols.cpp get_arch_from_flag.c MachO_File.cpp SymbolIndex.cpp StringArena.cpp ExportTrie.cpp DyldInfoDecoder.cpp AnalysisCache.cpp ImageCache.cpp DataFile.cpp OutputWriter.cpp -I../include -I/opt/local/include -o list_symbols
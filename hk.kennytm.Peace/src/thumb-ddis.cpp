@@ -22,21 +22,334 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "DataFile.h"
 #include "MachO_File.h"
 #include "ThumbDumbDisassembler.h"
+#include "Threading.h"
+#include "XrefIndex.h"
+#include "ControlFlowGraph.h"
+#include "OutputWriter.h"
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <string>
+#include <algorithm>
 
 void print_section(const section* s) {
 	printf(" ; %8x\t%08x\t%8x\t%s,%s\n", s->offset, s->addr, s->size, s->segname, s->sectname);
 }
 
+static void print_rate(const char* title, std::clock_t start, std::clock_t end, double instructions) {
+	double seconds = static_cast<double>(end - start) / CLOCKS_PER_SEC;
+	if (seconds > 0)
+		printf("%-32s %8.3f s  %10.2f M instructions/s\n", title, seconds, instructions / seconds / 1e6);
+	else
+		printf("%-32s %8.3f s\n", title, seconds);
+}
+
+// Compare the table-driven decoder with the pattern-matching one, both on decoding alone and on the whole disassembly,
+// and the OutputWriter with fprintf on printing the listing. Returns false if the range is not in the file.
+static bool benchmark(MachO_File& f, unsigned start_vm, unsigned end_vm) {
+	static const unsigned decode_repeats = 16;
+	
+	off_t start_offset = f.to_file_offset(start_vm);
+	unsigned count = (end_vm - start_vm + 2) / 2;
+	if (start_offset == 0 || start_offset + static_cast<off_t>(count*2) > f.filesize()) {
+		fprintf(stderr, "Error: The range 0x%x to 0x%x is not inside the file.\n", start_vm, end_vm);
+		return false;
+	}
+	
+	std::vector<unsigned short> opcodes (count);
+	if (count > 0)
+		std::memcpy(&opcodes[0], f.data() + start_offset, count*2);
+	
+	printf(" ; Benchmarking %u instructions from 0x%x to 0x%x.\n", count, start_vm, end_vm);
+	
+	for (int table_driven = 1; table_driven >= 0; -- table_driven) {
+		unsigned checksum = 0;
+		std::clock_t start = std::clock();
+		for (unsigned i = 0; i < decode_repeats; ++ i)
+			checksum += ThumbDumbDisassembler::checksum_decodings(count > 0 ? &opcodes[0] : NULL, count, table_driven != 0);
+		std::clock_t end = std::clock();
+		printf(" ; checksum %08x\n", checksum);
+		print_rate(table_driven ? "decode only (table)" : "decode only (patterns)", start, end, static_cast<double>(count) * decode_repeats);
+	}
+	
+#if _MSC_VER
+	std::FILE* null_stream = fopen("NUL", "w");
+#else
+	std::FILE* null_stream = fopen("/dev/null", "w");
+#endif
+	if (null_stream == NULL) {
+		perror("Error: Cannot open the null device");
+		return false;
+	}
+	
+	for (int table_driven = 1; table_driven >= 0; -- table_driven) {
+		ThumbDumbDisassembler d (f, null_stream);
+		d.set_table_driven(table_driven != 0);
+		std::clock_t start = std::clock();
+		d.disassemble_in_range(start_vm, end_vm-start_vm+2);
+		std::clock_t end = std::clock();
+		print_rate(table_driven ? "disassemble (table)" : "disassemble (patterns)", start, end, count);
+	}
+	
+	// the output alone, on lines shaped like those of the listing.
+	static const char* const sample_decoded[] = {"ldr      r0, [pc, #0x40]", "bl       0x2a4c", "push     {r4,r5,r7,lr}", "movs     r3, #1"};
+	static const char* const sample_reference = "@selector(initWithFrame:)";
+	{
+		std::clock_t start = std::clock();
+		for (unsigned i = 0; i < decode_repeats; ++ i)
+			for (unsigned j = 0; j < count; ++ j)
+				fprintf(null_stream, "%08x\t%s%04x\t%-48s; %8x = %s\n", start_vm+2*j, "    ", opcodes[j], sample_decoded[j%4], start_vm+j, sample_reference);
+		std::clock_t end = std::clock();
+		print_rate("print listing (stdio)", start, end, static_cast<double>(count) * decode_repeats);
+	}
+	{
+		OutputWriter output (null_stream);
+		std::clock_t start = std::clock();
+		for (unsigned i = 0; i < decode_repeats; ++ i)
+			for (unsigned j = 0; j < count; ++ j) {
+				output.write_hex(start_vm+2*j, 8);
+				output.write("\t    ");
+				output.write_hex(opcodes[j], 4);
+				output.put('\t');
+				output.write_padded(sample_decoded[j%4], 48);
+				output.write("; ");
+				output.write_hex(start_vm+j, 8, ' ');
+				output.write(" = ");
+				output.write_escaped(sample_reference);
+				output.put('\n');
+			}
+		output.flush();
+		std::clock_t end = std::clock();
+		print_rate("print listing (writer)", start, end, static_cast<double>(count) * decode_repeats);
+	}
+	
+	fclose(null_stream);
+	return true;
+}
+
+#pragma mark -
+
+struct ParallelChunk {
+	unsigned start_vm;
+	size_t bytes;
+	std::string output;
+	bool finished, failed;
+	AbstractARMDumbDisassembler::EmulationState state;
+};
+
+struct ParallelDisassembly {
+	MachO_File* file;
+	const ControlFlowGraph* cfg;
+	std::vector<ParallelChunk> chunks;
+	Mutex print_mutex;
+	size_t next_chunk_to_print;
+	bool success;
+};
+
+static void collect_function_start(unsigned addr, const char*, MachO_File::StringType type, void* context) {
+	if (type == MachO_File::MOST_Symbol || type == MachO_File::MOST_ObjCMethod)
+		static_cast<std::vector<unsigned>*>(context)->push_back(addr);
+}
+
+// the output of a chunk is kept in memory only until the chunks before it are printed.
+// The chunks are handed out in address order, so only a few are waiting at any time.
+static void disassemble_chunk(void* context, std::size_t index) {
+	ParallelDisassembly* job = static_cast<ParallelDisassembly*>(context);
+	ParallelChunk& chunk = job->chunks[index];
+	
+	try {
+		ThumbDumbDisassembler d (*job->file, chunk.output);
+		d.restore_state(chunk.state);
+		d.set_control_flow_graph(job->cfg);
+		d.disassemble_in_range(chunk.start_vm, chunk.bytes);
+	} catch (...) {
+		chunk.failed = true;
+	}
+	
+	ScopedLock lock (job->print_mutex);
+	chunk.finished = true;
+	while (job->next_chunk_to_print < job->chunks.size() && job->chunks[job->next_chunk_to_print].finished) {
+		ParallelChunk& ready_chunk = job->chunks[job->next_chunk_to_print];
+		if (ready_chunk.failed) {
+			if (job->success)
+				fprintf(stderr, "Error: Cannot disassemble the chunk at 0x%x.\n", ready_chunk.start_vm);
+			job->success = false;
+		} else if (job->success)
+			fwrite(ready_chunk.output.data(), 1, ready_chunk.output.size(), stdout);
+		std::string().swap(ready_chunk.output);
+		++ job->next_chunk_to_print;
+	}
+}
+
+// Split the range at function starts and disassemble the pieces on thread_count threads.
+// The emulation state at the start of each piece is found by a serial pass which prints nothing,
+// so the output is the same as disassembling the whole range serially.
+static bool disassemble_in_parallel(MachO_File& f, unsigned start_vm, size_t range_bytes, unsigned thread_count, const ControlFlowGraph* cfg) {
+	// the symbol tables are built here, since building them from the workers is not thread-safe.
+	std::vector<unsigned> function_starts;
+	f.for_each_symbol(&collect_function_start, &function_starts);
+	if (cfg != NULL) {
+		for (std::size_t i = 0; i < cfg->function_count(); ++ i)
+			function_starts.push_back(cfg->function(i).entry);
+	}
+	std::sort(function_starts.begin(), function_starts.end());
+	
+	// only split at addresses where the serial disassembly would start an instruction,
+	// i.e. not in the middle of a bl/blx pair.
+	std::vector<unsigned> split_points;
+	std::vector<unsigned>::const_iterator next_start = std::lower_bound(function_starts.begin(), function_starts.end(), start_vm+1);
+	off_t offset = f.to_file_offset(start_vm);
+	unsigned end_vm = static_cast<unsigned>(start_vm + range_bytes);
+	for (unsigned addr = start_vm; addr < end_vm && next_start != function_starts.end(); ) {
+		while (next_start != function_starts.end() && *next_start < addr)
+			++ next_start;
+		if (next_start != function_starts.end() && *next_start == addr) {
+			split_points.push_back(addr);
+			++ next_start;
+		}
+		const unsigned short* halfword = f.peek_data_at<unsigned short>(offset);
+		unsigned length = halfword != NULL ? ThumbDumbDisassembler::instruction_length(*halfword) : 2;
+		addr += length;
+		offset += length;
+	}
+	
+	// group the functions into a few chunks per thread, so the threads are kept busy without too many buffers.
+	size_t chunk_size = std::max<size_t>(range_bytes / (thread_count * 16), 4096);
+	ParallelDisassembly job;
+	job.file = &f;
+	job.cfg = cfg;
+	job.next_chunk_to_print = 0;
+	job.success = true;
+	ParallelChunk chunk;
+	chunk.start_vm = start_vm;
+	chunk.finished = false;
+	chunk.failed = false;
+	for (std::vector<unsigned>::const_iterator cit = split_points.begin(); cit != split_points.end(); ++ cit) {
+		if (*cit - chunk.start_vm >= chunk_size) {
+			chunk.bytes = *cit - chunk.start_vm;
+			job.chunks.push_back(chunk);
+			chunk.start_vm = *cit;
+		}
+	}
+	chunk.bytes = end_vm - chunk.start_vm;
+	job.chunks.push_back(chunk);
+	
+	ThumbDumbDisassembler emulator (f);
+	emulator.set_emulate_only(true);
+	for (std::vector<ParallelChunk>::iterator it = job.chunks.begin(); it != job.chunks.end(); ++ it) {
+		emulator.save_state(it->state);
+		emulator.disassemble_in_range(it->start_vm, it->bytes);
+	}
+	
+	parallel_for(thread_count, job.chunks.size(), &disassemble_chunk, &job);
+	return job.success;
+}
+
+#pragma mark -
+
+static const char* const reference_kind_names[] = {"symbol", "CFString", "C string", "selector", "class", "protocol", "ivar", "method"};
+
+// Record the references made by the instructions in the range, without printing the disassembly.
+static bool write_xref_index(MachO_File& f, unsigned start_vm, size_t range_bytes, const char* index_path) {
+	std::vector<XrefIndex::Reference> references;
+	ThumbDumbDisassembler d (f);
+	d.set_emulate_only(true);
+	d.set_reference_collector(&references);
+	d.disassemble_in_range(start_vm, range_bytes);
+	
+	if (!XrefIndex::write(index_path, f, references)) {
+		fprintf(stderr, "Error: Cannot write the cross-reference index to \"%s\".\n", index_path);
+		return false;
+	}
+	printf(" ; %lu references written to %s\n", static_cast<unsigned long>(references.size()), index_path);
+	return true;
+}
+
+static void print_referrers(const XrefIndex& index, const XrefIndex::Target& target) {
+	std::pair<const unsigned*, const unsigned*> referrers = index.referrers_of(target);
+	const char* kind = target.kind < sizeof(reference_kind_names)/sizeof(reference_kind_names[0]) ? reference_kind_names[target.kind] : "?";
+	printf(" ; %s (%s at 0x%x): %lu references\n", index.name_of(target), kind, target.address, static_cast<unsigned long>(referrers.second - referrers.first));
+	for (const unsigned* referrer = referrers.first; referrer != referrers.second; ++ referrer)
+		printf("%08x\n", *referrer);
+}
+
+// The query is an address if it starts with 0x, otherwise the name of a symbol, string, selector, etc.
+static bool query_xref_index(const char* index_path, const char* query) {
+	XrefIndex index (index_path);
+	
+	bool found = false;
+	if (query[0] == '0' && (query[1] == 'x' || query[1] == 'X')) {
+		const XrefIndex::Target* target = index.target_at(static_cast<unsigned>(std::strtoul(query, NULL, 16)));
+		if (target != NULL) {
+			print_referrers(index, *target);
+			found = true;
+		}
+	} else {
+		std::pair<const unsigned*, const unsigned*> targets = index.targets_named(query);
+		for (const unsigned* cit = targets.first; cit != targets.second; ++ cit) {
+			if (*cit < index.target_count()) {
+				print_referrers(index, index.target(*cit));
+				found = true;
+			}
+		}
+	}
+	
+	if (!found)
+		fprintf(stderr, "Error: Nothing in the index references %s.\n", query);
+	return found;
+}
+
+#pragma mark -
+
 int main (int argc, char* argv[]) {
+	bool run_benchmark = false, run_parallel = false, find_functions = false;
+	unsigned thread_count = 0;
+	const char* write_index_path = NULL;
+	const char* query_index_path = NULL;
+	int retval = 0;
+	while (argc >= 2 && argv[1][0] == '-') {
+		if (std::strcmp(argv[1], "-b") == 0) {
+			run_benchmark = true;
+			-- argc;
+			++ argv;
+		} else if (std::strcmp(argv[1], "-g") == 0) {
+			find_functions = true;
+			-- argc;
+			++ argv;
+		} else if (std::strcmp(argv[1], "-w") == 0 && argc >= 3) {
+			write_index_path = argv[2];
+			argc -= 2;
+			argv += 2;
+		} else if (std::strcmp(argv[1], "-r") == 0 && argc >= 3) {
+			query_index_path = argv[2];
+			argc -= 2;
+			argv += 2;
+		} else if (std::strcmp(argv[1], "-j") == 0 && argc >= 3) {
+			run_parallel = true;
+			thread_count = static_cast<unsigned>(std::strtoul(argv[2], NULL, 10));
+			argc -= 2;
+			argv += 2;
+		} else
+			break;
+	}
+	if (run_parallel && thread_count == 0)
+		thread_count = processor_count();
+	
 	if (argc < 2) {
-		printf("thumb-ddis <filename> [<start-vmaddr> [<end-vmaddr>]]");
+		printf("thumb-ddis [-b] [-g] [-j <threads>] [-w <index>] <filename> [<start-vmaddr> [<end-vmaddr>]]\n"
+			   "thumb-ddis -r <index> <0xaddress|name>\n\n"
+			   "  -b    Benchmark the table-driven decoder against the pattern-matching decoder, and the buffered output against stdio,\n"
+			   "        instead of printing the disassembly.\n"
+			   "  -g    Find functions and basic blocks by following the control flow, and label those without symbols.\n"
+			   "  -j    Split the range at function boundaries and disassemble the pieces on <threads> threads (0 = one per processor).\n"
+			   "  -w    Write the cross-references of the range to <index> instead of printing the disassembly.\n"
+			   "  -r    Print the instructions referencing an address or a name, as recorded in <index>.\n");
+	} else if (query_index_path != NULL) {
+		if (!query_xref_index(query_index_path, argv[1]))
+			retval = 1;
 	} else {
-		MachO_File f = MachO_File(argv[1]);
-		
-		printf(" ;  FileLoc\t  VMAddr\t    Size\tSectName\n");
-		f.for_each_section(&print_section);
-
-		ThumbDumbDisassembler d = ThumbDumbDisassembler(f);
+		MachO_File f (argv[1]);
 		
 		const section* text_section = f.section_having_name("__TEXT", "__text");
 		
@@ -54,8 +367,34 @@ int main (int argc, char* argv[]) {
 		if (argc >= 4)
 			sscanf(argv[3], "%x", &end_vm);
 		
-		d.disassemble_in_range(start_vm, end_vm-start_vm+2);
+		if (run_benchmark) {
+			if (!benchmark(f, start_vm, end_vm))
+				retval = 1;
+		} else if (write_index_path != NULL) {
+			if (!write_xref_index(f, start_vm, end_vm-start_vm+2, write_index_path))
+				retval = 1;
+		} else {
+			printf(" ;  FileLoc\t  VMAddr\t    Size\tSectName\n");
+			f.for_each_section(&print_section);
+			
+			ControlFlowGraph* cfg = NULL;
+			if (find_functions) {
+				cfg = new ControlFlowGraph(f, start_vm, end_vm-start_vm+2);
+				printf(" ; %lu functions and %lu basic blocks found.\n", static_cast<unsigned long>(cfg->function_count()), static_cast<unsigned long>(cfg->block_count()));
+			}
+			
+			if (run_parallel) {
+				if (!disassemble_in_parallel(f, start_vm, end_vm-start_vm+2, thread_count, cfg))
+					retval = 1;
+			} else {
+				ThumbDumbDisassembler d (f);
+				d.set_control_flow_graph(cfg);
+				d.disassemble_in_range(start_vm, end_vm-start_vm+2);
+			}
+			
+			delete cfg;
+		}
 	}
 	
-	return 0;
+	return retval;
 }